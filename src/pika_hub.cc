@@ -121,6 +121,32 @@ int main(int argc, char** argv) {
   options.info_log_level = static_cast<rocksutil::InfoLogLevel>(
       g_pika_hub_conf->info_log_level());
   options.pika_servers = g_pika_hub_conf->pika_servers();
+  options.binlog_ring_capacity = g_pika_hub_conf->binlog_ring_capacity() > 0 ?
+    g_pika_hub_conf->binlog_ring_capacity() : 0;
+  options.binlog_writer_thread = g_pika_hub_conf->binlog_writer_thread();
+  options.binlog_partitions = g_pika_hub_conf->binlog_partitions();
+  options.binlog_wakeup_bytes = g_pika_hub_conf->binlog_wakeup_bytes();
+  options.binlog_wakeup_delay_us = g_pika_hub_conf->binlog_wakeup_delay_us();
+  options.binlog_catchup_readahead =
+    g_pika_hub_conf->binlog_catchup_readahead();
+  options.binlog_catchup_prefetch = g_pika_hub_conf->binlog_catchup_prefetch();
+  options.binlog_mmap_segments = g_pika_hub_conf->binlog_mmap_segments();
+  options.binlog_compression = g_pika_hub_conf->binlog_compression();
+  options.binlog_sync_mode = g_pika_hub_conf->binlog_sync_mode();
+  options.binlog_sync_interval_ms = g_pika_hub_conf->binlog_sync_interval_ms();
+  options.binlog_sync_bytes = g_pika_hub_conf->binlog_sync_bytes();
+  options.binlog_file_size = g_pika_hub_conf->binlog_file_size();
+  options.binlog_purge_interval = g_pika_hub_conf->binlog_purge_interval();
+  options.binlog_retention_files = g_pika_hub_conf->binlog_retention_files();
+  options.binlog_compact_interval =
+    g_pika_hub_conf->binlog_compact_interval();
+  options.conflict_table_capacity = g_pika_hub_conf->conflict_table_capacity();
+  options.sender_threads = g_pika_hub_conf->sender_threads();
+  options.sender_coalesce_records = g_pika_hub_conf->sender_coalesce_records();
+  options.sender_coalesce_bytes = g_pika_hub_conf->sender_coalesce_bytes();
+  options.sender_coalesce_ms = g_pika_hub_conf->sender_coalesce_ms();
+  options.sender_compression = g_pika_hub_conf->sender_compression();
+  options.binlog_mirror = g_pika_hub_conf->binlog_mirror();
 
   SignalSetup();
   InitCmdInfoTable();
@@ -59,8 +59,14 @@ void InfoCmd::Do() {
     g_pika_hub_server->last_qps() << "\r\n";
   tmp_stream << "total_commands_processed:" <<
     g_pika_hub_server->query_num() << "\r\n";
-  tmp_stream << "lru_cache_record_num:" <<
-    g_pika_hub_server->binlog_manager()->GetLruMemUsage() << "\r\n";
+  tmp_stream << "conflict_table_record_num:" <<
+    g_pika_hub_server->binlog_manager()->conflict_table()->size() << "\r\n";
+  tmp_stream << "conflict_table_memory:" << g_pika_hub_server->
+    binlog_manager()->conflict_table()->memory_usage() << "\r\n";
+  tmp_stream << "binlog_ring_usage:" <<
+    g_pika_hub_server->binlog_manager()->GetRingMemUsage() << "\r\n";
+  tmp_stream << "# Binlog\r\n";
+  tmp_stream << g_pika_hub_server->binlog_manager()->DumpStats();
 
   if (g_pika_hub_server->is_primary()) {
     tmp_stream << "# Info for [Primary]\r\n";
@@ -94,6 +100,7 @@ void InfoCmd::Do() {
     int64_t seconds_to_expire = static_cast<int64_t>(lease_deadline / 1000000 -
         now / 1000000);
     tmp_stream << "seconds_to_expire_lease: " << seconds_to_expire << "\r\n";
+    tmp_stream << g_pika_hub_server->DumpBinlogMirror();
   }
 
   info.append(tmp_stream.str());
@@ -219,3 +226,73 @@ void RemoveCmd::Do() {
   }
   return;
 }
+
+void PurgelogstoCmd::DoInitial(const PikaCmdArgsType &argv,
+    const CmdInfo* const ptr_info) {
+  if (!ptr_info->CheckArg(argv.size())) {
+    res_.SetRes(CmdRes::kWrongNum, kCmdNamePurgelogsto);
+    return;
+  }
+  // both binlog_<n> and <n> are accepted
+  std::string filename = argv[1];
+  slash::StringToLower(filename);
+  if (filename.compare(0, strlen(kBinlogPrefix), kBinlogPrefix) == 0) {
+    filename = filename.substr(strlen(kBinlogPrefix));
+  }
+  unsigned long num;
+  if (filename.empty() ||
+      !slash::string2ul(filename.data(), filename.size(), &num)) {
+    res_.SetRes(CmdRes::kInvalidParameter);
+    return;
+  }
+  num_ = num;
+}
+
+void PurgelogstoCmd::Do() {
+  slash::Status s = g_pika_hub_server->PurgeBinlogs(num_);
+  if (s.ok()) {
+    res_.SetRes(CmdRes::kOk);
+  } else if (s.IsIncomplete()) {
+    res_.SetRes(CmdRes::kPurgeExist);
+  } else {
+    res_.SetRes(CmdRes::kErrOther,
+        "This operation is only allowed for the primary node");
+  }
+}
+
+void HubbinlogCmd::DoInitial(const PikaCmdArgsType &argv,
+    const CmdInfo* const ptr_info) {
+  if (!ptr_info->CheckArg(argv.size())) {
+    res_.SetRes(CmdRes::kWrongNum, kCmdNameHubbinlog);
+    return;
+  }
+  unsigned long number, offset;
+  if (!slash::string2ul(argv[1].data(), argv[1].size(), &number) ||
+      !slash::string2ul(argv[2].data(), argv[2].size(), &offset)) {
+    res_.SetRes(CmdRes::kInvalidParameter);
+    return;
+  }
+  number_ = number;
+  offset_ = offset;
+}
+
+void HubbinlogCmd::Do() {
+  if (!g_pika_hub_server->is_primary()) {
+    res_.SetRes(CmdRes::kErrOther,
+        "This operation is only allowed for the primary node");
+    return;
+  }
+  std::string meta, index, data;
+  slash::Status s = g_pika_hub_server->ReadBinlogForMirror(number_, offset_,
+      &meta, &index, &data);
+  if (s.ok()) {
+    res_.AppendArrayLen(3);
+    res_.AppendString(meta);
+    res_.AppendString(index);
+    res_.AppendString(data);
+  } else if (s.IsNotFound()) {
+    res_.SetRes(CmdRes::kErrOther, kMirrorDiverged);
+  } else {
+    res_.SetRes(CmdRes::kErrOther, s.ToString());
+  }
+}
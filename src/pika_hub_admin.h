@@ -90,4 +90,31 @@ class RemoveCmd : public Cmd {
   std::string addr_;
 };
 
+class PurgelogstoCmd : public Cmd {
+ public:
+  PurgelogstoCmd() : num_(0) {}
+  virtual void Do() override;
+
+ private:
+  virtual void DoInitial(const PikaCmdArgsType &argvs,
+      const CmdInfo* const ptr_info) override;
+  uint64_t num_;
+};
+
+/*
+ * hubbinlog <number> <offset>, sent by the BinlogMirror of a secondary,
+ * see PikaHubServer::ReadBinlogForMirror
+ */
+class HubbinlogCmd : public Cmd {
+ public:
+  HubbinlogCmd() : number_(0), offset_(0) {}
+  virtual void Do() override;
+
+ private:
+  virtual void DoInitial(const PikaCmdArgsType &argvs,
+      const CmdInfo* const ptr_info) override;
+  uint64_t number_;
+  uint64_t offset_;
+};
+
 #endif  // SRC_PIKA_HUB_ADMIN_H_
@@ -0,0 +1,86 @@
+//  Copyright (c) 2017-present The pika_hub Authors.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#include "src/pika_hub_binlog_batch.h"
+#include "src/pika_hub_binlog_compression.h"
+
+#include <string>
+#include <vector>
+
+#include "rocksutil/coding.h"
+
+BinlogBatch::BinlogBatch(std::string* content)
+  : corrupted_(false) {
+  owned_.swap(*content);
+  content_ = owned_;
+  Decode();
+}
+
+BinlogBatch::BinlogBatch(const rocksutil::Slice& content,
+    std::shared_ptr<const void> pin)
+  : pin_(pin), content_(content), corrupted_(false) {
+  Decode();
+}
+
+void BinlogBatch::Decode() {
+  if (IsCompressedGroup(content_)) {
+    std::string raw;
+    if (!UncompressGroup(content_, &raw).ok()) {
+      corrupted_ = true;
+      owned_.clear();
+      content_ = rocksutil::Slice();
+      pin_.reset();
+      return;
+    }
+    owned_.swap(raw);
+    content_ = owned_;
+    // the records point into owned_ only
+    pin_.reset();
+  }
+  DecodeBinlogContent(content_, &records_);
+}
+
+void BinlogBatch::EncodeRecord(const BinlogFields& fields,
+    std::string* dst) {
+  dst->append(reinterpret_cast<const char*>(&fields.op), sizeof(uint8_t));
+  rocksutil::PutFixed32(dst, fields.server_id);
+  rocksutil::PutFixed32(dst, fields.exec_time);
+  rocksutil::PutFixed32(dst, fields.filenum);
+  rocksutil::PutFixed32(dst, fields.key.size());
+  dst->append(fields.key.data(), fields.key.size());
+  rocksutil::PutFixed32(dst, fields.value.size());
+  dst->append(fields.value.data(), fields.value.size());
+}
+
+void BinlogBatch::DecodeBinlogContent(const rocksutil::Slice& content,
+    std::vector<BinlogFields>* result) {
+  int32_t pos = 0;
+  int32_t total = content.size();
+
+  uint8_t op = 0;
+  int32_t server_id = 0;
+  int32_t exec_time = 0;
+  int32_t filenum = 0;
+  int32_t key_size = 0;
+  int32_t value_size = 0;
+
+  result->clear();
+  while (pos + 1 < total) {
+    op = static_cast<uint8_t>(*(content.data() + pos));
+    server_id = rocksutil::DecodeFixed32(content.data() + pos + 1);
+    exec_time = rocksutil::DecodeFixed32(content.data() + pos + 5);
+    filenum = rocksutil::DecodeFixed32(content.data() + pos + 9);
+    key_size = rocksutil::DecodeFixed32(content.data() + pos + 13);
+    value_size = rocksutil::DecodeFixed32(content.data() + pos
+        + 17 + key_size);
+
+    result->push_back({op, server_id, exec_time, filenum,
+        rocksutil::Slice(content.data() + pos + 17, key_size),
+        rocksutil::Slice(content.data() + pos + 21 + key_size, value_size)
+        });
+
+    pos += (21 + key_size + value_size);
+  }
+}
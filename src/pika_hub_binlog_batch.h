@@ -0,0 +1,66 @@
+//  Copyright (c) 2017-present The pika_hub Authors.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#ifndef SRC_PIKA_HUB_BINLOG_BATCH_H_
+#define SRC_PIKA_HUB_BINLOG_BATCH_H_
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "src/pika_hub_common.h"
+
+/*
+ * BinlogBatch is a decoded binlog group. It is immutable once created, so
+ * one batch could be shared by all the BinlogSenders, the key & value of
+ * every record point into the content owned or pinned by the batch.
+ */
+class BinlogBatch {
+ public:
+  /*
+   * take the ownership of content, content is left empty. A compressed
+   * group is uncompressed once here, content() is always the records
+   */
+  explicit BinlogBatch(std::string* content);
+  /*
+   * decode content in place, it stays valid as long as pin is held,
+   * e.g. a group in a mapped binlog segment
+   */
+  BinlogBatch(const rocksutil::Slice& content,
+      std::shared_ptr<const void> pin);
+
+  const rocksutil::Slice& content() const {
+    return content_;
+  }
+  const std::vector<BinlogFields>& records() const {
+    return records_;
+  }
+  // the content is a compressed group which could not be uncompressed
+  bool corrupted() const {
+    return corrupted_;
+  }
+
+  // append fields to dst in the binlog encoding, the inverse of decoding
+  static void EncodeRecord(const BinlogFields& fields, std::string* dst);
+
+ private:
+  std::string owned_;
+  std::shared_ptr<const void> pin_;
+  rocksutil::Slice content_;
+  std::vector<BinlogFields> records_;
+  bool corrupted_;
+
+  void Decode();
+
+  static void DecodeBinlogContent(const rocksutil::Slice& content,
+      std::vector<BinlogFields>* result);
+
+  BinlogBatch(const BinlogBatch&);
+  BinlogBatch& operator=(const BinlogBatch&);
+};
+
+typedef std::shared_ptr<const BinlogBatch> BinlogBatchPtr;
+
+#endif  // SRC_PIKA_HUB_BINLOG_BATCH_H_
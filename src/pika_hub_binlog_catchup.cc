@@ -0,0 +1,155 @@
+//  Copyright (c) 2017-present The pika_hub Authors.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#include "src/pika_hub_binlog_catchup.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <cstring>
+#include <algorithm>
+#include <string>
+#include <utility>
+
+// the prefetch requests queued at most
+static const size_t kMaxPrefetchRequests = 64;
+
+CatchupFd::~CatchupFd() {
+  if (fd_ >= 0) {
+    close(fd_);
+  }
+}
+
+BinlogPrefetcher::~BinlogPrefetcher() {
+  set_should_stop();
+  {
+  rocksutil::MutexLock l(&mutex_);
+  cv_.SignalAll();
+  }
+  StopThread();
+}
+
+void BinlogPrefetcher::Prefetch(const std::shared_ptr<CatchupFd>& fd,
+    uint64_t offset, size_t length) {
+  rocksutil::MutexLock l(&mutex_);
+  if (requests_.size() >= kMaxPrefetchRequests) {
+    return;
+  }
+  Request request;
+  request.fd = fd;
+  request.offset = offset;
+  request.length = length;
+  requests_.push_back(request);
+  cv_.Signal();
+}
+
+void* BinlogPrefetcher::ThreadMain() {
+  while (!should_stop()) {
+    Request request;
+    {
+    rocksutil::MutexLock l(&mutex_);
+    while (requests_.empty() && !should_stop()) {
+      cv_.Wait();
+    }
+    if (should_stop()) {
+      break;
+    }
+    request = requests_.front();
+    requests_.pop_front();
+    }
+    // blocks until the range is in the page cache
+    if (readahead(request.fd->fd(), request.offset, request.length) == 0) {
+      prefetched_bytes_.fetch_add(request.length, std::memory_order_relaxed);
+    }
+  }
+  return nullptr;
+}
+
+CatchupFile::CatchupFile(std::shared_ptr<CatchupFd> fd, size_t readahead,
+    BinlogPrefetcher* prefetcher)
+  : fd_(fd),
+    readahead_(readahead),
+    prefetcher_(prefetcher),
+    buf_(new char[readahead]),
+    buf_begin_(0),
+    buf_len_(0),
+    pos_(0),
+    dropped_(0) {
+  posix_fadvise(fd_->fd(), 0, 0, POSIX_FADV_SEQUENTIAL);
+}
+
+CatchupFile::~CatchupFile() {
+  DropBehind(pos_);
+}
+
+void CatchupFile::DropBehind(uint64_t offset) {
+  if (offset > dropped_) {
+    posix_fadvise(fd_->fd(), dropped_, offset - dropped_,
+        POSIX_FADV_DONTNEED);
+    dropped_ = offset;
+  }
+}
+
+rocksutil::Status CatchupFile::Fill() {
+  ssize_t ret;
+  do {
+    ret = pread(fd_->fd(), buf_.get(), readahead_, pos_);
+  } while (ret < 0 && errno == EINTR);
+  if (ret < 0) {
+    buf_len_ = 0;
+    return rocksutil::Status::IOError("pread", strerror(errno));
+  }
+  // everything before the new chunk has been handed to the log reader
+  DropBehind(pos_);
+  buf_begin_ = pos_;
+  buf_len_ = static_cast<size_t>(ret);
+  if (prefetcher_ != nullptr && buf_len_ == readahead_) {
+    prefetcher_->Prefetch(fd_, buf_begin_ + buf_len_, readahead_);
+  }
+  return rocksutil::Status::OK();
+}
+
+rocksutil::Status CatchupFile::Read(size_t n, rocksutil::Slice* result,
+    char* scratch) {
+  size_t copied = 0;
+  while (copied < n) {
+    if (pos_ < buf_begin_ || pos_ >= buf_begin_ + buf_len_) {
+      rocksutil::Status s = Fill();
+      if (!s.ok()) {
+        return s;
+      }
+      if (buf_len_ == 0) {
+        break;
+      }
+    }
+    size_t offset = static_cast<size_t>(pos_ - buf_begin_);
+    size_t len = std::min(n - copied, buf_len_ - offset);
+    memcpy(scratch + copied, buf_.get() + offset, len);
+    copied += len;
+    pos_ += len;
+  }
+  *result = rocksutil::Slice(scratch, copied);
+  return rocksutil::Status::OK();
+}
+
+rocksutil::Status CatchupFile::Skip(uint64_t n) {
+  pos_ += n;
+  return rocksutil::Status::OK();
+}
+
+rocksutil::Status NewCatchupFile(const std::string& filename,
+    size_t readahead, BinlogPrefetcher* prefetcher,
+    std::unique_ptr<rocksutil::SequentialFile>* result) {
+  int fd;
+  do {
+    fd = open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+  } while (fd < 0 && errno == EINTR);
+  if (fd < 0) {
+    return rocksutil::Status::IOError(filename, strerror(errno));
+  }
+  result->reset(new CatchupFile(std::make_shared<CatchupFd>(fd), readahead,
+        prefetcher));
+  return rocksutil::Status::OK();
+}
@@ -0,0 +1,117 @@
+//  Copyright (c) 2017-present The pika_hub Authors.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#ifndef SRC_PIKA_HUB_BINLOG_CATCHUP_H_
+#define SRC_PIKA_HUB_BINLOG_CATCHUP_H_
+
+#include <string>
+#include <memory>
+#include <deque>
+#include <atomic>
+
+#include "src/pika_hub_common.h"
+#include "pink/include/pink_thread.h"
+#include "rocksutil/mutexlock.h"
+#include "rocksutil/env.h"
+
+// a file descriptor shared by a CatchupFile and its prefetch requests
+class CatchupFd {
+ public:
+  explicit CatchupFd(int fd) : fd_(fd) {}
+  ~CatchupFd();
+
+  int fd() const {
+    return fd_;
+  }
+
+ private:
+  int fd_;
+
+  CatchupFd(const CatchupFd&);
+  CatchupFd& operator=(const CatchupFd&);
+};
+
+/*
+ * BinlogPrefetcher reads the ranges ahead of the catch-up readers into
+ * the page cache in the background, so a lagging sender finds the next
+ * window cached while it is sending the current one. The requests beyond
+ * kMaxPrefetchRequests are dropped, the readers read them themselves
+ */
+class BinlogPrefetcher : public pink::Thread {
+ public:
+  BinlogPrefetcher()
+    : cv_(&mutex_),
+      prefetched_bytes_(0) {}
+
+  virtual ~BinlogPrefetcher();
+
+  void Prefetch(const std::shared_ptr<CatchupFd>& fd, uint64_t offset,
+      size_t length);
+
+  uint64_t prefetched_bytes() const {
+    return prefetched_bytes_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  struct Request {
+    std::shared_ptr<CatchupFd> fd;
+    uint64_t offset;
+    size_t length;
+  };
+
+  // protect requests_
+  rocksutil::port::Mutex mutex_;
+  rocksutil::port::CondVar cv_;
+  std::deque<Request> requests_;
+  std::atomic<uint64_t> prefetched_bytes_;
+
+  virtual void* ThreadMain() override;
+};
+
+/*
+ * CatchupFile reads a binlog file rolled over in readahead sized chunks,
+ * for the senders far behind the writer. The kernel is told the access
+ * is sequential, and the pages already consumed are dropped from the page
+ * cache, so a sender catching up does not evict the newest binlog the
+ * others are reading. The next chunk is handed to prefetcher if any.
+ *
+ * Only used for the files rolled over, they are never appended again
+ */
+class CatchupFile : public rocksutil::SequentialFile {
+ public:
+  CatchupFile(std::shared_ptr<CatchupFd> fd, size_t readahead,
+      BinlogPrefetcher* prefetcher);
+  virtual ~CatchupFile();
+
+  virtual rocksutil::Status Read(size_t n, rocksutil::Slice* result,
+      char* scratch) override;
+  virtual rocksutil::Status Skip(uint64_t n) override;
+
+ private:
+  std::shared_ptr<CatchupFd> fd_;
+  size_t readahead_;
+  BinlogPrefetcher* prefetcher_;
+  std::unique_ptr<char[]> buf_;
+  // buf_ holds [buf_begin_, buf_begin_ + buf_len_) of the file
+  uint64_t buf_begin_;
+  size_t buf_len_;
+  // the next byte to return
+  uint64_t pos_;
+  // the pages before dropped_ are dropped from the page cache
+  uint64_t dropped_;
+
+  rocksutil::Status Fill();
+  void DropBehind(uint64_t offset);
+
+  CatchupFile(const CatchupFile&);
+  CatchupFile& operator=(const CatchupFile&);
+};
+
+// prefetcher may be nullptr
+extern rocksutil::Status NewCatchupFile(const std::string& filename,
+    size_t readahead, BinlogPrefetcher* prefetcher,
+    std::unique_ptr<rocksutil::SequentialFile>* result);
+
+#endif  // SRC_PIKA_HUB_BINLOG_CATCHUP_H_
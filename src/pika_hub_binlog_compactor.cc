@@ -0,0 +1,297 @@
+//  Copyright (c) 2017-present The pika_hub Authors.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#include "src/pika_hub_binlog_compactor.h"
+#include "src/pika_hub_binlog_compression.h"
+
+#include <algorithm>
+#include <string>
+#include <utility>
+
+#include "rocksutil/file_reader_writer.h"
+#include "rocksutil/log_writer.h"
+
+// the binlog files folded in one round, they are all kept in memory
+static const uint64_t kCompactMaxFiles = 2;
+// the bytes of a group in the snapshot
+static const size_t kSnapshotGroupBytes = 64 * 1024;
+
+namespace {
+
+class SnapshotWriter {
+ public:
+  rocksutil::Status Open(rocksutil::Env* env, const std::string& filename,
+      BinlogCompression compression) {
+    compression_ = compression;
+    rocksutil::EnvOptions env_options;
+    env_options.use_mmap_writes = false;
+    std::unique_ptr<rocksutil::WritableFile> writable_file;
+    rocksutil::Status s = rocksutil::NewWritableFile(env, filename,
+        &writable_file, env_options);
+    if (!s.ok()) {
+      return s;
+    }
+    std::unique_ptr<rocksutil::WritableFileWriter> writable_file_writer(
+        new rocksutil::WritableFileWriter(std::move(writable_file),
+          env_options));
+    writer_.reset(new rocksutil::log::Writer(
+          std::move(writable_file_writer)));
+    return rocksutil::Status::OK();
+  }
+
+  rocksutil::Status Add(const std::string& record) {
+    rep_.append(record);
+    if (rep_.size() < kSnapshotGroupBytes) {
+      return rocksutil::Status::OK();
+    }
+    rocksutil::Status s = Flush();
+    rep_.clear();
+    return s;
+  }
+
+  rocksutil::Status Finish() {
+    rocksutil::Status s;
+    if (!rep_.empty()) {
+      s = Flush();
+      rep_.clear();
+    }
+    if (s.ok()) {
+      s = writer_->file()->Sync(false);
+    }
+    writer_.reset();
+    return s;
+  }
+
+ private:
+  BinlogCompression compression_;
+  std::unique_ptr<rocksutil::log::Writer> writer_;
+  std::string rep_;
+  std::string compressed_;
+
+  rocksutil::Status Flush() {
+    if (CompressGroup(compression_, rep_, &compressed_)) {
+      return writer_->AddRecord(compressed_);
+    }
+    return writer_->AddRecord(rep_);
+  }
+};
+
+}  // namespace
+
+BinlogCompactor::~BinlogCompactor() {
+  set_should_stop();
+  {
+  rocksutil::MutexLock l(&mutex_);
+  cv_.SignalAll();
+  }
+  StopThread();
+}
+
+void BinlogCompactor::Apply(const BinlogFields& record, Entry* entry) {
+  // the same rule as BinlogWriter::FormTaskGroup
+  if (entry->valid && (record.exec_time < entry->exec_time ||
+        (record.exec_time == entry->exec_time &&
+         record.server_id != entry->server_id))) {
+    return;
+  }
+  std::string encoded;
+  BinlogBatch::EncodeRecord(record, &encoded);
+  if (record.op == kExpireatOPCode) {
+    entry->expire.swap(encoded);
+  } else {
+    // the value after a set or del does not depend on the records before
+    entry->base.swap(encoded);
+    entry->expire.clear();
+  }
+  entry->valid = true;
+  entry->server_id = record.server_id;
+  entry->exec_time = record.exec_time;
+}
+
+void BinlogCompactor::Merge(const Entry& delta, Entry* entry) {
+  std::string content = delta.base + delta.expire;
+  BinlogBatch batch(&content);
+  for (auto& record : batch.records()) {
+    Apply(record, entry);
+  }
+}
+
+rocksutil::Status BinlogCompactor::FoldFile(uint64_t number,
+    EntryMap* delta) {
+  std::unique_ptr<SnapshotReader> reader(SnapshotReader::Open(env_,
+        log_path_ + "/" + kBinlogPrefix + std::to_string(number), number));
+  if (!reader) {
+    return rocksutil::Status::IOError("open binlog_" +
+        std::to_string(number) + " failed");
+  }
+  BinlogBatchPtr batch;
+  while (reader->Read(&batch)) {
+    for (auto& record : batch->records()) {
+      Apply(record, &(*delta)[record.key.ToString()]);
+    }
+  }
+  return reader->status();
+}
+
+rocksutil::Status BinlogCompactor::WriteSnapshot(const SnapshotMeta* old,
+    const EntryMap& delta, const std::string& filename, uint64_t* keys) {
+  *keys = 0;
+  SnapshotWriter writer;
+  rocksutil::Status s = writer.Open(env_, filename,
+      manager_->options().compression);
+  if (!s.ok()) {
+    return s;
+  }
+
+  auto emit = [&writer, keys](const Entry& entry) -> rocksutil::Status {
+    rocksutil::Status s = writer.Add(entry.base);
+    if (s.ok()) {
+      s = writer.Add(entry.expire);
+    }
+    (*keys)++;
+    return s;
+  };
+
+  auto iter = delta.begin();
+  // write the delta keys before key, then key merged with its delta
+  auto emit_old = [&](const std::string& key,
+      Entry* entry) -> rocksutil::Status {
+    rocksutil::Status s;
+    for (; iter != delta.end() && iter->first < key && s.ok(); iter++) {
+      s = emit(iter->second);
+    }
+    if (!s.ok()) {
+      return s;
+    }
+    if (iter != delta.end() && iter->first == key) {
+      Merge(iter->second, entry);
+      iter++;
+    }
+    return emit(*entry);
+  };
+
+  if (old != nullptr) {
+    std::unique_ptr<SnapshotReader> reader(SnapshotReader::Open(env_,
+          SnapshotFileName(log_path_, old->begin_number, old->end_number),
+          old->end_number));
+    if (!reader) {
+      return rocksutil::Status::IOError("open the old snapshot failed");
+    }
+    // the records of a key are adjacent in the snapshot
+    std::string key;
+    Entry entry;
+    BinlogBatchPtr batch;
+    while (s.ok() && reader->Read(&batch)) {
+      for (auto& record : batch->records()) {
+        if (entry.valid && record.key != key) {
+          s = emit_old(key, &entry);
+          if (!s.ok()) {
+            break;
+          }
+          entry = Entry();
+        }
+        key.assign(record.key.data(), record.key.size());
+        Apply(record, &entry);
+      }
+    }
+    if (s.ok()) {
+      s = reader->status();
+    }
+    if (s.ok() && entry.valid) {
+      s = emit_old(key, &entry);
+    }
+  }
+  for (; iter != delta.end() && s.ok(); iter++) {
+    s = emit(iter->second);
+  }
+
+  rocksutil::Status finish = writer.Finish();
+  return s.ok() ? finish : s;
+}
+
+rocksutil::Status BinlogCompactor::Compact(bool* more) {
+  *more = false;
+  SnapshotMeta old;
+  bool has_old = manager_->GetSnapshot(&old);
+  uint64_t first_number, writer_number, writer_offset;
+  manager_->GetFileRange(&first_number, &writer_number, &writer_offset);
+
+  SnapshotMeta meta;
+  uint64_t from = first_number;
+  if (has_old && old.end_number >= first_number) {
+    meta.begin_number = old.begin_number;
+    from = old.end_number;
+  } else {
+    if (has_old) {
+      rocksutil::Warn(info_log_, "BinlogCompactor binlog_%lu is purged "
+          "before compacted, build the snapshot from binlog_%lu",
+          old.end_number, first_number);
+      has_old = false;
+    }
+    meta.begin_number = first_number;
+  }
+  // only the files rolled over are folded
+  if (from >= writer_number) {
+    return rocksutil::Status::OK();
+  }
+  meta.end_number = std::min(writer_number, from + kCompactMaxFiles);
+  *more = meta.end_number < writer_number;
+
+  uint64_t start_us = env_->NowMicros();
+  EntryMap delta;
+  rocksutil::Status s;
+  for (uint64_t number = from; number < meta.end_number && s.ok(); number++) {
+    s = FoldFile(number, &delta);
+  }
+  if (!s.ok()) {
+    *more = false;
+    return s;
+  }
+
+  std::string filename = SnapshotFileName(log_path_, meta.begin_number,
+      meta.end_number);
+  std::string tmp = filename + kBinlogSnapshotTmpSuffix;
+  s = WriteSnapshot(has_old ? &old : nullptr, delta, tmp, &meta.keys);
+  if (s.ok()) {
+    s = env_->RenameFile(tmp, filename);
+  }
+  if (s.ok()) {
+    s = env_->GetFileSize(filename, &meta.size);
+  }
+  if (!s.ok()) {
+    env_->DeleteFile(tmp);
+    *more = false;
+    return s;
+  }
+  manager_->SetSnapshot(meta);
+  manager_->stats()->compactions++;
+  rocksutil::Info(info_log_, "BinlogCompactor snapshot of binlog %lu to %lu, "
+      "%lu keys, %lu bytes, folded %lu keys in %lu ms", meta.begin_number,
+      meta.end_number, meta.keys, meta.size, delta.size(),
+      (env_->NowMicros() - start_us) / 1000);
+  return s;
+}
+
+void* BinlogCompactor::ThreadMain() {
+  bool more = false;
+  while (!should_stop()) {
+    if (!more) {
+      rocksutil::MutexLock l(&mutex_);
+      if (!should_stop()) {
+        cv_.TimedWait(env_->NowMicros() +
+            static_cast<uint64_t>(interval_) * 1000000);
+      }
+    }
+    if (should_stop()) {
+      break;
+    }
+    rocksutil::Status s = Compact(&more);
+    if (!s.ok()) {
+      rocksutil::Error(info_log_, "BinlogCompactor compact error: %s",
+          s.ToString().c_str());
+    }
+  }
+  return nullptr;
+}
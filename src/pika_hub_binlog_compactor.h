@@ -0,0 +1,83 @@
+//  Copyright (c) 2017-present The pika_hub Authors.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#ifndef SRC_PIKA_HUB_BINLOG_COMPACTOR_H_
+#define SRC_PIKA_HUB_BINLOG_COMPACTOR_H_
+
+#include <map>
+#include <string>
+#include <memory>
+
+#include "src/pika_hub_common.h"
+#include "src/pika_hub_binlog_manager.h"
+#include "src/pika_hub_binlog_snapshot.h"
+#include "pink/include/pink_thread.h"
+#include "rocksutil/mutexlock.h"
+#include "rocksutil/auto_roll_logger.h"
+
+/*
+ * BinlogCompactor folds the binlog files rolled over into the snapshot,
+ * every interval seconds. A round reads a few files after the snapshot,
+ * keeps the last write of every key in memory, and merges them with the
+ * old snapshot into a new one, the conflicts are resolved as the writer
+ * does. So the memory used is bounded by the files folded, not by the
+ * keys in the snapshot.
+ *
+ * The snapshot is extended as long as the files after it are not purged,
+ * otherwise it is built again from the oldest binlog file.
+ */
+class BinlogCompactor : public pink::Thread {
+ public:
+  BinlogCompactor(std::shared_ptr<rocksutil::Logger> info_log,
+    rocksutil::Env* env,
+    const std::string& log_path,
+    BinlogManager* manager,
+    int interval)
+  : info_log_(info_log),
+    env_(env),
+    log_path_(log_path),
+    manager_(manager),
+    interval_(interval),
+    cv_(&mutex_) {}
+
+  virtual ~BinlogCompactor();
+
+ private:
+  // the latest state of a key
+  struct Entry {
+    Entry() : valid(false), server_id(0), exec_time(0) {}
+    // the last write accepted, to resolve the conflicts
+    bool valid;
+    int32_t server_id;
+    int32_t exec_time;
+    // the encoded set or del, and the expireat after it; may be empty
+    std::string base;
+    std::string expire;
+  };
+  typedef std::map<std::string, Entry> EntryMap;
+
+  std::shared_ptr<rocksutil::Logger> info_log_;
+  rocksutil::Env* env_;
+  std::string log_path_;
+  BinlogManager* manager_;
+  int interval_;
+
+  // wait for the interval or the stop
+  rocksutil::port::Mutex mutex_;
+  rocksutil::port::CondVar cv_;
+
+  // more is set if there are still files to fold
+  rocksutil::Status Compact(bool* more);
+  rocksutil::Status FoldFile(uint64_t number, EntryMap* delta);
+  // merge the old snapshot & delta into filename
+  rocksutil::Status WriteSnapshot(const SnapshotMeta* old,
+      const EntryMap& delta, const std::string& filename, uint64_t* keys);
+  static void Apply(const BinlogFields& record, Entry* entry);
+  // apply the records of delta after the ones in entry
+  static void Merge(const Entry& delta, Entry* entry);
+  virtual void* ThreadMain() override;
+};
+
+#endif  // SRC_PIKA_HUB_BINLOG_COMPACTOR_H_
@@ -0,0 +1,234 @@
+//  Copyright (c) 2017-present The pika_hub Authors.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#include "src/pika_hub_binlog_compression.h"
+
+#include <zlib.h>
+#include <snappy.h>
+#ifdef ZSTD
+#include <zstd.h>
+#endif
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+
+#include "rocksutil/coding.h"
+
+// the groups smaller than this are written as is
+static const size_t kCompressMinBytes = 128;
+// fast, the leader compresses with the other workers waiting
+static const int kZlibLevel = 1;
+static const int kZstdLevel = 1;
+/*
+ * the uncompressed size is read from the input, do not trust a
+ * corrupted one to allocate more than this
+ */
+static const uint32_t kUncompressMaxBytes = 256 * 1024 * 1024;
+
+bool BinlogCompressionSupported(BinlogCompression type) {
+  switch (type) {
+    case kNoCompression:
+    case kSnappyCompression:
+    case kZlibCompression:
+      return true;
+    case kZstdCompression:
+#ifdef ZSTD
+      return true;
+#else
+      return false;
+#endif
+    default:
+      return false;
+  }
+}
+
+const char* BinlogCompressionName(BinlogCompression type) {
+  switch (type) {
+    case kSnappyCompression:
+      return "snappy";
+    case kZlibCompression:
+      return "zlib";
+    case kZstdCompression:
+      return "zstd";
+    default:
+      return "none";
+  }
+}
+
+bool ParseBinlogCompression(const std::string& name,
+    BinlogCompression* type) {
+  if (name == "none") {
+    *type = kNoCompression;
+  } else if (name == "snappy") {
+    *type = kSnappyCompression;
+  } else if (name == "zlib") {
+    *type = kZlibCompression;
+  } else if (name == "zstd") {
+    *type = kZstdCompression;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+bool CompressGroup(BinlogCompression type, const rocksutil::Slice& raw,
+    std::string* output) {
+  if (type == kNoCompression || raw.size() < kCompressMinBytes ||
+      raw.size() > kUncompressMaxBytes || !BinlogCompressionSupported(type)) {
+    return false;
+  }
+  output->clear();
+  output->push_back(static_cast<char>(kBinlogCompressedFlag | type));
+  rocksutil::PutVarint32(output, static_cast<uint32_t>(raw.size()));
+  size_t header = output->size();
+
+  switch (type) {
+    case kSnappyCompression: {
+      std::string compressed;
+      snappy::Compress(raw.data(), raw.size(), &compressed);
+      output->append(compressed);
+      break;
+    }
+    case kZlibCompression: {
+      uLongf len = compressBound(raw.size());
+      output->resize(header + len);
+      if (compress2(reinterpret_cast<Bytef*>(&(*output)[header]), &len,
+            reinterpret_cast<const Bytef*>(raw.data()), raw.size(),
+            kZlibLevel) != Z_OK) {
+        return false;
+      }
+      output->resize(header + len);
+      break;
+    }
+#ifdef ZSTD
+    case kZstdCompression: {
+      size_t len = ZSTD_compressBound(raw.size());
+      output->resize(header + len);
+      len = ZSTD_compress(&(*output)[header], len, raw.data(), raw.size(),
+          kZstdLevel);
+      if (ZSTD_isError(len)) {
+        return false;
+      }
+      output->resize(header + len);
+      break;
+    }
+#endif
+    default:
+      return false;
+  }
+  // keep the group as is unless it shrinks by 1/8 at least
+  return output->size() < raw.size() - raw.size() / 8;
+}
+
+rocksutil::Status UncompressGroup(const rocksutil::Slice& content,
+    std::string* raw) {
+  rocksutil::Slice input(content);
+  uint8_t type = static_cast<uint8_t>(input[0]) & ~kBinlogCompressedFlag;
+  input.remove_prefix(1);
+  uint32_t size = 0;
+  if (!rocksutil::GetVarint32(&input, &size)) {
+    return rocksutil::Status::Corruption("bad compressed group header");
+  }
+  if (size > kUncompressMaxBytes) {
+    return rocksutil::Status::Corruption("compressed group too large");
+  }
+
+  raw->clear();
+  switch (type) {
+    case kSnappyCompression: {
+      size_t len = 0;
+      if (!snappy::GetUncompressedLength(input.data(), input.size(), &len) ||
+          len != size) {
+        return rocksutil::Status::Corruption("compressed group size mismatch");
+      }
+      if (!snappy::Uncompress(input.data(), input.size(), raw)) {
+        return rocksutil::Status::Corruption("snappy uncompress failed");
+      }
+      break;
+    }
+    case kZlibCompression: {
+      raw->resize(size);
+      uLongf len = size;
+      if (uncompress(reinterpret_cast<Bytef*>(&(*raw)[0]), &len,
+            reinterpret_cast<const Bytef*>(input.data()), input.size()) !=
+          Z_OK) {
+        return rocksutil::Status::Corruption("zlib uncompress failed");
+      }
+      raw->resize(len);
+      break;
+    }
+#ifdef ZSTD
+    case kZstdCompression: {
+      raw->resize(size);
+      size_t len = ZSTD_decompress(&(*raw)[0], size, input.data(),
+          input.size());
+      if (ZSTD_isError(len)) {
+        return rocksutil::Status::Corruption("zstd uncompress failed");
+      }
+      raw->resize(len);
+      break;
+    }
+#endif
+    default:
+      return rocksutil::Status::NotSupported("binlog compression type " +
+          std::to_string(type));
+  }
+  if (raw->size() != size) {
+    return rocksutil::Status::Corruption("compressed group size mismatch");
+  }
+  return rocksutil::Status::OK();
+}
+
+void AppendHubzFrame(BinlogCompression type, const rocksutil::Slice& raw,
+    std::string* dst) {
+  rocksutil::Slice input(raw);
+  std::string body;
+  do {
+    // the bound DecodeHubzFrame checks
+    rocksutil::Slice chunk(input.data(),
+        std::min<size_t>(input.size(), kUncompressMaxBytes));
+    input.remove_prefix(chunk.size());
+    if (!CompressGroup(type, chunk, &body)) {
+      body.assign(1, '\0');
+      body.append(chunk.data(), chunk.size());
+    }
+    dst->append(kHubzMagic, sizeof(kHubzMagic) - 1);
+    rocksutil::PutFixed32(dst, static_cast<uint32_t>(body.size()));
+    dst->append(body);
+  } while (!input.empty());
+}
+
+int DecodeHubzFrame(const rocksutil::Slice& input, size_t* consumed,
+    std::string* raw) {
+  const size_t header = sizeof(kHubzMagic) - 1 + sizeof(uint32_t);
+  if (input.size() < header) {
+    return 0;
+  }
+  if (memcmp(input.data(), kHubzMagic, sizeof(kHubzMagic) - 1) != 0) {
+    return -1;
+  }
+  uint32_t size = rocksutil::DecodeFixed32(input.data() +
+      sizeof(kHubzMagic) - 1);
+  // do not wait for a corrupted size to be buffered
+  if (size == 0 || size > kUncompressMaxBytes + 1) {
+    return -1;
+  }
+  if (input.size() < header + size) {
+    return 0;
+  }
+  rocksutil::Slice body(input.data() + header, size);
+  if (IsCompressedGroup(body)) {
+    if (!UncompressGroup(body, raw).ok()) {
+      return -1;
+    }
+  } else if (body[0] == '\0') {
+    raw->assign(body.data() + 1, body.size() - 1);
+  } else {
+    return -1;
+  }
+  *consumed = header + size;
+  return 1;
+}
@@ -0,0 +1,59 @@
+//  Copyright (c) 2017-present The pika_hub Authors.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#ifndef SRC_PIKA_HUB_BINLOG_COMPRESSION_H_
+#define SRC_PIKA_HUB_BINLOG_COMPRESSION_H_
+
+#include <string>
+
+#include "src/pika_hub_common.h"
+#include "rocksutil/slice.h"
+#include "rocksutil/status.h"
+
+/*
+ * A compressed binlog group is
+ *   kBinlogCompressedFlag | codec (1 byte)
+ *   uncompressed size (varint32)
+ *   compressed records
+ * the first byte of a plain group is an op code, which never has the
+ * flag bit, so both kinds are found in the same file
+ */
+
+// false if the codec is not built in
+extern bool BinlogCompressionSupported(BinlogCompression type);
+extern const char* BinlogCompressionName(BinlogCompression type);
+// the inverse of BinlogCompressionName, return false if name is unknown
+extern bool ParseBinlogCompression(const std::string& name,
+    BinlogCompression* type);
+// return false if type is kNoCompression, not built in or not worth it
+extern bool CompressGroup(BinlogCompression type,
+    const rocksutil::Slice& raw, std::string* output);
+inline bool IsCompressedGroup(const rocksutil::Slice& content) {
+  return !content.empty() &&
+    (static_cast<uint8_t>(content[0]) & kBinlogCompressedFlag) != 0;
+}
+extern rocksutil::Status UncompressGroup(const rocksutil::Slice& content,
+    std::string* raw);
+
+/*
+ * A compressed replication stream starts with the RESP command
+ * "hubcompress <codec>", followed by hubz frames of RESP commands:
+ *   "hubz" (4 bytes)
+ *   body size (fixed32)
+ *   body: a compressed group, or 0x00 and the commands as is
+ * The body holds at most the uncompressed size of a group, larger input
+ * is split into several frames, so a command may span frames
+ */
+extern void AppendHubzFrame(BinlogCompression type,
+    const rocksutil::Slice& raw, std::string* dst);
+/*
+ * Decode the frame at the front of input into raw, consumed is its size.
+ * Return 1 if a frame is decoded, 0 if more bytes are needed, -1 if the
+ * frame is corrupted
+ */
+extern int DecodeHubzFrame(const rocksutil::Slice& input, size_t* consumed,
+    std::string* raw);
+
+#endif  // SRC_PIKA_HUB_BINLOG_COMPRESSION_H_
@@ -0,0 +1,101 @@
+//  Copyright (c) 2017-present The pika_hub Authors.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#include "src/pika_hub_binlog_index.h"
+
+#include <utility>
+#include <string>
+
+#include "src/pika_hub_common.h"
+#include "rocksutil/coding.h"
+
+rocksutil::Status BinlogIndexWriter::Add(uint64_t begin) {
+  if (begin < last_ + kBinlogIndexInterval) {
+    return rocksutil::Status::OK();
+  }
+  std::string entry;
+  rocksutil::PutFixed64(&entry, begin);
+  rocksutil::Status s = file_->Append(entry);
+  if (s.ok()) {
+    last_ = begin;
+  }
+  return s;
+}
+
+BinlogIndexWriter* CreateBinlogIndexWriter(rocksutil::Env* env,
+    const std::string& filename) {
+  rocksutil::EnvOptions env_options;
+  env_options.use_mmap_reads = false;
+  env_options.use_mmap_writes = false;
+  std::unique_ptr<rocksutil::WritableFile> file;
+  rocksutil::Status s = env->NewWritableFile(filename, &file, env_options);
+  if (!s.ok()) {
+    return nullptr;
+  }
+  return new BinlogIndexWriter(std::move(file));
+}
+
+uint64_t SeekBinlogIndex(rocksutil::Env* env,
+    const std::string& filename, uint64_t offset) {
+  rocksutil::EnvOptions env_options;
+  std::unique_ptr<rocksutil::SequentialFile> file;
+  rocksutil::Status s = env->NewSequentialFile(filename, &file, env_options);
+  if (!s.ok()) {
+    return 0;
+  }
+
+  uint64_t result = 0;
+  char scratch[8 * 512];
+  rocksutil::Slice fragment;
+  while (true) {
+    s = file->Read(sizeof(scratch), &fragment, scratch);
+    // a partial entry is left by a crash, ignore it
+    if (!s.ok() || fragment.size() < 8) {
+      break;
+    }
+    for (size_t i = 0; i + 8 <= fragment.size(); i += 8) {
+      uint64_t begin = rocksutil::DecodeFixed64(fragment.data() + i);
+      if (begin > offset) {
+        return result;
+      }
+      result = begin;
+    }
+    if (fragment.size() < sizeof(scratch)) {
+      break;
+    }
+  }
+  return result;
+}
+
+void ListBinlogIndex(rocksutil::Env* env, const std::string& filename,
+    uint64_t begin, uint64_t end, std::string* entries) {
+  rocksutil::EnvOptions env_options;
+  std::unique_ptr<rocksutil::SequentialFile> file;
+  rocksutil::Status s = env->NewSequentialFile(filename, &file, env_options);
+  if (!s.ok()) {
+    return;
+  }
+
+  char scratch[8 * 512];
+  rocksutil::Slice fragment;
+  while (true) {
+    s = file->Read(sizeof(scratch), &fragment, scratch);
+    if (!s.ok() || fragment.size() < 8) {
+      break;
+    }
+    for (size_t i = 0; i + 8 <= fragment.size(); i += 8) {
+      uint64_t entry = rocksutil::DecodeFixed64(fragment.data() + i);
+      if (entry >= end) {
+        return;
+      }
+      if (entry >= begin) {
+        entries->append(fragment.data() + i, 8);
+      }
+    }
+    if (fragment.size() < sizeof(scratch)) {
+      break;
+    }
+  }
+}
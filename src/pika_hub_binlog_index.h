@@ -0,0 +1,56 @@
+//  Copyright (c) 2017-present The pika_hub Authors.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#ifndef SRC_PIKA_HUB_BINLOG_INDEX_H_
+#define SRC_PIKA_HUB_BINLOG_INDEX_H_
+
+#include <string>
+#include <memory>
+
+#include "rocksutil/env.h"
+
+/*
+ * binlog_<n>.index is a sparse index of the group boundaries in
+ * binlog_<n>, every entry is the Fixed64 offset where a group begins, and
+ * the entries are at least kBinlogIndexInterval bytes apart. A log::Reader
+ * created with such an offset starts exactly from that group.
+ * The index is only a hint, a missing or truncated index just makes
+ * the readers start earlier.
+ */
+class BinlogIndexWriter {
+ public:
+  explicit BinlogIndexWriter(std::unique_ptr<rocksutil::WritableFile>&& file)
+    : file_(std::move(file)), last_(0) {}
+
+  // called with the begin offset of every group, in order
+  rocksutil::Status Add(uint64_t begin);
+
+ private:
+  std::unique_ptr<rocksutil::WritableFile> file_;
+  uint64_t last_;
+
+  BinlogIndexWriter(const BinlogIndexWriter&);
+  BinlogIndexWriter& operator=(const BinlogIndexWriter&);
+};
+
+extern BinlogIndexWriter* CreateBinlogIndexWriter(rocksutil::Env* env,
+    const std::string& filename);
+
+/*
+ * Return the last indexed group boundary not after offset in the binlog
+ * file indexed by filename, 0 if there is none
+ */
+extern uint64_t SeekBinlogIndex(rocksutil::Env* env,
+    const std::string& filename, uint64_t offset);
+
+/*
+ * Append the Fixed64 entries of the index in [begin, end) to entries,
+ * used to ship the index of a binlog file along with its bytes
+ */
+extern void ListBinlogIndex(rocksutil::Env* env,
+    const std::string& filename, uint64_t begin, uint64_t end,
+    std::string* entries);
+
+#endif  // SRC_PIKA_HUB_BINLOG_INDEX_H_
@@ -4,22 +4,141 @@
 //  of patent rights can be found in the PATENTS file in the same directory.
 
 #include "src/pika_hub_binlog_manager.h"
+#include "src/pika_hub_binlog_index.h"
+#include "src/pika_hub_binlog_compression.h"
 #include "src/pika_hub_common.h"
 #include <string>
 #include <vector>
+#include <algorithm>
+#include <deque>
+#include <future>
+#include <utility>
 #include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+
+#include "rocksutil/file_reader_writer.h"
+#include "rocksutil/log_reader.h"
+
+// the binlog files decoded at the same time by RecoverConflictTable
+const size_t kRecoverThreads = 4;
 
 BinlogWriter* BinlogManager::AddWriter() {
+  {
+  rocksutil::MutexLock l(&mutex_);
+  start_number_ = number_;
+  }
   return CreateBinlogWriter(log_path_, number_,
       env_, this);
 }
 
 BinlogReader* BinlogManager::AddReader(uint64_t number,
     uint64_t offset) {
+  {
+  rocksutil::MutexLock l(&mutex_);
+  if (number < first_number_) {
+    rocksutil::Warn(info_log_, "binlog_%lu has been purged, read from "
+        "binlog_%lu instead", number, first_number_);
+    number = first_number_;
+    offset = 0;
+  }
+  }
   return CreateBinlogReader(log_path_, env_,
       number, offset, this);
 }
 
+BinlogReader* BinlogManager::AddResumeReader(uint64_t number,
+    uint64_t offset) {
+  if (number == 0 && offset == 0) {
+    rocksutil::MutexLock l(&mutex_);
+    number = start_number_;
+  }
+  uint64_t start = 0;
+  if (offset > kBinlogResendWindow) {
+    start = SeekBinlogIndex(env_, log_path_ + "/" + kBinlogPrefix +
+        std::to_string(number) + kBinlogIndexSuffix,
+        offset - kBinlogResendWindow);
+  }
+  return AddReader(number, start);
+}
+
+void BinlogManager::AddWaiter(BinlogWaiter* waiter) {
+  rocksutil::MutexLock l(&waiters_mutex_);
+  waiters_.push_back(waiter);
+}
+
+void BinlogManager::RemoveWaiter(BinlogWaiter* waiter) {
+  rocksutil::MutexLock l(&waiters_mutex_);
+  waiters_.erase(std::remove(waiters_.begin(), waiters_.end(), waiter),
+      waiters_.end());
+}
+
+void BinlogManager::WakeWaiter(BinlogWaiter* waiter) {
+  if (waiter->fd >= 0) {
+    uint64_t one = 1;
+    ssize_t ret = write(waiter->fd, &one, sizeof(one));
+    (void)ret;
+    return;
+  }
+  rocksutil::MutexLock l(&waiter->mutex);
+  waiter->signaled = true;
+  waiter->cv.Signal();
+}
+
+void BinlogManager::Wait(BinlogWaiter* waiter,
+    const std::function<bool()>& ready) {
+  {
+  rocksutil::MutexLock l(&waiter->mutex);
+  waiter->signaled = false;
+  }
+  waiter->armed.store(true);
+  // pairs with the fence in PublishTail, either side sees the other
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (ready()) {
+    waiter->armed.store(false);
+    return;
+  }
+  uint64_t timeout_us = options_.wakeup_bytes > 0 ?
+    options_.wakeup_delay_us : kBinlogWaitTimeoutUs;
+  rocksutil::MutexLock l(&waiter->mutex);
+  if (!waiter->signaled) {
+    waiter->cv.TimedWait(env_->NowMicros() + timeout_us);
+  }
+}
+
+void BinlogManager::PublishTail(uint64_t number, uint64_t offset,
+    uint64_t ring_seq, uint64_t bytes) {
+  // a reader sees the ring sequence no later than the tail
+  ring_seq_.store(ring_seq, std::memory_order_release);
+  tail_.Store(number, offset);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+
+  rocksutil::MutexLock l(&waiters_mutex_);
+  if (options_.wakeup_bytes > 0) {
+    /*
+     * the readers woken by a timeout pick up the groups deferred here,
+     * so they are never delayed more than wakeup_delay_us
+     */
+    pending_bytes_ += bytes;
+    uint64_t now = env_->NowMicros();
+    if (pending_bytes_ < options_.wakeup_bytes &&
+        now - last_wakeup_us_ < options_.wakeup_delay_us) {
+      stats_.deferred_wakeups++;
+      return;
+    }
+    pending_bytes_ = 0;
+    last_wakeup_us_ = now;
+  }
+  // only the armed waiters are woken, each once
+  for (auto waiter : waiters_) {
+    if (waiter->armed.exchange(false)) {
+      WakeWaiter(waiter);
+      stats_.wakeups++;
+    }
+  }
+}
+
 void BinlogManager::UpdateWriterOffset(uint64_t number,
     uint64_t offset) {
   number_ = number;
@@ -32,9 +151,328 @@ void BinlogManager::GetWriterOffset(uint64_t* number,
   *offset = offset_;
 }
 
+rocksutil::Status BinlogManager::StartPrefetcher() {
+  if (options_.catchup_readahead == 0 || !options_.catchup_prefetch) {
+    return rocksutil::Status::OK();
+  }
+  prefetcher_.reset(new BinlogPrefetcher());
+  if (prefetcher_->StartThread() != 0) {
+    prefetcher_.reset();
+    return rocksutil::Status::Corruption("start BinlogPrefetcher failed");
+  }
+  return rocksutil::Status::OK();
+}
+
+std::string BinlogManager::DumpStats() {
+  std::string mode;
+  switch (options_.sync_mode) {
+    case kSyncGroup:
+      mode = "group";
+      break;
+    case kSyncInterval:
+      mode = "interval";
+      break;
+    default:
+      mode = "none";
+      break;
+  }
+  std::string res;
+  res += "binlog_sync_mode:" + mode + "\r\n";
+  res += "binlog_appended_tasks:" + std::to_string(stats_.tasks) + "\r\n";
+  res += "binlog_written_groups:" + std::to_string(stats_.groups) + "\r\n";
+  res += "binlog_syncs:" + std::to_string(stats_.syncs) + "\r\n";
+  {
+  rocksutil::MutexLock l(&mutex_);
+  res += "binlog_first_number:" + std::to_string(first_number_) + "\r\n";
+  }
+  res += "binlog_purged_files:" + std::to_string(stats_.purged_files) +
+    "\r\n";
+  res += "binlog_replay_dropped_records:" +
+    std::to_string(stats_.replay_records) + "\r\n";
+  res += "binlog_replay_dropped_bytes:" +
+    std::to_string(stats_.replay_bytes) + "\r\n";
+  SnapshotMeta snapshot;
+  if (GetSnapshot(&snapshot)) {
+    res += "binlog_snapshot:" + std::to_string(snapshot.begin_number) + "-" +
+      std::to_string(snapshot.end_number) + " size=" +
+      std::to_string(snapshot.size) + " keys=" +
+      std::to_string(snapshot.keys) + "\r\n";
+  } else {
+    res += "binlog_snapshot:none\r\n";
+  }
+  res += "binlog_compactions:" + std::to_string(stats_.compactions) + "\r\n";
+  res += "binlog_snapshot_streams:" +
+    std::to_string(stats_.snapshot_streams) + "\r\n";
+  res += "binlog_wakeups:" + std::to_string(stats_.wakeups) + "\r\n";
+  res += "binlog_deferred_wakeups:" +
+    std::to_string(stats_.deferred_wakeups) + "\r\n";
+  res += "binlog_catchup_files:" + std::to_string(stats_.catchup_files) +
+    "\r\n";
+  res += "binlog_catchup_prefetched_bytes:" + std::to_string(prefetcher_ ?
+      prefetcher_->prefetched_bytes() : 0) + "\r\n";
+  res += "binlog_mapped_segments:" + std::to_string(segments_.Size()) +
+    "\r\n";
+  res += "binlog_mapped_groups:" + std::to_string(stats_.mapped_groups) +
+    "\r\n";
+  res += "binlog_compression:" +
+    std::string(BinlogCompressionName(options_.compression)) + "\r\n";
+  res += "binlog_compressed_groups:" +
+    std::to_string(stats_.compressed_groups) + "\r\n";
+  res += "binlog_compressed_bytes:" +
+    std::to_string(stats_.compress_output_bytes) + "/" +
+    std::to_string(stats_.compress_input_bytes) + "\r\n";
+  const char* recover_state[] = {"idle", "running", "done"};
+  res += "conflict_recover_state:" +
+    std::string(recover_state[stats_.recover_state]) + "\r\n";
+  res += "conflict_recover_files:" + std::to_string(stats_.recover_files_done) +
+    "/" + std::to_string(stats_.recover_files_total) + "\r\n";
+  res += "conflict_recover_records:" + std::to_string(stats_.recover_records) +
+    "\r\n";
+  res += "conflict_recover_time_ms:" + std::to_string(stats_.recover_time_ms) +
+    "\r\n";
+  res += "binlog_append_latency_us[" + mode + "]:" +
+    stats_.append_latency.Summary() + "\r\n";
+  res += "binlog_append_latency_us_buckets[" + mode + "]:" +
+    stats_.append_latency.Buckets() + "\r\n";
+  res += "binlog_sync_latency_us[" + mode + "]:" +
+    stats_.sync_latency.Summary() + "\r\n";
+  res += "binlog_sync_latency_us_buckets[" + mode + "]:" +
+    stats_.sync_latency.Buckets() + "\r\n";
+  return res;
+}
+
+/*
+ * return false if file is not binlog_<n><suffix>, suffix is empty or
+ * one of the suffixes in common.h
+ */
+static bool ParseBinlogNumber(const std::string& file, uint64_t* number,
+    std::string* suffix) {
+  size_t prefix_len = strlen(kBinlogPrefix);
+  if (file.size() <= prefix_len ||
+      file.compare(0, prefix_len, kBinlogPrefix) != 0) {
+    return false;
+  }
+  const char* begin = file.c_str() + prefix_len;
+  char* end = nullptr;
+  *number = strtoull(begin, &end, 10);
+  if (end == begin) {
+    return false;
+  }
+  suffix->assign(end);
+  return true;
+}
+
+rocksutil::Status BinlogManager::LoadBinlogFiles() {
+  std::vector<std::string> result;
+  rocksutil::Status s = env_->GetChildren(log_path_, &result);
+  if (!s.ok()) {
+    return s;
+  }
+
+  bool found = false;
+  uint64_t first = 0, last = 0, number;
+  std::string suffix;
+  bool has_snapshot = false;
+  SnapshotMeta snapshot;
+  for (auto& file : result) {
+    uint64_t begin, end;
+    if (ParseSnapshotFileName(file, &begin, &end, &suffix)) {
+      // keep the newest complete snapshot only
+      if (!suffix.empty()) {
+        env_->DeleteFile(log_path_ + "/" + file);
+      } else if (!has_snapshot || end > snapshot.end_number) {
+        if (has_snapshot) {
+          env_->DeleteFile(SnapshotFileName(log_path_,
+                snapshot.begin_number, snapshot.end_number));
+        }
+        snapshot.begin_number = begin;
+        snapshot.end_number = end;
+        has_snapshot = true;
+      } else {
+        env_->DeleteFile(log_path_ + "/" + file);
+      }
+      continue;
+    }
+    if (!ParseBinlogNumber(file, &number, &suffix)) {
+      continue;
+    }
+    if (suffix == kBinlogPreallocSuffix) {
+      env_->DeleteFile(log_path_ + "/" + file);
+    } else if (suffix.empty()) {
+      first = found ? std::min(first, number) : number;
+      last = found ? std::max(last, number) : number;
+      found = true;
+    }
+  }
+  if (found) {
+    rocksutil::MutexLock l(&mutex_);
+    first_number_ = first;
+    /*
+     * the tail of the newest file may be torn, never append to it;
+     * (last + 1, 0) is also where the senders of the last run ended
+     */
+    number_ = last + 1;
+    offset_ = 0;
+    start_number_ = number_;
+    tail_.Store(number_, offset_);
+    rocksutil::Info(info_log_, "Load binlog files %lu to %lu", first, last);
+  }
+  if (has_snapshot && env_->GetFileSize(SnapshotFileName(log_path_,
+          snapshot.begin_number, snapshot.end_number), &snapshot.size).ok()) {
+    rocksutil::MutexLock l(&mutex_);
+    snapshot_ = snapshot;
+    has_snapshot_ = true;
+    rocksutil::Info(info_log_, "Load binlog snapshot of binlog %lu to %lu",
+        snapshot.begin_number, snapshot.end_number);
+  }
+  return rocksutil::Status::OK();
+}
+
+namespace {
+
+struct DecodedFile {
+  rocksutil::Status status;
+  std::vector<BinlogBatchPtr> batches;
+};
+
+/*
+ * decode all the groups in filename, a torn tail left by a crash is
+ * ignored
+ */
+DecodedFile DecodeBinlogFile(rocksutil::Env* env,
+    const std::string& filename) {
+  DecodedFile result;
+  rocksutil::EnvOptions env_options;
+  std::unique_ptr<rocksutil::SequentialFile> sequential_file;
+  result.status = rocksutil::NewSequentialFile(env, filename,
+      &sequential_file, env_options);
+  if (!result.status.ok()) {
+    return result;
+  }
+  std::unique_ptr<rocksutil::SequentialFileReader> sequential_reader(
+      new rocksutil::SequentialFileReader(std::move(sequential_file)));
+  rocksutil::log::Reader::LogReporter reporter;
+  reporter.status = &result.status;
+  rocksutil::log::Reader reader(std::move(sequential_reader), &reporter,
+      true, 0);
+
+  std::string scratch;
+  rocksutil::Slice record;
+  while (reader.ReadRecord(&record, &scratch,
+        rocksutil::log::WALRecoveryMode::kTolerateCorruptedTailRecords)) {
+    std::string content(record.data(), record.size());
+    result.batches.push_back(std::make_shared<const BinlogBatch>(&content));
+  }
+  return result;
+}
+
+}  // namespace
+
+rocksutil::Status BinlogManager::RecoverConflictTable(int64_t* nums) {
+  uint64_t first, last;
+  {
+  rocksutil::MutexLock l(&mutex_);
+  first = first_number_;
+  last = number_;
+  }
+  uint64_t start_us = env_->NowMicros();
+  *nums = 0;
+  stats_.recover_files_total = last - first;
+  stats_.recover_files_done = 0;
+  stats_.recover_records = 0;
+  stats_.recover_state = kRecoverRunning;
+
+  /*
+   * decode up to kRecoverThreads files ahead, and apply them one by one
+   * in order, so the newest write of every key wins
+   */
+  rocksutil::Status s;
+  std::deque<std::pair<uint64_t, std::future<DecodedFile> > > decoding;
+  uint64_t next = first;
+  while (next < last || !decoding.empty()) {
+    while (next < last && decoding.size() < kRecoverThreads) {
+      std::string filename = log_path_ + "/" + kBinlogPrefix +
+        std::to_string(next);
+      rocksutil::Env* env = env_;
+      decoding.push_back(std::make_pair(next,
+            std::async(std::launch::async, [env, filename]() {
+              return DecodeBinlogFile(env, filename);
+            })));
+      next++;
+    }
+
+    uint64_t number = decoding.front().first;
+    DecodedFile file = decoding.front().second.get();
+    decoding.pop_front();
+    if (!file.status.ok()) {
+      // apply what has been decoded and go on with the next file
+      rocksutil::Warn(info_log_, "RecoverConflictTable binlog_%lu: %s",
+          number, file.status.ToString().c_str());
+      if (s.ok()) {
+        s = file.status;
+      }
+    }
+    for (auto& batch : file.batches) {
+      for (auto& record : batch->records()) {
+        conflict_table_.Insert(record.key, record.server_id,
+            record.exec_time);
+      }
+      *nums += batch->records().size();
+      stats_.recover_records += batch->records().size();
+    }
+    stats_.recover_files_done++;
+  }
+
+  stats_.recover_time_ms = (env_->NowMicros() - start_us) / 1000;
+  stats_.recover_state = kRecoverDone;
+  rocksutil::Info(info_log_, "RecoverConflictTable %ld records from binlog "
+      "%lu to %lu in %lu ms", *nums, first, last,
+      stats_.recover_time_ms.load());
+  return s;
+}
+
+rocksutil::Status BinlogManager::PurgeFiles(uint64_t to, int* purged) {
+  *purged = 0;
+  {
+  rocksutil::MutexLock l(&mutex_);
+  if (to <= first_number_) {
+    return rocksutil::Status::OK();
+  }
+  first_number_ = to;
+  }
+
+  std::vector<std::string> result;
+  rocksutil::Status s = env_->GetChildren(log_path_, &result);
+  if (!s.ok()) {
+    return s;
+  }
+  uint64_t number;
+  std::string suffix;
+  for (auto& file : result) {
+    if (ParseBinlogNumber(file, &number, &suffix) && number < to &&
+        (suffix.empty() || suffix == kBinlogIndexSuffix)) {
+      s = env_->DeleteFile(log_path_ + "/" + file);
+      if (!s.ok()) {
+        return s;
+      }
+      (*purged)++;
+      stats_.purged_files++;
+    }
+  }
+  return rocksutil::Status::OK();
+}
+
 void BinlogManager::ResetOffsetAndBinlog() {
+  {
+  rocksutil::MutexLock l(&mutex_);
   number_ = 0;
   offset_ = 0;
+  tail_.Store(0, 0);
+  ring_.Clear();
+  first_number_ = 0;
+  start_number_ = 0;
+  has_snapshot_ = false;
+  }
 
   std::vector<std::string> result;
   rocksutil::Status s = env_->GetChildren(log_path_, &result);
@@ -48,22 +486,157 @@ void BinlogManager::ResetOffsetAndBinlog() {
   }
 }
 
-BinlogManager* CreateBinlogManager(const std::string& log_path,
-    rocksutil::Env* env, std::shared_ptr<rocksutil::Logger> info_log) {
-  std::vector<std::string> result;
-  rocksutil::Status s = env->GetChildren(log_path, &result);
+void BinlogManager::GetFileRange(uint64_t* first_number, uint64_t* number,
+    uint64_t* offset) {
+  rocksutil::MutexLock l(&mutex_);
+  *first_number = first_number_;
+  *number = number_;
+  *offset = offset_;
+}
 
+rocksutil::Status BinlogManager::ReadFileRange(uint64_t number,
+    uint64_t offset, size_t n, std::string* data, std::string* index) {
+  data->clear();
+  index->clear();
+  uint64_t limit = UINT64_MAX;
+  {
+  rocksutil::MutexLock l(&mutex_);
+  if (number < first_number_) {
+    return rocksutil::Status::OK();
+  }
+  if (number > number_) {
+    return rocksutil::Status::NotFound("binlog not written yet");
+  }
+  if (number == number_) {
+    limit = offset_;
+  }
+  }
+
+  std::string filename = log_path_ + "/" + kBinlogPrefix +
+    std::to_string(number);
+  uint64_t size = 0;
+  rocksutil::Status s = env_->GetFileSize(filename, &size);
   if (!s.ok()) {
-    return nullptr;
+    return s;
+  }
+  limit = std::min(limit, size);
+  if (offset > limit) {
+    return rocksutil::Status::InvalidArgument("offset beyond the binlog end");
+  }
+  n = std::min(static_cast<uint64_t>(n), limit - offset);
+  if (n == 0) {
+    return rocksutil::Status::OK();
   }
 
-  std::string prefix;
-  for (auto& file : result) {
-    prefix = file.substr(0, strlen(kBinlogPrefix));
-    if (prefix == kBinlogPrefix) {
-      s = env->DeleteFile(log_path + "/" + file);
+  rocksutil::EnvOptions env_options;
+  std::unique_ptr<rocksutil::SequentialFile> file;
+  s = rocksutil::NewSequentialFile(env_, filename, &file, env_options);
+  if (!s.ok()) {
+    return s;
+  }
+  if (offset > 0) {
+    s = file->Skip(offset);
+    if (!s.ok()) {
+      return s;
     }
   }
+  data->resize(n);
+  size_t copied = 0;
+  rocksutil::Slice fragment;
+  while (copied < n) {
+    s = file->Read(n - copied, &fragment, &(*data)[copied]);
+    if (!s.ok()) {
+      data->clear();
+      return s;
+    }
+    if (fragment.size() == 0) {
+      break;
+    }
+    if (fragment.data() != data->data() + copied) {
+      memcpy(&(*data)[copied], fragment.data(), fragment.size());
+    }
+    copied += fragment.size();
+  }
+  data->resize(copied);
+
+  ListBinlogIndex(env_, filename + kBinlogIndexSuffix, offset,
+      offset + copied, index);
+  return rocksutil::Status::OK();
+}
+
+BinlogManager* CreateBinlogManager(const std::string& log_path,
+    rocksutil::Env* env, std::shared_ptr<rocksutil::Logger> info_log,
+    const BinlogOptions& options) {
+  BinlogManager* manager = new BinlogManager(log_path, env, info_log,
+      options);
+  rocksutil::Status s = manager->LoadBinlogFiles();
+  if (s.ok()) {
+    s = manager->StartPrefetcher();
+  }
+  if (!s.ok()) {
+    delete manager;
+    return nullptr;
+  }
+  return manager;
+}
+
+bool BinlogManager::GetSnapshot(SnapshotMeta* meta) {
+  rocksutil::MutexLock l(&mutex_);
+  if (!has_snapshot_) {
+    return false;
+  }
+  *meta = snapshot_;
+  return true;
+}
 
-  return new BinlogManager(log_path, env, info_log);
+void BinlogManager::SetSnapshot(const SnapshotMeta& meta) {
+  bool had_snapshot = false;
+  SnapshotMeta old;
+  {
+  rocksutil::MutexLock l(&mutex_);
+  had_snapshot = has_snapshot_;
+  old = snapshot_;
+  snapshot_ = meta;
+  has_snapshot_ = true;
+  }
+  /*
+   * the readers open it with mutex_ held, so none is opening the old one
+   * now; those opened keep reading it after the deletion
+   */
+  if (had_snapshot && (old.begin_number != meta.begin_number ||
+        old.end_number != meta.end_number)) {
+    env_->DeleteFile(SnapshotFileName(log_path_, old.begin_number,
+          old.end_number));
+  }
+}
+
+SnapshotReader* BinlogManager::OpenSnapshot(uint64_t number,
+    uint64_t offset) {
+  rocksutil::MutexLock l(&mutex_);
+  if (!has_snapshot_) {
+    return nullptr;
+  }
+  if (number == 0 && offset == 0) {
+    number = start_number_;
+  }
+  // the purged binlog is skipped by the readers anyway
+  if (number < first_number_) {
+    number = first_number_;
+    offset = 0;
+  }
+  if (number < snapshot_.begin_number || number >= snapshot_.end_number) {
+    return nullptr;
+  }
+  uint64_t replay = (snapshot_.end_number - number) * options_.file_size;
+  replay = replay > offset ? replay - offset : 0;
+  if (snapshot_.size >= replay) {
+    return nullptr;
+  }
+  SnapshotReader* reader = SnapshotReader::Open(env_,
+      SnapshotFileName(log_path_, snapshot_.begin_number,
+        snapshot_.end_number), snapshot_.end_number);
+  if (reader != nullptr) {
+    stats_.snapshot_streams++;
+  }
+  return reader;
 }
@@ -8,61 +8,242 @@
 
 #include <string>
 #include <memory>
+#include <vector>
+#include <atomic>
+#include <functional>
 
 #include "src/pika_hub_binlog_writer.h"
 #include "src/pika_hub_binlog_reader.h"
-#include "rocksutil/cache.h"
+#include "src/pika_hub_binlog_snapshot.h"
+#include "src/pika_hub_binlog_catchup.h"
+#include "src/pika_hub_binlog_segment.h"
+#include "src/pika_hub_binlog_ring.h"
+#include "src/pika_hub_histogram.h"
+#include "src/pika_hub_conflict_table.h"
+#include "src/pika_hub_offset_table.h"
+
+enum RecoverState {
+  kRecoverIdle = 0,
+  kRecoverRunning,
+  kRecoverDone
+};
+
+struct BinlogStats {
+  BinlogStats() : tasks(0), groups(0), syncs(0), purged_files(0),
+    replay_records(0), replay_bytes(0), compactions(0), snapshot_streams(0),
+    wakeups(0), deferred_wakeups(0), catchup_files(0), mapped_groups(0),
+    compressed_groups(0), compress_input_bytes(0), compress_output_bytes(0),
+    recover_state(kRecoverIdle), recover_files_total(0),
+    recover_files_done(0), recover_records(0), recover_time_ms(0) {}
+  // latency of BinlogWriter::Append seen by the callers
+  Histogram append_latency;
+  Histogram sync_latency;
+  std::atomic<uint64_t> tasks;
+  std::atomic<uint64_t> groups;
+  std::atomic<uint64_t> syncs;
+  std::atomic<uint64_t> purged_files;
+  // the records replayed by the pika servers and dropped before Append
+  std::atomic<uint64_t> replay_records;
+  std::atomic<uint64_t> replay_bytes;
+  // the snapshots written by BinlogCompactor, and streamed to the senders
+  std::atomic<uint64_t> compactions;
+  std::atomic<uint64_t> snapshot_streams;
+  // the waiters woken, and the groups appended without waking them
+  std::atomic<uint64_t> wakeups;
+  std::atomic<uint64_t> deferred_wakeups;
+  // the binlog files opened by the readers in catch-up mode
+  std::atomic<uint64_t> catchup_files;
+  // the groups decoded in place from a mapped binlog segment
+  std::atomic<uint64_t> mapped_groups;
+  // the groups written compressed, and their bytes before and after
+  std::atomic<uint64_t> compressed_groups;
+  std::atomic<uint64_t> compress_input_bytes;
+  std::atomic<uint64_t> compress_output_bytes;
+  // progress of RecoverConflictTable
+  std::atomic<int> recover_state;
+  std::atomic<uint64_t> recover_files_total;
+  std::atomic<uint64_t> recover_files_done;
+  std::atomic<uint64_t> recover_records;
+  std::atomic<uint64_t> recover_time_ms;
+};
 
 class BinlogManager {
  public:
   BinlogManager(const std::string& log_path,
       rocksutil::Env* env,
-      std::shared_ptr<rocksutil::Logger> info_log)
+      std::shared_ptr<rocksutil::Logger> info_log,
+      const BinlogOptions& options)
     : log_path_(log_path), env_(env),
-    number_(0), offset_(0),
-    cv_(&mutex_),
-    lru_cache_(rocksutil::NewLRUCache(100000000, 0)),
+    options_(options),
+    number_(0), offset_(0), first_number_(0), start_number_(0),
+    has_snapshot_(false),
+    ring_(options.ring_capacity),
+    ring_seq_(0),
+    pending_bytes_(0),
+    last_wakeup_us_(0),
+    conflict_table_(options.conflict_table_capacity),
+    segments_(log_path),
     info_log_(info_log) {}
 
-  ~BinlogManager() {
-    lru_cache_->DisownData();
-  }
-
+  // the new writer always starts from a new binlog file
   BinlogWriter* AddWriter();
   BinlogReader* AddReader(uint64_t number, uint64_t offset);
+  /*
+   * Add a reader to resume sending after (number, offset), which is the
+   * end of the last group sent successfully. The groups sent within
+   * kBinlogResendWindow before it are read again from the last indexed
+   * group boundary. (0, 0) means nothing has been sent in this term, the
+   * reader starts where the writer started
+   */
+  BinlogReader* AddResumeReader(uint64_t number, uint64_t offset);
+
+  const BinlogOptions& options() const {
+    return options_;
+  }
+
+  BinlogStats* stats() {
+    return &stats_;
+  }
+  std::string DumpStats();
 
   rocksutil::port::Mutex* mutex() {
     return &mutex_;
   }
 
-  rocksutil::port::CondVar* cv() {
-    return &cv_;
+  // protected by mutex()
+  BinlogRing* ring() {
+    return &ring_;
   }
 
-  std::shared_ptr<rocksutil::Cache> lru_cache() {
-    return lru_cache_;
+  ConflictTable* conflict_table() {
+    return &conflict_table_;
   }
 
+  BinlogSegmentCache* segments() {
+    return &segments_;
+  }
+
+  // nullptr unless catch-up prefetch is on
+  BinlogPrefetcher* prefetcher() {
+    return prefetcher_.get();
+  }
+  // start the prefetcher if catch-up prefetch is on
+  rocksutil::Status StartPrefetcher();
+
+  void AddWaiter(BinlogWaiter* waiter);
+  void RemoveWaiter(BinlogWaiter* waiter);
+  void WakeWaiter(BinlogWaiter* waiter);
+  /*
+   * Arm waiter and block until it is woken or ready() holds, at most
+   * wakeup_delay_us if the wakeups are coalesced. ready() is checked
+   * after arming, so a group published meanwhile is never missed
+   */
+  void Wait(BinlogWaiter* waiter, const std::function<bool()>& ready);
+
+  // protected by mutex()
   void UpdateWriterOffset(uint64_t number, uint64_t offset);
   void GetWriterOffset(uint64_t* number, uint64_t* offset);
-  size_t GetLruMemUsage() {
-    return lru_cache_->GetUsage();
+  /*
+   * Publish the end of the group written and the ring sequence after
+   * it to the readers, then wake the armed waiters; called by the writer
+   * after mutex() is released, bytes is the size of the group
+   */
+  void PublishTail(uint64_t number, uint64_t offset, uint64_t ring_seq,
+      uint64_t bytes);
+  // lock free, the readers poll them instead of the binlog files
+  void GetPublishedTail(uint64_t* number, uint64_t* offset) const {
+    tail_.Load(number, offset);
+  }
+  uint64_t published_ring_seq() const {
+    return ring_seq_.load(std::memory_order_acquire);
   }
-  rocksutil::Status RecoverLruCache(int64_t* nums);
+  size_t GetRingMemUsage() {
+    rocksutil::MutexLock l(&mutex_);
+    return ring_.usage();
+  }
+  /*
+   * Delete binlog_<n> for all n < to, the readers added later start from
+   * binlog_<to> at least
+   */
+  rocksutil::Status PurgeFiles(uint64_t to, int* purged);
+  // protected by mutex()
+  uint64_t first_number() {
+    return first_number_;
+  }
+  // protected by mutex()
+  uint64_t start_number() {
+    return start_number_;
+  }
+  /*
+   * Find the binlog files left by the last run, the writer continues
+   * after the newest one; called before any writer or reader is added, at
+   * start and after BinlogMirror stops
+   */
+  rocksutil::Status LoadBinlogFiles();
+  /*
+   * Rebuild the conflict table from the retained binlog files, the files
+   * are decoded in parallel and applied in order. nums is the number of
+   * records applied
+   */
+  rocksutil::Status RecoverConflictTable(int64_t* nums);
   void ResetOffsetAndBinlog();
 
+  // the oldest binlog file and the end of the last group written
+  void GetFileRange(uint64_t* first_number, uint64_t* number,
+      uint64_t* offset);
+  /*
+   * Copy at most n bytes of binlog_<number> from offset into data, never
+   * past the end of the last group written. The index entries of the
+   * bytes copied are appended to index. data is empty if binlog_<number>
+   * is purged or there is nothing new; return NotFound if binlog_<number>
+   * is not written yet, InvalidArgument if offset is beyond its end
+   */
+  rocksutil::Status ReadFileRange(uint64_t number, uint64_t offset,
+      size_t n, std::string* data, std::string* index);
+
+  // the newest snapshot, return false if there is none
+  bool GetSnapshot(SnapshotMeta* meta);
+  // publish meta as the newest snapshot and delete the older one
+  void SetSnapshot(const SnapshotMeta& meta);
+  /*
+   * Open the snapshot for a sender resuming after (number, offset),
+   * the same position as AddResumeReader. Return nullptr unless the
+   * snapshot covers the position and is smaller than the binlog to
+   * replay up to its end
+   */
+  SnapshotReader* OpenSnapshot(uint64_t number, uint64_t offset);
+
  private:
   std::string log_path_;
   rocksutil::Env* env_;
+  const BinlogOptions options_;
   uint64_t number_;
   uint64_t offset_;
+  // the oldest binlog file not purged
+  uint64_t first_number_;
+  // the first binlog file of the current writer
+  uint64_t start_number_;
+  bool has_snapshot_;
+  SnapshotMeta snapshot_;
   rocksutil::port::Mutex mutex_;
-  rocksutil::port::CondVar cv_;
-  std::shared_ptr<rocksutil::Cache> lru_cache_;
+  BinlogRing ring_;
+  // the writer position last published, a copy of (number_, offset_)
+  BinlogOffset tail_;
+  std::atomic<uint64_t> ring_seq_;
+  // protect waiters_ and the wakeup coalescing
+  rocksutil::port::Mutex waiters_mutex_;
+  std::vector<BinlogWaiter*> waiters_;
+  uint64_t pending_bytes_;
+  uint64_t last_wakeup_us_;
+  BinlogStats stats_;
+  ConflictTable conflict_table_;
+  BinlogSegmentCache segments_;
+  std::unique_ptr<BinlogPrefetcher> prefetcher_;
   std::shared_ptr<rocksutil::Logger> info_log_;
 };
 
 extern BinlogManager* CreateBinlogManager(const std::string& log_path,
-    rocksutil::Env* env, std::shared_ptr<rocksutil::Logger> info_log);
+    rocksutil::Env* env, std::shared_ptr<rocksutil::Logger> info_log,
+    const BinlogOptions& options);
 
 #endif  // SRC_PIKA_HUB_BINLOG_MANAGER_H_
@@ -0,0 +1,333 @@
+//  Copyright (c) 2017-present The pika_hub Authors.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#include "src/pika_hub_binlog_mirror.h"
+
+#include <chrono>
+#include <string>
+#include <thread>
+#include <utility>
+
+#include "pink/include/redis_cli.h"
+#include "rocksutil/coding.h"
+#include "rocksutil/file_reader_writer.h"
+#include "slash/include/slash_string.h"
+
+// wait before asking again if the primary has nothing new
+static const int kMirrorIdleMs = 100;
+// wait before reconnecting to the primary
+static const int kMirrorRetryMs = 1000;
+
+void EncodeMirrorMeta(const MirrorMeta& meta, std::string* dst) {
+  dst->clear();
+  rocksutil::PutFixed64(dst, meta.first_number);
+  rocksutil::PutFixed64(dst, meta.writer_number);
+  rocksutil::PutFixed64(dst, meta.writer_offset);
+  rocksutil::PutFixed32(dst, meta.offsets.size());
+  for (auto iter = meta.offsets.begin(); iter != meta.offsets.end();
+      iter++) {
+    rocksutil::PutFixed32(dst, iter->first);
+    rocksutil::PutFixed64(dst, iter->second.rcv_number);
+    rocksutil::PutFixed64(dst, iter->second.rcv_offset);
+    rocksutil::PutFixed64(dst, iter->second.send_number);
+    rocksutil::PutFixed64(dst, iter->second.send_offset);
+  }
+}
+
+bool DecodeMirrorMeta(const rocksutil::Slice& src, MirrorMeta* meta) {
+  rocksutil::Slice input(src);
+  uint32_t count = 0;
+  if (!rocksutil::GetFixed64(&input, &meta->first_number) ||
+      !rocksutil::GetFixed64(&input, &meta->writer_number) ||
+      !rocksutil::GetFixed64(&input, &meta->writer_offset) ||
+      !rocksutil::GetFixed32(&input, &count)) {
+    return false;
+  }
+  meta->offsets.clear();
+  for (uint32_t i = 0; i < count; i++) {
+    uint32_t server_id = 0;
+    MirrorOffsets offsets;
+    if (!rocksutil::GetFixed32(&input, &server_id) ||
+        !rocksutil::GetFixed64(&input, &offsets.rcv_number) ||
+        !rocksutil::GetFixed64(&input, &offsets.rcv_offset) ||
+        !rocksutil::GetFixed64(&input, &offsets.send_number) ||
+        !rocksutil::GetFixed64(&input, &offsets.send_offset)) {
+      return false;
+    }
+    meta->offsets[static_cast<int32_t>(server_id)] = offsets;
+  }
+  return true;
+}
+
+BinlogMirror::~BinlogMirror() {
+  set_should_stop();
+  StopThread();
+  CloseFile();
+  CloseConn();
+}
+
+void BinlogMirror::SetPrimary(const std::string& primary) {
+  rocksutil::MutexLock l(&mutex_);
+  primary_ = primary;
+}
+
+bool BinlogMirror::GetOffsets(MirrorOffsetMap* offsets) {
+  rocksutil::MutexLock l(&mutex_);
+  if (!has_offsets_) {
+    return false;
+  }
+  *offsets = offsets_;
+  return true;
+}
+
+std::string BinlogMirror::DumpStatus() {
+  rocksutil::MutexLock l(&mutex_);
+  std::string res;
+  res += "binlog_mirror_primary:" + mirrored_primary_ + "\r\n";
+  res += "binlog_mirror_offset:" + std::to_string(number_) + ":" +
+    std::to_string(offset_) + "\r\n";
+  res += "binlog_mirror_pika_offsets:" +
+    std::to_string(has_offsets_ ? offsets_.size() : 0) + "\r\n";
+  return res;
+}
+
+bool BinlogMirror::Connect(const std::string& primary) {
+  std::string ip;
+  int port = 0;
+  if (!slash::ParseIpPortString(primary, ip, port)) {
+    rocksutil::Error(info_log_, "BinlogMirror invalid primary %s",
+        primary.c_str());
+    return false;
+  }
+  cli_ = pink::NewRedisCli();
+  cli_->set_connect_timeout(1500);
+  slash::Status s = cli_->Connect(ip, port);
+  if (!s.ok()) {
+    rocksutil::Error(info_log_, "BinlogMirror connect to %s failed: %s",
+        primary.c_str(), s.ToString().c_str());
+    CloseConn();
+    return false;
+  }
+  cli_->set_send_timeout(3000);
+  cli_->set_recv_timeout(3000);
+  if (passwd_.empty()) {
+    return true;
+  }
+
+  pink::RedisCmdArgsType argv;
+  std::string wbuf_str;
+  argv.push_back("auth");
+  argv.push_back(passwd_);
+  pink::SerializeRedisCommand(argv, &wbuf_str);
+  s = cli_->Send(&wbuf_str);
+  if (s.ok()) {
+    s = cli_->Recv(&argv);
+  }
+  if (!s.ok() || argv.empty() || slash::StringToLower(argv[0]) != "ok") {
+    rocksutil::Error(info_log_, "BinlogMirror auth to %s failed",
+        primary.c_str());
+    CloseConn();
+    return false;
+  }
+  return true;
+}
+
+void BinlogMirror::CloseConn() {
+  delete cli_;
+  cli_ = nullptr;
+}
+
+void BinlogMirror::Reset() {
+  CloseFile();
+  manager_->ResetOffsetAndBinlog();
+  started_ = false;
+  has_pending_ = false;
+  pending_.clear();
+  rocksutil::MutexLock l(&mutex_);
+  number_ = 0;
+  offset_ = 0;
+  has_offsets_ = false;
+  offsets_.clear();
+}
+
+rocksutil::Status BinlogMirror::OpenFile() {
+  std::string filename = log_path_ + "/" + kBinlogPrefix +
+    std::to_string(number_);
+  rocksutil::EnvOptions env_options;
+  env_options.use_mmap_writes = false;
+  rocksutil::Status s = rocksutil::NewWritableFile(env_, filename, &file_,
+      env_options);
+  if (!s.ok()) {
+    return s;
+  }
+  // the index is only a hint, go on without it
+  index_.reset(CreateBinlogIndexWriter(env_,
+        filename + kBinlogIndexSuffix));
+  return rocksutil::Status::OK();
+}
+
+void BinlogMirror::CloseFile() {
+  if (file_) {
+    file_->Sync();
+    file_->Close();
+    file_.reset();
+  }
+  index_.reset();
+}
+
+rocksutil::Status BinlogMirror::Fetch() {
+  pink::RedisCmdArgsType argv;
+  std::string wbuf_str;
+  argv.push_back("hubbinlog");
+  argv.push_back(std::to_string(number_));
+  argv.push_back(std::to_string(offset_));
+  pink::SerializeRedisCommand(argv, &wbuf_str);
+  slash::Status s = cli_->Send(&wbuf_str);
+  if (s.ok()) {
+    s = cli_->Recv(&argv);
+  }
+  if (!s.ok()) {
+    rocksutil::Error(info_log_, "BinlogMirror hubbinlog to %s failed: %s",
+        mirrored_primary_.c_str(), s.ToString().c_str());
+    return rocksutil::Status::IOError("hubbinlog failed");
+  }
+
+  if (argv.size() != 3) {
+    std::string reply = argv.empty() ? "" : argv[0];
+    rocksutil::Warn(info_log_, "BinlogMirror hubbinlog %lu:%lu from %s: %s",
+        number_, offset_, mirrored_primary_.c_str(), reply.c_str());
+    if (reply.find(kMirrorDiverged) != std::string::npos) {
+      // the local binlog is not a prefix of the primary's
+      Reset();
+      return rocksutil::Status::OK();
+    }
+    return rocksutil::Status::Corruption("hubbinlog error reply");
+  }
+
+  MirrorMeta meta;
+  if (!DecodeMirrorMeta(argv[0], &meta)) {
+    rocksutil::Error(info_log_, "BinlogMirror invalid hubbinlog reply "
+        "from %s", mirrored_primary_.c_str());
+    return rocksutil::Status::Corruption("invalid hubbinlog reply");
+  }
+  return Apply(meta, argv[1], argv[2]);
+}
+
+rocksutil::Status BinlogMirror::Apply(const MirrorMeta& meta,
+    const std::string& index, const std::string& data) {
+  if (!started_) {
+    // the local binlog is empty, begin with the oldest file of the primary
+    started_ = true;
+    if (number_ < meta.first_number) {
+      rocksutil::MutexLock l(&mutex_);
+      number_ = meta.first_number;
+      offset_ = 0;
+      return rocksutil::Status::OK();
+    }
+  } else if (number_ < meta.first_number) {
+    rocksutil::Warn(info_log_, "BinlogMirror binlog_%lu is purged by %s "
+        "before mirrored, mirror from scratch", number_,
+        mirrored_primary_.c_str());
+    Reset();
+    return rocksutil::Status::OK();
+  }
+
+  rocksutil::Status s;
+  bool progress = false;
+  if (!data.empty()) {
+    if (!file_) {
+      s = offset_ == 0 ? OpenFile() :
+        rocksutil::Status::Corruption("binlog file is not open");
+    }
+    if (s.ok()) {
+      s = file_->Append(data);
+    }
+    if (!s.ok()) {
+      rocksutil::Error(info_log_, "BinlogMirror write binlog_%lu error: %s",
+          number_, s.ToString().c_str());
+      Reset();
+      return s;
+    }
+    if (index_) {
+      for (size_t i = 0; i + 8 <= index.size(); i += 8) {
+        index_->Add(rocksutil::DecodeFixed64(index.data() + i));
+      }
+    }
+    rocksutil::MutexLock l(&mutex_);
+    offset_ += data.size();
+    progress = true;
+  } else if (number_ < meta.writer_number) {
+    // the primary has rolled over binlog_<number_>, it is complete
+    CloseFile();
+    rocksutil::MutexLock l(&mutex_);
+    number_++;
+    offset_ = 0;
+    progress = true;
+  }
+
+  if (meta.first_number > 0) {
+    int purged = 0;
+    manager_->PurgeFiles(meta.first_number, &purged);
+  }
+
+  /*
+   * keep the offsets of one reply until the binlog before its writer
+   * position is mirrored, then take the next ones
+   */
+  if (!has_pending_) {
+    pending_ = meta.offsets;
+    pending_number_ = meta.writer_number;
+    pending_offset_ = meta.writer_offset;
+    has_pending_ = true;
+  }
+  if (number_ > pending_number_ ||
+      (number_ == pending_number_ && offset_ >= pending_offset_)) {
+    rocksutil::MutexLock l(&mutex_);
+    offsets_.swap(pending_);
+    has_offsets_ = true;
+    has_pending_ = false;
+  }
+
+  return progress ? rocksutil::Status::OK() :
+    rocksutil::Status::Incomplete("nothing new");
+}
+
+void* BinlogMirror::ThreadMain() {
+  while (!should_stop()) {
+    std::string primary;
+    {
+    rocksutil::MutexLock l(&mutex_);
+    primary = primary_;
+    }
+    if (primary.empty()) {
+      CloseConn();
+      std::this_thread::sleep_for(std::chrono::milliseconds(kMirrorRetryMs));
+      continue;
+    }
+    if (primary != mirrored_primary_) {
+      rocksutil::Info(info_log_, "BinlogMirror primary changes from %s to %s,"
+          " mirror from scratch", mirrored_primary_.c_str(), primary.c_str());
+      CloseConn();
+      Reset();
+      rocksutil::MutexLock l(&mutex_);
+      mirrored_primary_ = primary;
+    }
+    if (cli_ == nullptr && !Connect(primary)) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(kMirrorRetryMs));
+      continue;
+    }
+
+    rocksutil::Status s = Fetch();
+    if (s.IsIncomplete()) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(kMirrorIdleMs));
+    } else if (!s.ok()) {
+      CloseConn();
+      std::this_thread::sleep_for(std::chrono::milliseconds(kMirrorRetryMs));
+    }
+  }
+  // the tail is read by the senders if this pika_hub becomes primary
+  CloseFile();
+  return nullptr;
+}
@@ -0,0 +1,138 @@
+//  Copyright (c) 2017-present The pika_hub Authors.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#ifndef SRC_PIKA_HUB_BINLOG_MIRROR_H_
+#define SRC_PIKA_HUB_BINLOG_MIRROR_H_
+
+#include <map>
+#include <memory>
+#include <string>
+
+#include "src/pika_hub_binlog_manager.h"
+#include "src/pika_hub_binlog_index.h"
+#include "pink/include/pink_cli.h"
+#include "pink/include/pink_thread.h"
+#include "rocksutil/mutexlock.h"
+#include "rocksutil/auto_roll_logger.h"
+
+// the bytes of binlog returned by one hubbinlog
+const size_t kBinlogMirrorChunk = 1024 * 1024;
+// in the error reply of hubbinlog if the offset asked is not in the binlog
+const char kMirrorDiverged[] = "binlog diverged";
+
+// the offsets of a pika server on the primary
+struct MirrorOffsets {
+  uint64_t rcv_number = 0;
+  uint64_t rcv_offset = 0;
+  uint64_t send_number = 0;
+  uint64_t send_offset = 0;
+};
+
+typedef std::map<int32_t, MirrorOffsets> MirrorOffsetMap;
+
+/*
+ * The first part of a hubbinlog reply. The offsets are taken before the
+ * writer position, so all the binlog they refer to is before
+ * (writer_number, writer_offset)
+ */
+struct MirrorMeta {
+  uint64_t first_number = 0;
+  uint64_t writer_number = 0;
+  uint64_t writer_offset = 0;
+  MirrorOffsetMap offsets;
+};
+
+extern void EncodeMirrorMeta(const MirrorMeta& meta, std::string* dst);
+extern bool DecodeMirrorMeta(const rocksutil::Slice& src, MirrorMeta* meta);
+
+/*
+ * BinlogMirror runs on a secondary pika_hub, it pulls the binlog files of
+ * the primary by hubbinlog and writes them byte for byte under the same
+ * names, so the binlog offsets of the primary are valid here as well.
+ * The offsets of the pika servers on the primary are kept once the binlog
+ * they refer to is mirrored; when this pika_hub becomes primary, it
+ * resumes from the mirrored binlog and these offsets.
+ * The local binlog is wiped whenever the primary changes.
+ */
+class BinlogMirror : public pink::Thread {
+ public:
+  BinlogMirror(std::shared_ptr<rocksutil::Logger> info_log,
+      rocksutil::Env* env,
+      const std::string& log_path,
+      const std::string& passwd,
+      BinlogManager* manager)
+  : info_log_(info_log),
+    env_(env),
+    log_path_(log_path),
+    passwd_(passwd),
+    manager_(manager),
+    cli_(nullptr),
+    number_(0),
+    offset_(0),
+    started_(false),
+    has_pending_(false),
+    pending_number_(0),
+    pending_offset_(0),
+    has_offsets_(false) {}
+
+  virtual ~BinlogMirror();
+
+  // ip:port of the primary, empty if there is none for now
+  void SetPrimary(const std::string& primary);
+  /*
+   * the offsets of the pika servers on the primary, which the mirrored
+   * binlog covers; return false if there are none. Call it after
+   * StopThread to get the last ones
+   */
+  bool GetOffsets(MirrorOffsetMap* offsets);
+  std::string DumpStatus();
+
+ private:
+  std::shared_ptr<rocksutil::Logger> info_log_;
+  rocksutil::Env* env_;
+  std::string log_path_;
+  std::string passwd_;
+  BinlogManager* manager_;
+
+  // protect primary_, mirrored_primary_, number_, offset_ for reading
+  // from other threads, and offsets_, has_offsets_
+  rocksutil::port::Mutex mutex_;
+  std::string primary_;
+
+  // the members below are only changed by the mirror thread
+  std::string mirrored_primary_;
+  pink::PinkCli* cli_;
+  // the next byte to mirror
+  uint64_t number_;
+  uint64_t offset_;
+  // the first reply is handled
+  bool started_;
+  std::unique_ptr<rocksutil::WritableFile> file_;
+  std::unique_ptr<BinlogIndexWriter> index_;
+  /*
+   * the offsets of the last reply, which become valid once the binlog
+   * before (pending_number_, pending_offset_) is mirrored
+   */
+  bool has_pending_;
+  MirrorOffsetMap pending_;
+  uint64_t pending_number_;
+  uint64_t pending_offset_;
+  bool has_offsets_;
+  MirrorOffsetMap offsets_;
+
+  bool Connect(const std::string& primary);
+  void CloseConn();
+  // wipe the local binlog and mirror from the oldest file of the primary
+  void Reset();
+  rocksutil::Status OpenFile();
+  void CloseFile();
+  // return Incomplete if there is nothing new
+  rocksutil::Status Fetch();
+  rocksutil::Status Apply(const MirrorMeta& meta, const std::string& index,
+      const std::string& data);
+  virtual void* ThreadMain() override;
+};
+
+#endif  // SRC_PIKA_HUB_BINLOG_MIRROR_H_
@@ -0,0 +1,107 @@
+//  Copyright (c) 2017-present The pika_hub Authors.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#include "src/pika_hub_binlog_purger.h"
+#include "src/pika_hub_offset_table.h"
+
+#include <string>
+#include <algorithm>
+
+BinlogPurger::~BinlogPurger() {
+  set_should_stop();
+  {
+  rocksutil::MutexLock l(&mutex_);
+  cv_.SignalAll();
+  }
+  StopThread();
+}
+
+bool BinlogPurger::PurgeTo(uint64_t to) {
+  rocksutil::MutexLock l(&mutex_);
+  if (purging_ || manual_to_ != 0) {
+    return false;
+  }
+  manual_to_ = to;
+  cv_.SignalAll();
+  return true;
+}
+
+uint64_t BinlogPurger::SafePurgePoint(uint64_t writer_number,
+    uint64_t start_number) {
+  uint64_t point = writer_number;
+  rocksutil::MutexLock l(pika_mutex_);
+  for (auto iter = pika_servers_->begin(); iter != pika_servers_->end();
+      iter++) {
+    if (iter->second.sync_status == kShouldDelete) {
+      continue;
+    }
+    uint64_t send_number, send_offset;
+    iter->second.offsets->send.Load(&send_number, &send_offset);
+    // nothing sent in this term, the sender starts from start_number
+    if (send_number == 0 && send_offset == 0) {
+      point = std::min(point, start_number);
+    } else {
+      point = std::min(point, send_number);
+    }
+  }
+  return point;
+}
+
+void BinlogPurger::Purge(uint64_t to) {
+  int purged = 0;
+  rocksutil::Status s = manager_->PurgeFiles(to, &purged);
+  if (!s.ok()) {
+    rocksutil::Error(info_log_, "BinlogPurger purge to binlog_%lu error: %s",
+        to, s.ToString().c_str());
+  } else if (purged > 0) {
+    rocksutil::Info(info_log_, "BinlogPurger purged %d files before binlog_%lu",
+        purged, to);
+  }
+}
+
+void* BinlogPurger::ThreadMain() {
+  while (!should_stop()) {
+    uint64_t manual_to = 0;
+    {
+    rocksutil::MutexLock l(&mutex_);
+    if (manual_to_ == 0 && !should_stop()) {
+      cv_.TimedWait(env_->NowMicros() +
+          static_cast<uint64_t>(interval_) * 1000000);
+    }
+    if (should_stop()) {
+      break;
+    }
+    manual_to = manual_to_;
+    manual_to_ = 0;
+    purging_ = true;
+    }
+
+    uint64_t writer_number, writer_offset, start_number;
+    {
+    rocksutil::MutexLock l(manager_->mutex());
+    manager_->GetWriterOffset(&writer_number, &writer_offset);
+    start_number = manager_->start_number();
+    }
+    uint64_t to = SafePurgePoint(writer_number, start_number);
+    if (manual_to != 0) {
+      if (manual_to > to) {
+        rocksutil::Warn(info_log_, "BinlogPurger binlog before %lu is still "
+            "needed, only purge to %lu", manual_to, to);
+      }
+      to = std::min(to, manual_to);
+    } else {
+      // keep the newest retention_files files, including the current one
+      uint64_t retained = writer_number + 1 >
+        static_cast<uint64_t>(retention_files_) ?
+        writer_number + 1 - retention_files_ : 0;
+      to = std::min(to, retained);
+    }
+    Purge(to);
+
+    rocksutil::MutexLock l(&mutex_);
+    purging_ = false;
+  }
+  return nullptr;
+}
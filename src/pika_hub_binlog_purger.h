@@ -0,0 +1,76 @@
+//  Copyright (c) 2017-present The pika_hub Authors.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#ifndef SRC_PIKA_HUB_BINLOG_PURGER_H_
+#define SRC_PIKA_HUB_BINLOG_PURGER_H_
+
+#include <string>
+#include <memory>
+
+#include "src/pika_hub_common.h"
+#include "src/pika_hub_binlog_manager.h"
+#include "pink/include/pink_thread.h"
+#include "rocksutil/mutexlock.h"
+#include "rocksutil/auto_roll_logger.h"
+
+/*
+ * BinlogPurger deletes the binlog files which are no longer needed by any
+ * BinlogSender, every interval seconds or on demand (purgelogsto).
+ * A BinlogSender resumes inside binlog_<send_number>, so the files before
+ * min(send_number) of all the pika servers could be deleted, and the
+ * newest retention_files files are always kept by the periodic purge
+ */
+class BinlogPurger : public pink::Thread {
+ public:
+  BinlogPurger(std::shared_ptr<rocksutil::Logger> info_log,
+    rocksutil::Env* env,
+    PikaServers* pika_servers,
+    rocksutil::port::Mutex* pika_mutex,
+    BinlogManager* manager,
+    int interval,
+    int retention_files)
+  : info_log_(info_log),
+    env_(env),
+    pika_servers_(pika_servers),
+    pika_mutex_(pika_mutex),
+    manager_(manager),
+    interval_(interval),
+    retention_files_(retention_files),
+    cv_(&mutex_),
+    manual_to_(0),
+    purging_(false) {}
+
+  virtual ~BinlogPurger();
+
+  /*
+   * Delete the binlog files whose number is less than to asynchronously,
+   * the files still needed by the senders are kept anyway,
+   * return false if another purge is in progress
+   */
+  bool PurgeTo(uint64_t to);
+
+ private:
+  std::shared_ptr<rocksutil::Logger> info_log_;
+  rocksutil::Env* env_;
+  PikaServers* pika_servers_;
+  // protect pika_servers_
+  rocksutil::port::Mutex* pika_mutex_;
+  BinlogManager* manager_;
+  int interval_;
+  int retention_files_;
+
+  // protect manual_to_ & purging_
+  rocksutil::port::Mutex mutex_;
+  rocksutil::port::CondVar cv_;
+  uint64_t manual_to_;
+  bool purging_;
+
+  // the files before the returned number are not needed by any sender
+  uint64_t SafePurgePoint(uint64_t writer_number, uint64_t start_number);
+  void Purge(uint64_t to);
+  virtual void* ThreadMain() override;
+};
+
+#endif  // SRC_PIKA_HUB_BINLOG_PURGER_H_
@@ -6,25 +6,67 @@
 #include <utility>
 #include <memory>
 #include <string>
+#include <algorithm>
+#include <functional>
 
 #include "src/pika_hub_binlog_reader.h"
 #include "src/pika_hub_common.h"
 #include "src/pika_hub_binlog_manager.h"
+#include "src/pika_hub_binlog_catchup.h"
 #include "rocksutil/file_reader_writer.h"
 #include "rocksutil/coding.h"
 
+/*
+ * The end of a record of length bytes which starts at begin, it follows
+ * the way rocksutil::log::Writer splits a record into fragments: the tail
+ * of a block shorter than a header is padded, and every fragment has its
+ * own header
+ */
+static uint64_t RecordEnd(uint64_t begin, uint64_t length) {
+  uint64_t pos = begin;
+  uint64_t left = length;
+  do {
+    uint64_t leftover = kBinlogBlockSize - pos % kBinlogBlockSize;
+    if (leftover < kBinlogHeaderSize) {
+      pos += leftover;
+    }
+    uint64_t avail = kBinlogBlockSize - pos % kBinlogBlockSize -
+      kBinlogHeaderSize;
+    uint64_t fragment = std::min(left, avail);
+    pos += kBinlogHeaderSize + fragment;
+    left -= fragment;
+  } while (left > 0);
+  return pos;
+}
+
 void BinlogReader::GetOffset(uint64_t* number, uint64_t* offset) {
   *number = number_;
-  *offset = reader_->EndOfBufferOffset();
+  *offset = in_memory_ ? offset_ : record_end_;
+}
+
+BinlogReader::~BinlogReader() {
+  if (waiting_) {
+    manager_->RemoveWaiter(&waiter_);
+  }
+  delete reader_;
 }
 
 void BinlogReader::StopRead() {
   should_exit_ = true;
-  manager_->cv()->SignalAll();
+  manager_->WakeWaiter(&waiter_);
 }
 
-rocksutil::Status BinlogReader::ReadRecord(
-    std::vector<BinlogFields>* result) {
+void BinlogReader::Wait(const std::function<bool()>& ready) {
+  if (!waiting_) {
+    manager_->AddWaiter(&waiter_);
+    waiting_ = true;
+  }
+  manager_->Wait(&waiter_, [this, &ready]() {
+      return should_exit_ || ready();
+    });
+}
+
+rocksutil::Status BinlogReader::ReadRecord(BinlogBatchPtr* batch) {
   bool ret = true;
   uint64_t writer_number = 0;
   uint64_t writer_offset = 0;
@@ -32,41 +74,86 @@ rocksutil::Status BinlogReader::ReadRecord(
   std::string scratch;
   rocksutil::Slice record;
   while (!should_exit_) {
+    if (in_memory_) {
+      bool would_block = false;
+      if (ReadFromRing(batch, &would_block)) {
+        return rocksutil::Status::OK();
+      }
+      if (would_block) {
+        return rocksutil::Status::Incomplete("No more binlog");
+      }
+      if (should_exit_) {
+        break;
+      }
+      /*
+       * lag behind the ring, continue from the binlog file
+       */
+      if (!ResetReader(number_, offset_)) {
+        return rocksutil::Status::Corruption("Reset reader to " +
+            std::to_string(number_) + ":" + std::to_string(offset_) +
+            " failed");
+      }
+      continue;
+    }
+
     ret = reader_->ReadRecord(&record, &scratch,
         rocksutil::log::WALRecoveryMode::kAbsoluteConsistency);
     if (ret) {
-      DecodeBinlogContent(record, result);
+      record_end_ = RecordEnd(reader_->LastRecordOffset(), record.size());
+      if (segment_ && segment_->Contains(record)) {
+        *batch = std::make_shared<const BinlogBatch>(record, segment_);
+        manager_->stats()->mapped_groups++;
+      } else {
+        std::string content(record.data(), record.size());
+        *batch = std::make_shared<const BinlogBatch>(&content);
+      }
+      if ((*batch)->corrupted()) {
+        return rocksutil::Status::Corruption("Uncompress group at " +
+            std::to_string(number_) + ":" +
+            std::to_string(reader_->LastRecordOffset()) + " failed");
+      }
       return rocksutil::Status::OK();
     } else {
       if (status_.ok()) {
-        manager_->mutex()->Lock();
-        manager_->GetWriterOffset(&writer_number, &writer_offset);
         reader_offset = reader_->EndOfBufferOffset();
-        while (number_ == writer_number && reader_offset == writer_offset) {
-          /*
-           * wait until new content is written or should exit;
-           */
-          manager_->cv()->Wait();
-          if (should_exit_) {
-            manager_->mutex()->Unlock();
-            return rocksutil::Status::Corruption("Exit");
-          }
-          manager_->GetWriterOffset(&writer_number, &writer_offset);
-          reader_offset = reader_->EndOfBufferOffset();
+        if (SwitchToRing(reader_offset)) {
+          continue;
         }
-        uint64_t cur_file_size;
-        env_->GetFileSize(log_path_ + "/" + kBinlogPrefix +
-            std::to_string(number_), &cur_file_size);
-        if (cur_file_size > reader_offset) {
+        /*
+         * look at the published tail instead of the file, the groups
+         * before it are all in the page cache
+         */
+        manager_->GetPublishedTail(&writer_number, &writer_offset);
+        if (number_ == writer_number && reader_offset < writer_offset) {
           reader_->UnmarkEOF();
-          manager_->mutex()->Unlock();
           continue;
         }
-        manager_->mutex()->Unlock();
-        rocksutil::Status s = env_->FileExists(log_path_ + "/" + kBinlogPrefix +
-              std::to_string(number_+1));
-        if (s.ok()) {
-          TryToRollFile();
+        if (number_ < writer_number) {
+          // read what was written before the roll, then the next file
+          if (!eof_rechecked_) {
+            eof_rechecked_ = true;
+            reader_->UnmarkEOF();
+            continue;
+          }
+          if (!TryToRollFile()) {
+            return rocksutil::Status::Corruption("Roll to binlog_" +
+                std::to_string(number_ + 1) + " failed");
+          }
+          continue;
+        }
+        if (nonblocking_) {
+          return rocksutil::Status::Incomplete("No more binlog");
+        }
+        /*
+         * wait until new content is written or should exit;
+         */
+        Wait([this, reader_offset]() {
+            uint64_t number, offset;
+            manager_->GetPublishedTail(&number, &offset);
+            return number != number_ || offset != reader_offset;
+          });
+        if (should_exit_) {
+          return rocksutil::Status::Corruption("Exit");
         }
       } else {
         return status_;
@@ -78,7 +165,8 @@ rocksutil::Status BinlogReader::ReadRecord(
 
 rocksutil::log::Reader* CreateReader(rocksutil::Env* env,
     const std::string log_path, uint64_t num,
-    uint64_t offset, rocksutil::log::Reader::LogReporter* reporter) {
+    uint64_t offset, rocksutil::log::Reader::LogReporter* reporter,
+    BinlogManager* manager, std::shared_ptr<BinlogSegment>* segment) {
 
   rocksutil::EnvOptions env_options;
   env_options.use_mmap_reads = false;
@@ -86,8 +174,30 @@ rocksutil::log::Reader* CreateReader(rocksutil::Env* env,
 
   std::unique_ptr<rocksutil::SequentialFile> sequential_file;
   std::string filename = log_path + "/" + kBinlogPrefix + std::to_string(num);
-  rocksutil::Status s = rocksutil::NewSequentialFile(env, filename,
-                            &sequential_file, env_options);
+  /*
+   * a file rolled over is shared through the segment cache, or read in
+   * catch-up mode; the reader is at least a whole file behind the writer
+   */
+  uint64_t tail_number, tail_offset;
+  manager->GetPublishedTail(&tail_number, &tail_offset);
+  size_t readahead = manager->options().catchup_readahead;
+  rocksutil::Status s;
+  segment->reset();
+  if (manager->options().mmap_segments && num < tail_number) {
+    *segment = manager->segments()->Get(num);
+  }
+  if (*segment) {
+    sequential_file.reset(new SegmentFile(*segment));
+  } else if (readahead > 0 && num < tail_number) {
+    s = NewCatchupFile(filename, readahead, manager->prefetcher(),
+        &sequential_file);
+    if (s.ok()) {
+      manager->stats()->catchup_files++;
+    }
+  } else {
+    s = rocksutil::NewSequentialFile(env, filename,
+        &sequential_file, env_options);
+  }
   if (!s.ok()) {
     return nullptr;
   }
@@ -98,64 +208,124 @@ rocksutil::log::Reader* CreateReader(rocksutil::Env* env,
             true, offset);
 }
 
+bool BinlogReader::SwitchToRing(uint64_t reader_offset) {
+  if (manager_->options().ring_capacity == 0) {
+    return false;
+  }
+  rocksutil::MutexLock l(manager_->mutex());
+  /*
+   * switch to BinlogRing if we have caught up with the writer
+   * or the next group is still in the ring
+   */
+  uint64_t writer_number = 0;
+  uint64_t writer_offset = 0;
+  manager_->GetWriterOffset(&writer_number, &writer_offset);
+  uint64_t seq = 0;
+  uint64_t ring_offset = reader_offset;
+  bool found = false;
+  if (number_ == writer_number && reader_offset == writer_offset) {
+    seq = manager_->ring()->next_seq();
+    found = true;
+  } else {
+    ring_offset = record_end_;
+    found = manager_->ring()->Seek(number_, ring_offset, &seq);
+  }
+  if (found) {
+    in_memory_ = true;
+    offset_ = ring_offset;
+    ring_seq_ = seq;
+  }
+  return found;
+}
+
+bool BinlogReader::ReadFromRing(BinlogBatchPtr* batch, bool* would_block) {
+  BinlogRing::Entry entry;
+  while (!should_exit_) {
+    /*
+     * nothing new is published, wait without taking mutex(), the
+     * writer is never blocked by the readers caught up
+     */
+    if (ring_seq_ >= manager_->published_ring_seq()) {
+      if (nonblocking_) {
+        *would_block = true;
+        return false;
+      }
+      /*
+       * wait until new group is appended or should exit;
+       */
+      Wait([this]() {
+          return ring_seq_ < manager_->published_ring_seq();
+        });
+      continue;
+    }
+    rocksutil::MutexLock l(manager_->mutex());
+    if (!manager_->ring()->Get(ring_seq_, &entry)) {
+      // evicted, or cleared by ResetOffsetAndBinlog
+      return false;
+    }
+    if (!(entry.number == number_ && entry.begin == offset_) &&
+        !(entry.number == number_ + 1 && entry.begin == 0)) {
+      // not continuous, maybe a failed write, let the file decide
+      return false;
+    }
+    number_ = entry.number;
+    offset_ = entry.end;
+    ring_seq_++;
+    *batch = entry.batch;
+    return true;
+  }
+  return false;
+}
+
+bool BinlogReader::ResetReader(uint64_t number, uint64_t offset) {
+  std::shared_ptr<BinlogSegment> segment;
+  rocksutil::log::Reader* new_reader = CreateReader(env_,
+      log_path_, number, offset, &reporter_, manager_, &segment);
+  if (new_reader == nullptr) {
+    return false;
+  }
+  delete reader_;
+  reader_ = new_reader;
+  segment_ = segment;
+  number_ = number;
+  record_end_ = offset;
+  in_memory_ = false;
+  eof_rechecked_ = false;
+  return true;
+}
+
 bool BinlogReader::TryToRollFile() {
+  std::shared_ptr<BinlogSegment> segment;
   rocksutil::log::Reader* new_reader = CreateReader(env_,
-      log_path_, number_ + 1, 0, &reporter_);
+      log_path_, number_ + 1, 0, &reporter_, manager_, &segment);
   if (new_reader != nullptr) {
     delete reader_;
     reader_ = new_reader;
+    segment_ = segment;
     number_++;
+    record_end_ = 0;
+    eof_rechecked_ = false;
     return true;
   }
   return false;
 }
 
-void BinlogReader::DecodeBinlogContent(const rocksutil::Slice& content,
-    std::vector<BinlogFields>* result) {
-  int32_t pos = 0;
-  int32_t total = content.size();
-
-  uint8_t op = 0;
-  int32_t server_id = 0;
-  int32_t exec_time = 0;
-  int32_t filenum = 0;
-  int32_t key_size = 0;
-  int32_t value_size = 0;
-
-  result->clear();
-  while (pos + 1 < total) {
-    op = static_cast<uint8_t>(*(content.data() + pos));
-    server_id = rocksutil::DecodeFixed32(content.data() + pos + 1);
-    exec_time = rocksutil::DecodeFixed32(content.data() + pos + 5);
-    filenum = rocksutil::DecodeFixed32(content.data() + pos + 9);
-    key_size = rocksutil::DecodeFixed32(content.data() + pos + 13);
-    value_size = rocksutil::DecodeFixed32(content.data() + pos
-        + 17 + key_size);
-
-    result->push_back({op, server_id, exec_time, filenum,
-        std::string(content.data() + pos + 17, key_size),
-        std::string(content.data() + pos + 21 + key_size, value_size)
-        });
-
-    pos += (21 + key_size + value_size);
-  }
-}
-
 BinlogReader* CreateBinlogReader(const std::string& log_path,
     rocksutil::Env* env, uint64_t number, uint64_t offset,
     BinlogManager* manager) {
 
   BinlogReader* binlog_reader = new BinlogReader(nullptr, log_path, number,
-                                      env, manager);
+                                      offset, env, manager);
 
+  std::shared_ptr<BinlogSegment> segment;
   rocksutil::log::Reader* reader = CreateReader(env,
-      log_path, number, offset, binlog_reader->reporter());
+      log_path, number, offset, binlog_reader->reporter(), manager, &segment);
 
   if (reader == nullptr) {
     delete binlog_reader;
     return nullptr;
   } else {
-    binlog_reader->set_reader(reader);
+    binlog_reader->set_reader(reader, segment);
     return binlog_reader;
   }
 }
@@ -8,39 +8,73 @@
 
 #include <string>
 #include <vector>
+#include <memory>
+#include <atomic>
+#include <functional>
 
 #include "src/pika_hub_common.h"
+#include "src/pika_hub_binlog_batch.h"
+#include "src/pika_hub_binlog_segment.h"
 #include "rocksutil/log_reader.h"
+#include "rocksutil/mutexlock.h"
 #include "rocksutil/env.h"
 
+/*
+ * BinlogWaiter is the wait slot of a blocking BinlogReader, or of an
+ * event loop polling nonblocking readers. It is woken once after armed
+ * is set, by a write to fd if fd >= 0, otherwise by signaling cv
+ */
+struct BinlogWaiter {
+  BinlogWaiter() : fd(-1), armed(false), cv(&mutex), signaled(false) {}
+  int fd;
+  std::atomic<bool> armed;
+  rocksutil::port::Mutex mutex;
+  rocksutil::port::CondVar cv;
+  // protected by mutex
+  bool signaled;
+};
+
 class BinlogManager;
 class BinlogReader {
  public:
   BinlogReader(rocksutil::log::Reader* reader,
      const std::string& log_path,
      uint64_t number,
+     uint64_t offset,
      rocksutil::Env* env,
      BinlogManager* manager)
   : reader_(reader), log_path_(log_path),
   number_(number),
+  record_end_(offset),
   env_(env), manager_(manager),
-  should_exit_(false) {
+  should_exit_(false),
+  nonblocking_(false),
+  in_memory_(false),
+  offset_(0),
+  ring_seq_(0),
+  eof_rechecked_(false),
+  waiting_(false) {
     reporter_.status = &status_;
   }
 
-  ~BinlogReader() {
-    delete reader_;
-  }
+  ~BinlogReader();
 
-  rocksutil::Status ReadRecord(std::vector<BinlogFields>* result);
+  rocksutil::Status ReadRecord(BinlogBatchPtr* batch);
 
   bool IsEOF() {
     return reader_->IsEOF();
   }
+  /*
+   * the exact position after the last group returned, a new reader
+   * created with it continues from the next group
+   */
   void GetOffset(uint64_t* number, uint64_t* offset);
 
-  void set_reader(rocksutil::log::Reader* reader) {
+  // segment is the mapped file read by reader, or nullptr
+  void set_reader(rocksutil::log::Reader* reader,
+      std::shared_ptr<BinlogSegment> segment) {
     reader_ = reader;
+    segment_ = segment;
   }
   rocksutil::log::Reader::LogReporter* reporter() {
     return &reporter_;
@@ -48,18 +82,55 @@ class BinlogReader {
 
   void StopRead();
 
+  /*
+   * ReadRecord returns Incomplete instead of waiting for the writer,
+   * used by the readers polled by an event loop
+   */
+  void set_nonblocking(bool nonblocking) {
+    nonblocking_ = nonblocking;
+  }
+
  private:
   bool TryToRollFile();
-  static void DecodeBinlogContent(const rocksutil::Slice& content,
-      std::vector<BinlogFields>* result);
+  bool ResetReader(uint64_t number, uint64_t offset);
+  // would_block is set if the next group is not appended yet
+  bool ReadFromRing(BinlogBatchPtr* batch, bool* would_block);
+  // switch to BinlogRing if the next group is still there
+  bool SwitchToRing(uint64_t reader_offset);
+  // block until ready() holds, woken by the writer or StopRead
+  void Wait(const std::function<bool()>& ready);
   rocksutil::log::Reader* reader_;
+  /*
+   * the groups read from segment_ in one piece are decoded in place,
+   * the ones split over blocks are assembled by reader_ and copied
+   */
+  std::shared_ptr<BinlogSegment> segment_;
   std::string log_path_;
   uint64_t number_;
+  // the end of the last group read from the file
+  uint64_t record_end_;
   rocksutil::Env* env_;
   BinlogManager* manager_;
   bool should_exit_;
+  bool nonblocking_;
   rocksutil::Status status_;
   rocksutil::log::Reader::LogReporter reporter_;
+  /*
+   * in_memory_ is true when the reader has caught up with the writer and
+   * is served by BinlogRing, then (number_, offset_) is the position of
+   * the next group and ring_seq_ is its sequence in BinlogRing
+   */
+  bool in_memory_;
+  uint64_t offset_;
+  uint64_t ring_seq_;
+  /*
+   * binlog_<number_> is rolled over and the reader has looked past its
+   * EOF once more, so all of it is read
+   */
+  bool eof_rechecked_;
+  // waiter_ is added to the manager on the first blocking wait
+  bool waiting_;
+  BinlogWaiter waiter_;
 };
 
 extern BinlogReader* CreateBinlogReader(const std::string& log_path,
@@ -0,0 +1,77 @@
+//  Copyright (c) 2017-present The pika_hub Authors.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#include "src/pika_hub_binlog_ring.h"
+
+#include <algorithm>
+#include <utility>
+
+void BinlogRing::Append(uint64_t number, uint64_t begin, uint64_t end,
+    BinlogBatchPtr batch) {
+  if (!enabled()) {
+    return;
+  }
+  Entry entry;
+  entry.seq = next_seq_++;
+  entry.number = number;
+  entry.begin = begin;
+  entry.end = end;
+  entry.batch = std::move(batch);
+  usage_ += entry.batch->content().size();
+  entries_.push_back(std::move(entry));
+
+  // always keep the newest entry, even if it exceeds the capacity alone
+  while (usage_ > capacity_ && entries_.size() > 1) {
+    usage_ -= entries_.front().batch->content().size();
+    entries_.pop_front();
+  }
+}
+
+bool BinlogRing::Get(uint64_t seq, Entry* entry) const {
+  if (entries_.empty() || seq < entries_.front().seq ||
+      seq >= next_seq_) {
+    return false;
+  }
+  *entry = entries_[seq - entries_.front().seq];
+  return true;
+}
+
+bool BinlogRing::evicted(uint64_t seq) const {
+  if (entries_.empty()) {
+    return seq < next_seq_;
+  }
+  return seq < entries_.front().seq;
+}
+
+bool BinlogRing::Seek(uint64_t number, uint64_t offset,
+    uint64_t* seq) const {
+  auto iter = std::lower_bound(entries_.begin(), entries_.end(),
+      std::make_pair(number, offset),
+      [](const Entry& e, const std::pair<uint64_t, uint64_t>& pos) {
+        return e.number < pos.first ||
+          (e.number == pos.first && e.begin < pos.second);
+      });
+  if (iter == entries_.end()) {
+    return false;
+  }
+  if (iter->number == number && iter->begin == offset) {
+    *seq = iter->seq;
+    return true;
+  }
+  if (iter->number == number + 1 && iter->begin == 0 &&
+      iter != entries_.begin()) {
+    auto prev = iter - 1;
+    if (prev->number == number && prev->end == offset) {
+      *seq = iter->seq;
+      return true;
+    }
+  }
+  return false;
+}
+
+void BinlogRing::Clear() {
+  entries_.clear();
+  usage_ = 0;
+}
@@ -0,0 +1,71 @@
+//  Copyright (c) 2017-present The pika_hub Authors.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#ifndef SRC_PIKA_HUB_BINLOG_RING_H_
+#define SRC_PIKA_HUB_BINLOG_RING_H_
+
+#include <deque>
+#include <memory>
+#include <string>
+
+#include "src/pika_hub_binlog_batch.h"
+
+/*
+ * BinlogRing keeps the most recently committed record groups in memory,
+ * so BinlogReaders that are close to the writer could be served without
+ * touching the binlog file. It is NOT thread safe, all the methods should
+ * be called with BinlogManager::mutex() held.
+ */
+class BinlogRing {
+ public:
+  struct Entry {
+    uint64_t seq = 0;
+    uint64_t number = 0;
+    // [begin, end) is the position of this group in binlog_<number>
+    uint64_t begin = 0;
+    uint64_t end = 0;
+    BinlogBatchPtr batch;
+  };
+
+  explicit BinlogRing(size_t capacity)
+    : capacity_(capacity), usage_(0), next_seq_(0) {}
+
+  bool enabled() const {
+    return capacity_ > 0;
+  }
+  size_t usage() const {
+    return usage_;
+  }
+  uint64_t next_seq() const {
+    return next_seq_;
+  }
+
+  void Append(uint64_t number, uint64_t begin, uint64_t end,
+      BinlogBatchPtr batch);
+  /*
+   * Get the entry with sequence seq, return false if it has not been
+   * appended yet or it has already been evicted, check evicted() to tell
+   */
+  bool Get(uint64_t seq, Entry* entry) const;
+  bool evicted(uint64_t seq) const;
+  /*
+   * Find the entry which starts exactly at (number, offset), the first
+   * entry of binlog_<number + 1> also matches if (number, offset) is the
+   * end of binlog_<number>
+   */
+  bool Seek(uint64_t number, uint64_t offset, uint64_t* seq) const;
+  void Clear();
+
+ private:
+  size_t capacity_;
+  size_t usage_;
+  uint64_t next_seq_;
+  std::deque<Entry> entries_;
+
+  BinlogRing(const BinlogRing&);
+  BinlogRing& operator=(const BinlogRing&);
+};
+
+#endif  // SRC_PIKA_HUB_BINLOG_RING_H_
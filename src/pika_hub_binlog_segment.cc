@@ -0,0 +1,95 @@
+//  Copyright (c) 2017-present The pika_hub Authors.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#include "src/pika_hub_binlog_segment.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <string>
+
+std::shared_ptr<BinlogSegment> BinlogSegment::Map(
+    const std::string& filename) {
+  int fd;
+  do {
+    fd = open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+  } while (fd < 0 && errno == EINTR);
+  if (fd < 0) {
+    return nullptr;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size == 0) {
+    close(fd);
+    return nullptr;
+  }
+  size_t size = static_cast<size_t>(st.st_size);
+  void* data = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+  // the mapping holds the file
+  close(fd);
+  if (data == MAP_FAILED) {
+    return nullptr;
+  }
+  return std::shared_ptr<BinlogSegment>(
+      new BinlogSegment(static_cast<const char*>(data), size));
+}
+
+BinlogSegment::~BinlogSegment() {
+  munmap(const_cast<char*>(data_), size_);
+}
+
+std::shared_ptr<BinlogSegment> BinlogSegmentCache::Get(uint64_t number) {
+  rocksutil::MutexLock l(&mutex_);
+  auto iter = segments_.find(number);
+  if (iter != segments_.end()) {
+    std::shared_ptr<BinlogSegment> segment = iter->second.lock();
+    if (segment) {
+      return segment;
+    }
+  }
+  std::shared_ptr<BinlogSegment> segment = BinlogSegment::Map(
+      log_path_ + "/" + kBinlogPrefix + std::to_string(number));
+  if (!segment) {
+    return nullptr;
+  }
+  // forget the segments no longer used
+  for (auto it = segments_.begin(); it != segments_.end(); ) {
+    if (it->second.expired()) {
+      it = segments_.erase(it);
+    } else {
+      it++;
+    }
+  }
+  segments_[number] = segment;
+  return segment;
+}
+
+size_t BinlogSegmentCache::Size() {
+  rocksutil::MutexLock l(&mutex_);
+  size_t size = 0;
+  for (auto& segment : segments_) {
+    if (!segment.second.expired()) {
+      size++;
+    }
+  }
+  return size;
+}
+
+rocksutil::Status SegmentFile::Read(size_t n, rocksutil::Slice* result,
+    char* scratch) {
+  size_t left = pos_ < segment_->size() ?
+    static_cast<size_t>(segment_->size() - pos_) : 0;
+  size_t len = std::min(n, left);
+  *result = rocksutil::Slice(segment_->data() + pos_, len);
+  pos_ += len;
+  return rocksutil::Status::OK();
+}
+
+rocksutil::Status SegmentFile::Skip(uint64_t n) {
+  pos_ += n;
+  return rocksutil::Status::OK();
+}
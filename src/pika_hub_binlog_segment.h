@@ -0,0 +1,91 @@
+//  Copyright (c) 2017-present The pika_hub Authors.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#ifndef SRC_PIKA_HUB_BINLOG_SEGMENT_H_
+#define SRC_PIKA_HUB_BINLOG_SEGMENT_H_
+
+#include <map>
+#include <string>
+#include <memory>
+
+#include "src/pika_hub_common.h"
+#include "rocksutil/mutexlock.h"
+#include "rocksutil/env.h"
+
+/*
+ * BinlogSegment is a binlog file rolled over mapped read only. The file is
+ * never written again, so the mapping is shared by all the readers and
+ * the groups decoded in place; it is unmapped when the last reader and
+ * the last BinlogBatch pointing into it are gone, even if the file has
+ * been purged meanwhile
+ */
+class BinlogSegment {
+ public:
+  // return nullptr if filename could not be mapped, e.g. it is empty
+  static std::shared_ptr<BinlogSegment> Map(const std::string& filename);
+  ~BinlogSegment();
+
+  const char* data() const {
+    return data_;
+  }
+  size_t size() const {
+    return size_;
+  }
+  bool Contains(const rocksutil::Slice& slice) const {
+    return slice.data() >= data_ && slice.data() + slice.size() <= data_ +
+      size_;
+  }
+
+ private:
+  BinlogSegment(const char* data, size_t size)
+    : data_(data), size_(size) {}
+
+  const char* data_;
+  size_t size_;
+
+  BinlogSegment(const BinlogSegment&);
+  BinlogSegment& operator=(const BinlogSegment&);
+};
+
+/*
+ * BinlogSegmentCache maps every binlog file rolled over at most once at
+ * a time, only the segments still in use are kept
+ */
+class BinlogSegmentCache {
+ public:
+  explicit BinlogSegmentCache(const std::string& log_path)
+    : log_path_(log_path) {}
+
+  // binlog_<number> must be rolled over, return nullptr on error
+  std::shared_ptr<BinlogSegment> Get(uint64_t number);
+  // the segments mapped now
+  size_t Size();
+
+ private:
+  std::string log_path_;
+  // protect segments_
+  rocksutil::port::Mutex mutex_;
+  std::map<uint64_t, std::weak_ptr<BinlogSegment> > segments_;
+};
+
+/*
+ * SegmentFile reads a BinlogSegment like a SequentialFile, the result
+ * points into the mapped pages instead of being copied into scratch
+ */
+class SegmentFile : public rocksutil::SequentialFile {
+ public:
+  explicit SegmentFile(std::shared_ptr<BinlogSegment> segment)
+    : segment_(segment), pos_(0) {}
+
+  virtual rocksutil::Status Read(size_t n, rocksutil::Slice* result,
+      char* scratch) override;
+  virtual rocksutil::Status Skip(uint64_t n) override;
+
+ private:
+  std::shared_ptr<BinlogSegment> segment_;
+  uint64_t pos_;
+};
+
+#endif  // SRC_PIKA_HUB_BINLOG_SEGMENT_H_
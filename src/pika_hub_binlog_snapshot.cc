@@ -0,0 +1,80 @@
+//  Copyright (c) 2017-present The pika_hub Authors.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#include "src/pika_hub_binlog_snapshot.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <utility>
+
+#include "rocksutil/file_reader_writer.h"
+
+std::string SnapshotFileName(const std::string& log_path,
+    uint64_t begin_number, uint64_t end_number) {
+  return log_path + "/" + kBinlogSnapshotPrefix +
+    std::to_string(begin_number) + "_" + std::to_string(end_number);
+}
+
+bool ParseSnapshotFileName(const std::string& file, uint64_t* begin_number,
+    uint64_t* end_number, std::string* suffix) {
+  size_t prefix_len = strlen(kBinlogSnapshotPrefix);
+  if (file.size() <= prefix_len ||
+      file.compare(0, prefix_len, kBinlogSnapshotPrefix) != 0) {
+    return false;
+  }
+  const char* begin = file.c_str() + prefix_len;
+  char* end = nullptr;
+  *begin_number = strtoull(begin, &end, 10);
+  if (end == begin || *end != '_') {
+    return false;
+  }
+  begin = end + 1;
+  *end_number = strtoull(begin, &end, 10);
+  if (end == begin) {
+    return false;
+  }
+  suffix->assign(end);
+  return suffix->empty() || *suffix == kBinlogSnapshotTmpSuffix;
+}
+
+SnapshotReader* SnapshotReader::Open(rocksutil::Env* env,
+    const std::string& filename, uint64_t end_number) {
+  rocksutil::EnvOptions env_options;
+  std::unique_ptr<rocksutil::SequentialFile> sequential_file;
+  rocksutil::Status s = rocksutil::NewSequentialFile(env, filename,
+      &sequential_file, env_options);
+  if (!s.ok()) {
+    return nullptr;
+  }
+  std::unique_ptr<rocksutil::SequentialFileReader> sequential_reader(
+      new rocksutil::SequentialFileReader(std::move(sequential_file)));
+  SnapshotReader* reader = new SnapshotReader(end_number);
+  reader->reader_.reset(new rocksutil::log::Reader(
+        std::move(sequential_reader), &reader->reporter_, true, 0));
+  return reader;
+}
+
+bool SnapshotReader::Read(BinlogBatchPtr* batch) {
+  if (!status_.ok()) {
+    return false;
+  }
+  /*
+   * a snapshot is renamed only after it is synced, a torn tail is only
+   * found in the last binlog file of a crashed run
+   */
+  rocksutil::Slice record;
+  if (!reader_->ReadRecord(&record, &scratch_,
+        rocksutil::log::WALRecoveryMode::kTolerateCorruptedTailRecords)) {
+    return false;
+  }
+  std::string content(record.data(), record.size());
+  *batch = std::make_shared<const BinlogBatch>(&content);
+  if ((*batch)->corrupted()) {
+    status_ = rocksutil::Status::Corruption("uncompress group failed");
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,78 @@
+//  Copyright (c) 2017-present The pika_hub Authors.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#ifndef SRC_PIKA_HUB_BINLOG_SNAPSHOT_H_
+#define SRC_PIKA_HUB_BINLOG_SNAPSHOT_H_
+
+#include <string>
+#include <memory>
+
+#include "src/pika_hub_common.h"
+#include "src/pika_hub_binlog_batch.h"
+#include "rocksutil/log_reader.h"
+#include "rocksutil/env.h"
+
+/*
+ * A snapshot holds the latest state of every key written in
+ * binlog_<begin_number> to binlog_<end_number - 1>: the last set or del
+ * of the key and the last expireat after it. The records are sorted by
+ * key and encoded as binlog groups, so they are sent like the binlog.
+ * Streaming it and then the binlog from (end_number, 0) leaves a pika
+ * server in the same state as replaying the binlog from begin_number.
+ */
+struct SnapshotMeta {
+  uint64_t begin_number = 0;
+  uint64_t end_number = 0;
+  uint64_t size = 0;
+  // 0 if the snapshot is loaded from the last run
+  uint64_t keys = 0;
+};
+
+extern std::string SnapshotFileName(const std::string& log_path,
+    uint64_t begin_number, uint64_t end_number);
+/*
+ * return false if file is not binlog_snapshot_<begin>_<end><suffix>,
+ * suffix is empty or kBinlogSnapshotTmpSuffix
+ */
+extern bool ParseSnapshotFileName(const std::string& file,
+    uint64_t* begin_number, uint64_t* end_number, std::string* suffix);
+
+/*
+ * SnapshotReader reads the groups of a complete log file in order, a
+ * snapshot or a binlog file rolled over
+ */
+class SnapshotReader {
+ public:
+  // return nullptr if filename could not be opened
+  static SnapshotReader* Open(rocksutil::Env* env,
+      const std::string& filename, uint64_t end_number);
+
+  // return false at the end of the file or on error, see status()
+  bool Read(BinlogBatchPtr* batch);
+
+  const rocksutil::Status& status() const {
+    return status_;
+  }
+  uint64_t end_number() const {
+    return end_number_;
+  }
+
+ private:
+  explicit SnapshotReader(uint64_t end_number)
+    : end_number_(end_number) {
+    reporter_.status = &status_;
+  }
+
+  uint64_t end_number_;
+  rocksutil::Status status_;
+  rocksutil::log::Reader::LogReporter reporter_;
+  std::unique_ptr<rocksutil::log::Reader> reader_;
+  std::string scratch_;
+
+  SnapshotReader(const SnapshotReader&);
+  SnapshotReader& operator=(const SnapshotReader&);
+};
+
+#endif  // SRC_PIKA_HUB_BINLOG_SNAPSHOT_H_
@@ -5,12 +5,14 @@
 
 #include "src/pika_hub_binlog_writer.h"
 
+#include <algorithm>
 #include <utility>
 #include <memory>
 #include <string>
 
 #include "src/pika_hub_common.h"
 #include "src/pika_hub_binlog_manager.h"
+#include "src/pika_hub_binlog_compression.h"
 #include "rocksutil/file_reader_writer.h"
 #include "rocksutil/coding.h"
 
@@ -88,20 +90,452 @@ void BinlogWriter::WriteThread::ExitAsTaskGroupLeader(
   }
 }
 
+bool BinlogWriter::WriteThread::LinkTask(Executor* e) {
+  bool linked_as_leader;
+  LinkOne(e, &linked_as_leader);
+  return linked_as_leader;
+}
+
+BinlogWriter::Executor* BinlogWriter::WriteThread::FetchTaskGroup(
+    Executor** newest_executor) {
+  Executor* head = newest_executor_.exchange(nullptr,
+      std::memory_order_acquire);
+  *newest_executor = head;
+  if (head == nullptr) {
+    return nullptr;
+  }
+  while (head->link_older != nullptr) {
+    head->link_older->link_newer = head;
+    head = head->link_older;
+  }
+  return head;
+}
+
+BinlogWriter::~BinlogWriter() {
+  if (sync_thread_ != nullptr) {
+    sync_thread_->set_should_stop();
+    {
+    rocksutil::MutexLock l(&sync_mutex_);
+    sync_cv_.SignalAll();
+    }
+    sync_thread_->StopThread();
+    delete sync_thread_;
+    sync_thread_ = nullptr;
+  }
+  if (!form_threads_.empty()) {
+    /*
+     * stop the FormThreads first, they hand over all the queued tasks
+     * before exit, then FlushThread writes the last group
+     */
+    for (auto t : form_threads_) {
+      t->set_should_stop();
+    }
+    {
+    rocksutil::MutexLock l(&pipeline_mutex_);
+    pipeline_cv_.SignalAll();
+    }
+    for (auto t : form_threads_) {
+      t->StopThread();
+      delete t;
+    }
+    form_threads_.clear();
+  }
+  if (flush_thread_ != nullptr) {
+    flush_thread_->set_should_stop();
+    {
+    rocksutil::MutexLock l(&pipeline_mutex_);
+    pipeline_cv_.SignalAll();
+    }
+    flush_thread_->StopThread();
+    delete flush_thread_;
+  }
+  if (prealloc_thread_ != nullptr) {
+    // PreallocThread closes the retired files & removes the unused one
+    prealloc_thread_->set_should_stop();
+    {
+    rocksutil::MutexLock l(&prealloc_mutex_);
+    prealloc_cv_.SignalAll();
+    }
+    prealloc_thread_->StopThread();
+    delete prealloc_thread_;
+  }
+  if (manager_->options().sync_mode != kSyncNone && unsynced_bytes_ > 0) {
+    Sync();
+  }
+  delete writer_;
+  delete index_;
+}
+
+int BinlogWriter::StartWriterThread() {
+  flush_thread_ = new FlushThread(this);
+  int ret = flush_thread_->StartThread();
+  if (ret != 0) {
+    return ret;
+  }
+  for (size_t i = 0; i < lanes_.size(); i++) {
+    FormThread* t = new FormThread(this, static_cast<int>(i));
+    ret = t->StartThread();
+    if (ret != 0) {
+      delete t;
+      return ret;
+    }
+    form_threads_.push_back(t);
+  }
+  return 0;
+}
+
+int BinlogWriter::StartPreallocThread() {
+  {
+  rocksutil::MutexLock l(&prealloc_mutex_);
+  prealloc_number_ = number_ + 1;
+  }
+  prealloc_thread_ = new PreallocThread(this);
+  return prealloc_thread_->StartThread();
+}
+
+int BinlogWriter::StartSyncThread() {
+  sync_thread_ = new SyncThread(this);
+  return sync_thread_->StartThread();
+}
+
+static std::string BinlogFileName(const std::string& log_path,
+    uint64_t num) {
+  return log_path + "/" + kBinlogPrefix + std::to_string(num);
+}
+
+static rocksutil::log::Writer* CreateWriter(rocksutil::Env* env,
+    const std::string& filename, uint64_t preallocate_size) {
+
+  rocksutil::EnvOptions env_options;
+  env_options.use_mmap_reads = false;
+  env_options.use_mmap_writes = false;
+  // the readers rely on the file size, never expose the allocated space
+  env_options.fallocate_with_keep_size = true;
+  std::unique_ptr<rocksutil::WritableFile> writable_file;
+  rocksutil::Status s = NewWritableFile(env, filename,
+                &writable_file, env_options);
+  if (!s.ok()) {
+    return nullptr;
+  }
+  if (preallocate_size > 0) {
+    // best effort, the file still grows by append if it fails
+    writable_file->Allocate(0, preallocate_size);
+  }
+
+  std::unique_ptr<rocksutil::WritableFileWriter> writable_file_writer(
+       new rocksutil::WritableFileWriter(std::move(writable_file),
+         env_options));
+
+  return new rocksutil::log::Writer(std::move(writable_file_writer));
+}
+
+void* BinlogWriter::PreallocThread::ThreadMain() {
+  const BinlogOptions& options = writer_->manager_->options();
+  std::vector<rocksutil::log::Writer*> retired;
+  uint64_t number = 0;
+  while (true) {
+    {
+    rocksutil::MutexLock l(&writer_->prealloc_mutex_);
+    while (!should_stop() && writer_->retired_writers_.empty() &&
+           (writer_->prealloc_number_ == 0 ||
+            writer_->prealloc_writer_ != nullptr)) {
+      writer_->prealloc_cv_.Wait();
+    }
+    retired.swap(writer_->retired_writers_);
+    number = writer_->prealloc_writer_ == nullptr ?
+      writer_->prealloc_number_ : 0;
+    }
+
+    for (auto w : retired) {
+      if (options.sync_mode != kSyncNone) {
+        w->file()->Sync(false);
+      }
+      {
+      rocksutil::MutexLock l(&writer_->sync_mutex_);
+      writer_->WaitForSync(w);
+      }
+      delete w;
+    }
+    retired.clear();
+
+    if (should_stop()) {
+      break;
+    }
+    if (number == 0) {
+      continue;
+    }
+
+    std::string filename = BinlogFileName(writer_->log_path_, number) +
+      kBinlogPreallocSuffix;
+    std::string index_filename = BinlogFileName(writer_->log_path_, number) +
+      kBinlogIndexSuffix;
+    rocksutil::log::Writer* w = CreateWriter(writer_->env_, filename,
+        options.file_size);
+    BinlogIndexWriter* index = nullptr;
+    if (w != nullptr) {
+      index = CreateBinlogIndexWriter(writer_->env_, index_filename);
+    }
+    rocksutil::MutexLock l(&writer_->prealloc_mutex_);
+    if (w == nullptr) {
+      /*
+       * failed, RollFile creates the file itself and asks for
+       * the next one later
+       */
+      if (writer_->prealloc_number_ == number) {
+        writer_->prealloc_number_ = 0;
+      }
+    } else if (writer_->prealloc_number_ == number) {
+      writer_->prealloc_writer_ = w;
+      writer_->prealloc_index_ = index;
+    } else {
+      // RollFile did not wait for us
+      delete w;
+      writer_->env_->DeleteFile(filename);
+      if (index != nullptr) {
+        delete index;
+        writer_->env_->DeleteFile(index_filename);
+      }
+    }
+  }
+
+  rocksutil::MutexLock l(&writer_->prealloc_mutex_);
+  if (writer_->prealloc_writer_ != nullptr) {
+    delete writer_->prealloc_writer_;
+    writer_->prealloc_writer_ = nullptr;
+    writer_->env_->DeleteFile(BinlogFileName(writer_->log_path_,
+          writer_->prealloc_number_) + kBinlogPreallocSuffix);
+  }
+  if (writer_->prealloc_index_ != nullptr) {
+    delete writer_->prealloc_index_;
+    writer_->prealloc_index_ = nullptr;
+    writer_->env_->DeleteFile(BinlogFileName(writer_->log_path_,
+          writer_->prealloc_number_) + kBinlogIndexSuffix);
+  }
+  return nullptr;
+}
+
+void* BinlogWriter::SyncThread::ThreadMain() {
+  uint64_t interval_us = std::max<uint64_t>(
+      writer_->manager_->options().sync_interval_ms, 1) * 1000;
+  rocksutil::MutexLock l(&writer_->sync_mutex_);
+  while (!should_stop()) {
+    uint64_t now = writer_->env_->NowMicros();
+    if (writer_->unsynced_bytes_ == 0) {
+      writer_->sync_cv_.TimedWait(now + interval_us);
+      continue;
+    }
+    uint64_t due = writer_->last_sync_us_ + interval_us;
+    if (now < due) {
+      writer_->sync_cv_.TimedWait(due);
+      continue;
+    }
+
+    /*
+     * sync what is written so far without blocking the writer, a roll
+     * meanwhile retires the file but leaves it open until we are done
+     */
+    rocksutil::log::Writer* w = writer_->writer_;
+    uint64_t bytes = writer_->unsynced_bytes_;
+    writer_->syncing_writer_ = w;
+    writer_->sync_mutex_.Unlock();
+    /*
+     * AddRecord flushes every group to the file, fdatasync the file
+     * directly, the buffer of WritableFileWriter is the writer's own.
+     * A failure shows up again in the next sync of the writer
+     */
+    w->file()->writable_file()->Sync();
+    uint64_t end_us = writer_->env_->NowMicros();
+    writer_->sync_mutex_.Lock();
+
+    writer_->syncing_writer_ = nullptr;
+    writer_->sync_cv_.SignalAll();
+    if (writer_->writer_ == w) {
+      // the groups written during the sync are left to the next one
+      writer_->unsynced_bytes_ -= std::min(bytes, writer_->unsynced_bytes_);
+      writer_->last_sync_us_ = std::max(writer_->last_sync_us_, now);
+    }
+    writer_->manager_->stats()->syncs++;
+    writer_->manager_->stats()->sync_latency.Add(end_us - now);
+  }
+  return nullptr;
+}
+
+void* BinlogWriter::FormThread::ThreadMain() {
+  Executor* first = nullptr;
+  Executor* newest_executor = nullptr;
+  while (true) {
+    {
+    rocksutil::MutexLock l(&writer_->pipeline_mutex_);
+    while ((first = writer_->lanes_[lane_]->FetchTaskGroup(
+            &newest_executor)) == nullptr && !should_stop()) {
+      writer_->pipeline_cv_.Wait();
+    }
+    }
+    if (first == nullptr) {
+      break;
+    }
+
+    TaskGroup* group = new TaskGroup;
+    group->first = first;
+    group->last = newest_executor;
+    writer_->FormTaskGroup(first, newest_executor, &group->rep);
+
+    {
+    rocksutil::MutexLock l(&writer_->pipeline_mutex_);
+    while (writer_->flushing_group_ != nullptr) {
+      writer_->pipeline_cv_.Wait();
+    }
+    writer_->flushing_group_ = group;
+    writer_->pipeline_cv_.SignalAll();
+    }
+  }
+  return nullptr;
+}
+
+void* BinlogWriter::FlushThread::ThreadMain() {
+  TaskGroup* group = nullptr;
+  while (true) {
+    {
+    rocksutil::MutexLock l(&writer_->pipeline_mutex_);
+    while (writer_->flushing_group_ == nullptr && !should_stop()) {
+      writer_->pipeline_cv_.Wait();
+    }
+    group = writer_->flushing_group_;
+    // release the slot at once, so FormThread could hand over next group
+    writer_->flushing_group_ = nullptr;
+    writer_->pipeline_cv_.SignalAll();
+    }
+    if (group == nullptr) {
+      break;
+    }
+
+    rocksutil::Status result;
+    if (!group->rep.empty()) {
+      result = writer_->WriteTaskGroup(&group->rep);
+    }
+
+    Executor* e = group->first;
+    while (true) {
+      /*
+       * e and its promise are destroyed once the caller is waked up, so
+       * take the promise over before setting the value
+       */
+      Executor* next = e->link_newer;
+      bool last = (e == group->last);
+      std::promise<rocksutil::Status> promise(std::move(*e->promise));
+      promise.set_value(result);
+      if (last) {
+        break;
+      }
+      e = next;
+    }
+    delete group;
+  }
+  return nullptr;
+}
+
 uint64_t BinlogWriter::GetOffsetInFile() {
   return writer_->file()->GetFileSize();
 }
 
-rocksutil::Status BinlogWriter::Append(uint8_t op, const std::string& key,
-    const std::string& value, int32_t server_id,
+int BinlogWriter::Lane(const rocksutil::Slice& key) {
+  if (lanes_.size() == 1) {
+    return 0;
+  }
+  return ConflictTable::Partition(key, static_cast<int>(lanes_.size()));
+}
+
+rocksutil::Status BinlogWriter::Append(uint8_t op,
+    const rocksutil::Slice& key,
+    const rocksutil::Slice& value, int32_t server_id,
     int32_t exec_time, int32_t filenum) {
+  uint64_t start_us = env_->NowMicros();
   Task task(op, key, value, server_id, exec_time, filenum);
-  return Append(&task);
+  int lane = Lane(key);
+  rocksutil::Status s;
+  if (!form_threads_.empty()) {
+    s = AppendByWriterThread(lane, &task, 1);
+  } else {
+    s = Append(lane, &task, 1);
+  }
+  manager_->stats()->append_latency.Add(env_->NowMicros() - start_us);
+  return s;
+}
+
+rocksutil::Status BinlogWriter::AppendBatch(const std::vector<Task>& tasks) {
+  if (tasks.empty()) {
+    return rocksutil::Status::OK();
+  }
+  uint64_t start_us = env_->NowMicros();
+  rocksutil::Status s;
+  if (lanes_.size() == 1) {
+    if (!form_threads_.empty()) {
+      s = AppendByWriterThread(0, tasks.data(), tasks.size());
+    } else {
+      s = Append(0, tasks.data(), tasks.size());
+    }
+    manager_->stats()->append_latency.Add(env_->NowMicros() - start_us);
+    return s;
+  }
+
+  // split the batch by lane, the order of the tasks in a lane is kept
+  std::vector<std::vector<Task>> split(lanes_.size());
+  for (const auto& task : tasks) {
+    split[Lane(task.key_)].push_back(task);
+  }
+  if (form_threads_.empty()) {
+    for (size_t i = 0; i < split.size() && s.ok(); i++) {
+      if (!split[i].empty()) {
+        s = Append(static_cast<int>(i), split[i].data(), split[i].size());
+      }
+    }
+  } else {
+    // queue to all the lanes first, so they are formed in parallel
+    std::vector<std::unique_ptr<Executor>> executors;
+    std::vector<std::promise<rocksutil::Status>> promises(split.size());
+    std::vector<std::future<rocksutil::Status>> futures;
+    for (size_t i = 0; i < split.size(); i++) {
+      if (split[i].empty()) {
+        continue;
+      }
+      executors.emplace_back(new Executor(split[i].data(), split[i].size()));
+      futures.push_back(LinkToFormThread(static_cast<int>(i),
+            executors.back().get(), &promises[i]));
+    }
+    for (auto& f : futures) {
+      rocksutil::Status result = f.get();
+      if (s.ok()) {
+        s = result;
+      }
+    }
+  }
+  manager_->stats()->append_latency.Add(env_->NowMicros() - start_us);
+  return s;
 }
 
-rocksutil::Status BinlogWriter::Append(Task* task) {
-  Executor e(task);
-  write_thread_.JoinTaskGroup(&e);
+std::future<rocksutil::Status> BinlogWriter::LinkToFormThread(int lane,
+    Executor* e, std::promise<rocksutil::Status>* promise) {
+  std::future<rocksutil::Status> future = promise->get_future();
+  e->promise = promise;
+  if (lanes_[lane]->LinkTask(e)) {
+    rocksutil::MutexLock l(&pipeline_mutex_);
+    pipeline_cv_.SignalAll();
+  }
+  return future;
+}
+
+rocksutil::Status BinlogWriter::AppendByWriterThread(int lane,
+    const Task* tasks, size_t count) {
+  Executor e(tasks, count);
+  std::promise<rocksutil::Status> promise;
+  return LinkToFormThread(lane, &e, &promise).get();
+}
+
+rocksutil::Status BinlogWriter::Append(int lane, const Task* tasks,
+    size_t count) {
+  WriteThread* write_thread = lanes_[lane].get();
+  Executor e(tasks, count);
+  write_thread->JoinTaskGroup(&e);
   if (!e.leader && e.done) {
     return e.status;
   }
@@ -109,126 +543,302 @@ rocksutil::Status BinlogWriter::Append(Task* task) {
   // only LEADER reaches this point
   assert(e.leader == true);
 
-  if (GetOffsetInFile() >= kMaxBinlogFileSize) {
-    RollFile();
-  }
-
   count_++;
-  assert(count_ == 1);
+  assert(count_ <= static_cast<int>(lanes_.size()));
 
   Executor* newest_executor;
-  write_thread_.EnterAsTaskGroupLeader(&newest_executor);
+  write_thread->EnterAsTaskGroupLeader(&newest_executor);
 
-  Executor* last_executor = &e;
   std::string rep;
+  FormTaskGroup(&e, newest_executor, &rep);
+
+  rocksutil::Status result;
+  if (!rep.empty()) {
+    result = CommitTaskGroup(&rep);
+  }
+
+  count_--;
+  assert(count_ >= 0);
+  write_thread->ExitAsTaskGroupLeader(&e, newest_executor, result);
+
+  e.done = true;
+  return result;
+}
+
+void BinlogWriter::FormTaskGroup(Executor* first, Executor* last,
+    std::string* rep) {
+  size_t group_size = 0;
+  uint64_t tasks = 0;
+  for (Executor* iter = first; ; iter = iter->link_newer) {
+    for (size_t i = 0; i < iter->count; i++) {
+      group_size += iter->task[i].EncodedSize();
+    }
+    tasks += iter->count;
+    if (iter == last) {
+      break;
+    }
+  }
+  manager_->stats()->tasks += tasks;
+
+  Executor* executor = first;
+  rep->clear();
+  rep->reserve(group_size);
   while (true) {
-    rocksutil::Cache::Handle* handle = manager_->lru_cache()->
-      Lookup(last_executor->task->key_);
-    bool valid = true;
-    if (handle) {
-      int32_t _exec_time = static_cast<CacheEntity*>(
-          manager_->lru_cache()->Value(handle))->exec_time;
-      int32_t _server_id = static_cast<CacheEntity*>(
-          manager_->lru_cache()->Value(handle))->server_id;
-      if (last_executor->task->exec_time_ < _exec_time ||
-          (last_executor->task->exec_time_ == _exec_time &&
-           last_executor->task->server_id_ != _server_id)) {
-        valid = false;
+    for (size_t i = 0; i < executor->count; i++) {
+      const Task* task = &executor->task[i];
+      int32_t _server_id, _exec_time;
+      bool valid = true;
+      if (manager_->conflict_table()->Lookup(task->key_,
+            &_server_id, &_exec_time)) {
+        if (task->exec_time_ < _exec_time ||
+            (task->exec_time_ == _exec_time &&
+             task->server_id_ != _server_id)) {
+          valid = false;
+        }
       }
-      manager_->lru_cache()->Release(handle);
-    }
-    if (valid) {
-      CacheEntity* entity = new CacheEntity(last_executor->task->server_id_,
-          last_executor->task->exec_time_);
-      manager_->lru_cache()->Insert(last_executor->task->key_, entity,
-          1, &CacheEntityDeleter);
+      if (valid) {
+        manager_->conflict_table()->Insert(task->key_,
+            task->server_id_, task->exec_time_);
 
-      rep.append(last_executor->task->rep_);
+        EncodeBinlogContent(rep, task);
+      }
     }
 
-    if (last_executor == newest_executor) {
+    if (executor == last) {
       break;
     }
-    last_executor = last_executor->link_newer;
+    executor = executor->link_newer;
   }
+}
 
-  rocksutil::Status result;
-  if (!rep.empty()) {
-    {
-    rocksutil::MutexLock l(manager_->mutex());
-    result = writer_->AddRecord(rep);
-    manager_->UpdateWriterOffset(number_, GetOffsetInFile());
-    manager_->cv()->SignalAll();
-    }
+rocksutil::Status BinlogWriter::CommitTaskGroup(std::string* rep) {
+  if (lanes_.size() == 1) {
+    return WriteTaskGroup(rep);
   }
 
-  count_--;
-  assert(count_ == 0);
-  write_thread_.ExitAsTaskGroupLeader(&e, last_executor, result);
+  PendingGroup group(rep);
+  commit_mutex_.Lock();
+  pending_groups_.push_back(&group);
+  while (!group.done && committing_) {
+    commit_cv_.Wait();
+  }
+  if (group.done) {
+    commit_mutex_.Unlock();
+    return group.status;
+  }
 
-  e.done = true;
-  return result;
+  /*
+   * take over the writing, the groups of the other lanes queued so far
+   * are appended to one record, so they share the write & the sync.
+   * Every lane waits for its group before forming the next one, so the
+   * order of the writes to one key is kept
+   */
+  committing_ = true;
+  std::vector<PendingGroup*> groups;
+  groups.swap(pending_groups_);
+  commit_mutex_.Unlock();
+
+  std::string* merged = groups[0]->rep;
+  for (size_t i = 1; i < groups.size(); i++) {
+    merged->append(*groups[i]->rep);
+  }
+  rocksutil::Status result = WriteTaskGroup(merged);
+
+  // the groups queued meanwhile are written by one of their leaders
+  commit_mutex_.Lock();
+  for (auto g : groups) {
+    g->status = result;
+    g->done = true;
+  }
+  committing_ = false;
+  commit_cv_.SignalAll();
+  commit_mutex_.Unlock();
+  return group.status;
 }
 
-rocksutil::log::Writer* CreateWriter(rocksutil::Env* env,
-    const std::string log_path, uint64_t num) {
+rocksutil::Status BinlogWriter::WriteTaskGroup(std::string* rep) {
+  /*
+   * decode the group once here, the batch is shared by all the readers
+   * served from BinlogRing
+   */
+  BinlogBatchPtr batch;
+  if (manager_->ring()->enabled()) {
+    batch = std::make_shared<const BinlogBatch>(rep);
+  }
+  rocksutil::Slice content = batch ? batch->content() : rocksutil::Slice(*rep);
+  /*
+   * compressed once by the leader, BinlogRing keeps the records as they
+   * are, so the readers caught up never uncompress
+   */
+  std::string compressed;
+  BinlogStats* stats = manager_->stats();
+  if (CompressGroup(manager_->options().compression, content, &compressed)) {
+    stats->compressed_groups++;
+    stats->compress_input_bytes += content.size();
+    stats->compress_output_bytes += compressed.size();
+    content = compressed;
+  }
 
-  rocksutil::EnvOptions env_options;
-  env_options.use_mmap_reads = false;
-  env_options.use_mmap_writes = false;
-  std::unique_ptr<rocksutil::WritableFile> writable_file;
-  std::string filename = log_path + "/" + kBinlogPrefix + std::to_string(num);
-  rocksutil::Status s = NewWritableFile(env, filename,
-                &writable_file, env_options);
-  if (!s.ok()) {
-    return nullptr;
+  rocksutil::MutexLock sync_lock(&sync_mutex_);
+  if (GetOffsetInFile() >= manager_->options().file_size) {
+    RollFile();
+  }
+  rocksutil::Status result;
+  uint64_t begin, end, ring_seq;
+  {
+  rocksutil::MutexLock l(manager_->mutex());
+  begin = GetOffsetInFile();
+  result = writer_->AddRecord(content);
+  end = GetOffsetInFile();
+  manager_->UpdateWriterOffset(number_, end);
+  if (result.ok() && batch) {
+    manager_->ring()->Append(number_, begin, end, batch);
+  }
+  ring_seq = manager_->ring()->next_seq();
+  }
+  // wake the readers outside of mutex(), they need not take it to go on
+  manager_->PublishTail(number_, end, ring_seq, end - begin);
+  manager_->stats()->groups++;
+  if (result.ok() && index_ != nullptr) {
+    index_->Add(begin);
   }
 
-  std::unique_ptr<rocksutil::WritableFileWriter> writable_file_writer(
-       new rocksutil::WritableFileWriter(std::move(writable_file),
-         env_options));
+  /*
+   * the readers are waked up before the sync, the senders could ship
+   * the group while it is being synced
+   */
+  if (result.ok()) {
+    result = MaybeSync(end - begin);
+  }
+  return result;
+}
 
-  return new rocksutil::log::Writer(std::move(writable_file_writer));
+rocksutil::Status BinlogWriter::MaybeSync(uint64_t bytes) {
+  const BinlogOptions& options = manager_->options();
+  if (options.sync_mode == kSyncNone) {
+    return rocksutil::Status::OK();
+  }
+  unsynced_bytes_ += bytes;
+  if (options.sync_mode == kSyncInterval &&
+      unsynced_bytes_ < options.sync_bytes &&
+      env_->NowMicros() - last_sync_us_ < options.sync_interval_ms * 1000) {
+    if (unsynced_bytes_ == bytes) {
+      // SyncThread may be sleeping a whole interval, wake it to the due
+      sync_cv_.SignalAll();
+    }
+    return rocksutil::Status::OK();
+  }
+  return Sync();
+}
+
+rocksutil::Status BinlogWriter::Sync() {
+  uint64_t start_us = env_->NowMicros();
+  // fdatasync
+  rocksutil::Status s = writer_->file()->Sync(false);
+  last_sync_us_ = env_->NowMicros();
+  unsynced_bytes_ = 0;
+  manager_->stats()->syncs++;
+  manager_->stats()->sync_latency.Add(last_sync_us_ - start_us);
+  return s;
 }
 
 void BinlogWriter::RollFile() {
-  rocksutil::log::Writer* new_writer = CreateWriter(env_,
-      log_path_, number_ + 1);
-  if (new_writer != nullptr) {
+  std::string filename = BinlogFileName(log_path_, number_ + 1);
+  rocksutil::log::Writer* new_writer = nullptr;
+  BinlogIndexWriter* new_index = nullptr;
+  if (prealloc_thread_ != nullptr) {
+    rocksutil::MutexLock l(&prealloc_mutex_);
+    if (prealloc_writer_ != nullptr && prealloc_number_ == number_ + 1) {
+      /*
+       * the readers switch to binlog_<n+1> once it exists, it is renamed
+       * here after all of binlog_<n> has been written
+       */
+      rocksutil::Status s = env_->RenameFile(
+          filename + kBinlogPreallocSuffix, filename);
+      if (s.ok()) {
+        new_writer = prealloc_writer_;
+        new_index = prealloc_index_;
+      } else {
+        delete prealloc_writer_;
+        delete prealloc_index_;
+      }
+      prealloc_writer_ = nullptr;
+      prealloc_index_ = nullptr;
+    }
+  }
+  if (new_writer == nullptr) {
+    new_writer = CreateWriter(env_, filename, 0);
+    if (new_writer == nullptr) {
+      return;
+    }
+    new_index = CreateBinlogIndexWriter(env_, filename + kBinlogIndexSuffix);
+  }
+
+  if (prealloc_thread_ != nullptr) {
+    // the tail of the old file is synced by PreallocThread
+    RetireWriter(writer_);
+  } else {
+    if (manager_->options().sync_mode != kSyncNone && unsynced_bytes_ > 0) {
+      writer_->file()->Sync(false);
+    }
+    WaitForSync(writer_);
     delete writer_;
-    writer_ = new_writer;
-    number_++;
   }
+  unsynced_bytes_ = 0;
+  last_sync_us_ = env_->NowMicros();
+  writer_ = new_writer;
+  delete index_;
+  index_ = new_index;
+  number_++;
 }
 
-void BinlogWriter::CacheEntityDeleter(const rocksutil::Slice& key,
-    void* value) {
-  delete static_cast<CacheEntity*>(value);
+void BinlogWriter::WaitForSync(rocksutil::log::Writer* writer) {
+  while (syncing_writer_ == writer) {
+    sync_cv_.Wait();
+  }
 }
 
+void BinlogWriter::RetireWriter(rocksutil::log::Writer* writer) {
+  rocksutil::MutexLock l(&prealloc_mutex_);
+  retired_writers_.push_back(writer);
+  prealloc_number_ = number_ + 2;
+  prealloc_cv_.SignalAll();
+}
 
-void BinlogWriter::EncodeBinlogContent(std::string* result,
-    uint8_t op, const std::string& key, const std::string& value,
-    int32_t server_id, int32_t exec_time, int32_t filenum) {
-  result->clear();
 
-  result->append(reinterpret_cast<char*>(&op), sizeof(uint8_t));
-  rocksutil::PutFixed32(result, server_id);
-  rocksutil::PutFixed32(result, exec_time);
-  rocksutil::PutFixed32(result, filenum);
-  rocksutil::PutFixed32(result, key.size());
-  result->append(key.data(), key.size());
-  rocksutil::PutFixed32(result, value.size());
-  result->append(value.data(), value.size());
+void BinlogWriter::EncodeBinlogContent(std::string* result,
+    const Task* task) {
+  result->append(reinterpret_cast<const char*>(&task->op_), sizeof(uint8_t));
+  rocksutil::PutFixed32(result, task->server_id_);
+  rocksutil::PutFixed32(result, task->exec_time_);
+  rocksutil::PutFixed32(result, task->filenum_);
+  rocksutil::PutFixed32(result, task->key_.size());
+  result->append(task->key_.data(), task->key_.size());
+  rocksutil::PutFixed32(result, task->value_.size());
+  result->append(task->value_.data(), task->value_.size());
 }
 
 
 BinlogWriter* CreateBinlogWriter(const std::string& log_path,
     uint64_t number, rocksutil::Env* env,
     BinlogManager* manager) {
+  std::string filename = BinlogFileName(log_path, number);
   rocksutil::log::Writer* writer = CreateWriter(env,
-      log_path, number);
-  return (writer == nullptr ?
-      nullptr : new BinlogWriter(writer, number, log_path, env,
-                      manager));
+      filename, manager->options().file_size);
+  if (writer == nullptr) {
+    return nullptr;
+  }
+  BinlogIndexWriter* index = CreateBinlogIndexWriter(env,
+      filename + kBinlogIndexSuffix);
+  BinlogWriter* binlog_writer = new BinlogWriter(writer, index, number,
+      log_path, env, manager, manager->options().partitions);
+  if (binlog_writer->StartPreallocThread() != 0 ||
+      (manager->options().sync_mode == kSyncInterval &&
+       binlog_writer->StartSyncThread() != 0) ||
+      (manager->options().writer_thread &&
+       binlog_writer->StartWriterThread() != 0)) {
+    delete binlog_writer;
+    return nullptr;
+  }
+  return binlog_writer;
 }
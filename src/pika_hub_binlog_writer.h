@@ -7,7 +7,12 @@
 #define SRC_PIKA_HUB_BINLOG_WRITER_H_
 
 #include <string>
+#include <vector>
+#include <memory>
+#include <future>
 
+#include "src/pika_hub_binlog_index.h"
+#include "pink/include/pink_thread.h"
 #include "rocksutil/log_writer.h"
 #include "rocksutil/mutexlock.h"
 #include "rocksutil/env.h"
@@ -17,48 +22,84 @@ class BinlogManager;
 class BinlogWriter {
  public:
   BinlogWriter(rocksutil::log::Writer* writer,
+     BinlogIndexWriter* index,
      uint64_t number, const std::string& log_path,
      rocksutil::Env* env,
-     BinlogManager* manager)
-  : writer_(writer), log_path_(log_path),
+     BinlogManager* manager,
+     int partitions)
+  : writer_(writer), index_(index), log_path_(log_path),
     number_(number), env_(env),
-    manager_(manager), count_(0) {}
-
-  ~BinlogWriter() {
-    delete writer_;
+    manager_(manager), count_(0),
+    unsynced_bytes_(0), last_sync_us_(env->NowMicros()),
+    sync_cv_(&sync_mutex_),
+    syncing_writer_(nullptr),
+    sync_thread_(nullptr),
+    commit_cv_(&commit_mutex_),
+    committing_(false),
+    pipeline_cv_(&pipeline_mutex_),
+    flushing_group_(nullptr),
+    flush_thread_(nullptr),
+    prealloc_cv_(&prealloc_mutex_),
+    prealloc_number_(0),
+    prealloc_writer_(nullptr),
+    prealloc_index_(nullptr),
+    prealloc_thread_(nullptr) {
+    for (int i = 0; i < partitions; i++) {
+      lanes_.emplace_back(new WriteThread);
+    }
   }
 
+  ~BinlogWriter();
+
+  int StartWriterThread();
+  int StartPreallocThread();
+  // only needed by kSyncInterval
+  int StartSyncThread();
+
   uint64_t GetOffsetInFile();
-  rocksutil::Status Append(uint8_t op, const std::string& key,
-      const std::string& value, int32_t server_id,
+  /*
+   * key & value are only referenced until Append returns, they are
+   * encoded into the group buffer by the leader directly
+   */
+  rocksutil::Status Append(uint8_t op, const rocksutil::Slice& key,
+      const rocksutil::Slice& value, int32_t server_id,
       int32_t exec_time, int32_t filenum);
 
   uint64_t number() {
     return number_;
   }
 
-  static void CacheEntityDeleter(const rocksutil::Slice& key, void* value);
+  class Task;
+  /*
+   * Append the tasks as one executor per lane, the tasks of a lane are
+   * written in the same group and the conflicts are checked one by one
+   * in order. With one lane the whole batch is one group
+   */
+  rocksutil::Status AppendBatch(const std::vector<Task>& tasks);
 
   class Task {
    public:
-    Task(uint8_t op, const std::string& key,
-        const std::string& value, int32_t server_id,
+    Task(uint8_t op, const rocksutil::Slice& key,
+        const rocksutil::Slice& value, int32_t server_id,
         int32_t exec_time, int32_t filenum) :
-      op_(op), key_(key), server_id_(server_id),
-      exec_time_(exec_time), filenum_(filenum) {
-        EncodeBinlogContent(&rep_, op, key,
-            value, server_id, exec_time, filenum);
+      op_(op), key_(key), value_(value), server_id_(server_id),
+      exec_time_(exec_time), filenum_(filenum) {}
+    size_t EncodedSize() const {
+      // op + server_id + exec_time + filenum + key_size + value_size
+      return 21 + key_.size() + value_.size();
     }
     uint8_t op_;
-    std::string key_;
+    rocksutil::Slice key_;
+    rocksutil::Slice value_;
     int32_t server_id_;
     int32_t exec_time_;
     int32_t filenum_;
-    std::string rep_;
   };
 
   struct Executor {
-    Task* task;
+    // task[0, count)
+    const Task* task;
+    size_t count;
     bool leader;
     bool done;
     rocksutil::Status status;
@@ -66,13 +107,17 @@ class BinlogWriter {
     Executor* link_newer;
     rocksutil::port::Mutex mutex;
     rocksutil::port::CondVar cv;
-    explicit Executor(Task* t) :
+    // only used by writer thread mode
+    std::promise<rocksutil::Status>* promise;
+    Executor(const Task* t, size_t n) :
       task(t),
+      count(n),
       leader(false),
       done(false),
       link_older(nullptr),
       link_newer(nullptr),
-      cv(&mutex) {}
+      cv(&mutex),
+      promise(nullptr) {}
   };
 
   class WriteThread {
@@ -84,6 +129,14 @@ class BinlogWriter {
     void ExitAsTaskGroupLeader(Executor* leader, Executor* last_executor,
           const rocksutil::Status& result);
 
+    /*
+     * writer thread mode, the executors are only queued by LinkTask,
+     * return true if the queue was empty before;
+     * FetchTaskGroup takes all the queued executors, return the oldest one
+     * or nullptr if the queue is empty
+     */
+    bool LinkTask(Executor* e);
+    Executor* FetchTaskGroup(Executor** newest_executor);
 
    private:
     void LinkOne(Executor* e, bool* linked_as_leader);
@@ -91,19 +144,149 @@ class BinlogWriter {
   };
 
  private:
+  struct TaskGroup {
+    Executor* first;
+    Executor* last;
+    std::string rep;
+  };
+
+  // a group formed by a lane leader, waiting to be written
+  struct PendingGroup {
+    std::string* rep;
+    bool done;
+    rocksutil::Status status;
+    explicit PendingGroup(std::string* r) : rep(r), done(false) {}
+  };
+
+  /*
+   * FormThread takes the queued executors of its lane and forms a task
+   * group, then hands it over to FlushThread, which writes the group and
+   * completes the executors. So group N+1 is formed while group N is
+   * being written, and the lanes form their groups in parallel
+   */
+  class FormThread : public pink::Thread {
+   public:
+    FormThread(BinlogWriter* writer, int lane)
+      : writer_(writer), lane_(lane) {}
+    virtual ~FormThread() {}
+   private:
+    BinlogWriter* writer_;
+    int lane_;
+    virtual void* ThreadMain() override;
+  };
+
+  class FlushThread : public pink::Thread {
+   public:
+    explicit FlushThread(BinlogWriter* writer) : writer_(writer) {}
+    virtual ~FlushThread() {}
+   private:
+    BinlogWriter* writer_;
+    virtual void* ThreadMain() override;
+  };
+
+  /*
+   * PreallocThread creates & fallocates binlog_<n+1> under a temporary
+   * name before the roll, and syncs & closes the files rolled over, so
+   * RollFile is only a rename and a pointer swap in the common case
+   */
+  class PreallocThread : public pink::Thread {
+   public:
+    explicit PreallocThread(BinlogWriter* writer) : writer_(writer) {}
+    virtual ~PreallocThread() {}
+   private:
+    BinlogWriter* writer_;
+    virtual void* ThreadMain() override;
+  };
+
+  /*
+   * SyncThread syncs the groups kSyncInterval left unsynced once
+   * sync_interval_ms is due, even if no more group is written to
+   * trigger it. The fdatasync runs without sync_mutex_, the groups are
+   * still written meanwhile
+   */
+  class SyncThread : public pink::Thread {
+   public:
+    explicit SyncThread(BinlogWriter* writer) : writer_(writer) {}
+    virtual ~SyncThread() {}
+   private:
+    BinlogWriter* writer_;
+    virtual void* ThreadMain() override;
+  };
+
   void RollFile();
-  rocksutil::Status Append(Task* task);
-  static void EncodeBinlogContent(std::string* result,
-      uint8_t op, const std::string& key, const std::string& value,
-      int32_t server_id, int32_t exec_time, int32_t filenum);
+  // called with sync_mutex_ held
+  void WaitForSync(rocksutil::log::Writer* writer);
+  void RetireWriter(rocksutil::log::Writer* writer);
+  int Lane(const rocksutil::Slice& key);
+  rocksutil::Status Append(int lane, const Task* tasks, size_t count);
+  rocksutil::Status AppendByWriterThread(int lane, const Task* tasks,
+      size_t count);
+  // queue e to the FormThread of lane, return the future of its status
+  std::future<rocksutil::Status> LinkToFormThread(int lane, Executor* e,
+      std::promise<rocksutil::Status>* promise);
+  // check the conflicts & encode the tasks in [first, last] into rep
+  void FormTaskGroup(Executor* first, Executor* last, std::string* rep);
+  /*
+   * write the group of a lane leader. The groups handed over by the
+   * leaders of other lanes meanwhile are written together by one of them
+   */
+  rocksutil::Status CommitTaskGroup(std::string* rep);
+  // roll the binlog file if needed, write one group & wake up the readers
+  rocksutil::Status WriteTaskGroup(std::string* rep);
+  // fdatasync the current file according to BinlogOptions::sync_mode
+  rocksutil::Status MaybeSync(uint64_t bytes);
+  rocksutil::Status Sync();
+  // append the encoded task to result
+  static void EncodeBinlogContent(std::string* result, const Task* task);
 
   rocksutil::log::Writer* writer_;
+  // may be nullptr, the index is only a hint for the readers
+  BinlogIndexWriter* index_;
   std::string log_path_;
   uint64_t number_;
   rocksutil::Env* env_;
   BinlogManager* manager_;
-  WriteThread write_thread_;
+  // one per partition, see BinlogOptions::partitions
+  std::vector<std::unique_ptr<WriteThread>> lanes_;
+  // the lane leaders, at most one per lane
   std::atomic<int> count_;
+  // serialize writing the groups with SyncThread, protect the members below
+  rocksutil::port::Mutex sync_mutex_;
+  uint64_t unsynced_bytes_;
+  uint64_t last_sync_us_;
+  /*
+   * signaled when the first unsynced group is left to SyncThread, and
+   * when the sync of SyncThread is done
+   */
+  rocksutil::port::CondVar sync_cv_;
+  // synced by SyncThread now, not to be deleted until it is done
+  rocksutil::log::Writer* syncing_writer_;
+  SyncThread* sync_thread_;
+
+  // protect committing_ & pending_groups_
+  rocksutil::port::Mutex commit_mutex_;
+  rocksutil::port::CondVar commit_cv_;
+  // a lane leader is writing the pending groups
+  bool committing_;
+  std::vector<PendingGroup*> pending_groups_;
+
+  // protect flushing_group_, wait for tasks or the handover of groups
+  rocksutil::port::Mutex pipeline_mutex_;
+  rocksutil::port::CondVar pipeline_cv_;
+  TaskGroup* flushing_group_;
+  // one per lane, empty if not in writer thread mode
+  std::vector<FormThread*> form_threads_;
+  FlushThread* flush_thread_;
+
+  // protect the members below, shared with PreallocThread
+  rocksutil::port::Mutex prealloc_mutex_;
+  rocksutil::port::CondVar prealloc_cv_;
+  // the number to preallocate, 0 if there is nothing to do
+  uint64_t prealloc_number_;
+  rocksutil::log::Writer* prealloc_writer_;
+  BinlogIndexWriter* prealloc_index_;
+  std::vector<rocksutil::log::Writer*> retired_writers_;
+  PreallocThread* prealloc_thread_;
 };
 
 extern BinlogWriter* CreateBinlogWriter(const std::string& log_path,
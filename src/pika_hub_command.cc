@@ -55,6 +55,18 @@ void InitCmdInfoTable() {
   cmd_infos.insert(std::pair<std::string, CmdInfo*>(kCmdNameRemove,
         removeptr));
 
+  // Purgelogsto
+  CmdInfo* purgelogstoptr = new CmdInfo(kCmdNamePurgelogsto, 2,
+      kCmdFlagsWrite | kCmdFlagsAdmin);
+  cmd_infos.insert(std::pair<std::string, CmdInfo*>(kCmdNamePurgelogsto,
+        purgelogstoptr));
+
+  // Hubbinlog
+  CmdInfo* hubbinlogptr = new CmdInfo(kCmdNameHubbinlog, 3,
+      kCmdFlagsRead | kCmdFlagsAdmin);
+  cmd_infos.insert(std::pair<std::string, CmdInfo*>(kCmdNameHubbinlog,
+        hubbinlogptr));
+
   // Set
   CmdInfo* setptr = new CmdInfo(kCmdNameSet, 7,
       kCmdFlagsWrite);
@@ -68,6 +80,11 @@ void InitCmdInfoTable() {
       kCmdFlagsWrite);
   cmd_infos.insert(std::pair<std::string, CmdInfo*>(kCmdNameExpireat,
         expireatptr));
+  // Hubbatch
+  CmdInfo* hubbatchptr = new CmdInfo(kCmdNameHubbatch, 4,
+      kCmdFlagsWrite);
+  cmd_infos.insert(std::pair<std::string, CmdInfo*>(kCmdNameHubbatch,
+        hubbatchptr));
 }
 
 void DestoryCmdInfoTable() {
@@ -118,6 +135,15 @@ void InitCmdTable(std::unordered_map<std::string, Cmd*> *cmd_table) {
   cmd_table->insert(std::pair<std::string, Cmd*>(kCmdNameRemove,
         removeptr));
 
+  // Purgelogsto
+  Cmd* purgelogstoptr = new PurgelogstoCmd();
+  cmd_table->insert(std::pair<std::string, Cmd*>(kCmdNamePurgelogsto,
+        purgelogstoptr));
+
+  // Hubbinlog
+  Cmd* hubbinlogptr = new HubbinlogCmd();
+  cmd_table->insert(std::pair<std::string, Cmd*>(kCmdNameHubbinlog,
+        hubbinlogptr));
 
   // Set
   Cmd* setptr = new SetCmd();
@@ -129,6 +155,10 @@ void InitCmdTable(std::unordered_map<std::string, Cmd*> *cmd_table) {
   Cmd* expireatptr = new ExpireatCmd();
   cmd_table->insert(std::pair<std::string, Cmd*>(kCmdNameExpireat,
         expireatptr));
+  // Hubbatch
+  Cmd* hubbatchptr = new HubbatchCmd();
+  cmd_table->insert(std::pair<std::string, Cmd*>(kCmdNameHubbatch,
+        hubbatchptr));
 }
 
 Cmd* GetCmdFromTable(const std::string& opt, const CmdTable& cmd_table) {
@@ -23,11 +23,14 @@ const char kCmdNameCopy[] = "copy";
 const char kCmdNameAuth[] = "auth";
 const char kCmdNameAdd[]  = "add";
 const char kCmdNameRemove[] = "remove";
+const char kCmdNamePurgelogsto[] = "purgelogsto";
+const char kCmdNameHubbinlog[] = "hubbinlog";
 
 //  Sync command
 const char kCmdNameSet[] = "set";
 const char kCmdNameDel[] = "del";
 const char kCmdNameExpireat[] = "expireat";
+const char kCmdNameHubbatch[] = "hubbatch";
 
 typedef pink::RedisCmdArgsType PikaCmdArgsType;
 
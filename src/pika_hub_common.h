@@ -10,6 +10,8 @@
 #include <map>
 #include <atomic>
 
+#include "rocksutil/slice.h"
+
 enum SyncStatus {
   kShouldConnect = 0,
   kConnected,
@@ -17,6 +19,8 @@ enum SyncStatus {
   kShouldDelete
 };
 
+struct PikaOffsets;
+
 struct PikaStatus {
   SyncStatus sync_status = kShouldConnect;
   int32_t server_id = -1;
@@ -24,12 +28,15 @@ struct PikaStatus {
   int32_t rcv_fd_num = 0;
   int32_t send_fd = -1;
   int32_t hb_fd = -1;
-  uint64_t rcv_number = 0;
-  uint64_t rcv_offset = 0;
-  uint64_t send_number = 0;
-  uint64_t send_offset = 0;
-  void* sender = nullptr;
-  void* heartbeat = nullptr;
+  // slot in OffsetTable, updated without pika_mutex
+  PikaOffsets* offsets = nullptr;
+  // a target of SenderEngine is sending binlog to it
+  bool sending = false;
+  /*
+   * the receive offset is restored from the binlog mirror, so trysync
+   * from it instead of rolling back kMaxRecvRollbackNums files
+   */
+  bool rcv_exact = false;
   std::string ip;
   std::string passwd;
 };
@@ -44,17 +51,89 @@ struct BinlogFields {
   int32_t server_id;
   int32_t exec_time;
   int32_t filenum;
-  std::string key;
-  std::string value;
+  // point into the content of the BinlogBatch this record belongs to
+  rocksutil::Slice key;
+  rocksutil::Slice value;
 };
 
-struct CacheEntity {
-  CacheEntity(int32_t _server_id,
-      int32_t _exec_time)
-    : server_id(_server_id),
-      exec_time(_exec_time) {}
-  int32_t server_id;
-  int32_t exec_time;
+enum BinlogSyncMode {
+  kSyncNone = 0,  // leave it to the page cache
+  kSyncGroup,     // fdatasync after every group
+  kSyncInterval   // fdatasync every sync_interval_ms or sync_bytes
+};
+
+// the codec of the compressed binlog groups, stored in the group header
+enum BinlogCompression {
+  kNoCompression = 0,
+  kSnappyCompression = 1,
+  kZlibCompression = 2,
+  kZstdCompression = 3
+};
+// set in the first byte of a compressed group, see UncompressGroup
+const uint8_t kBinlogCompressedFlag = 0x80;
+// the compressed replication stream, see AppendHubzFrame
+const char kHubCompressCommand[] = "hubcompress";
+const char kHubzMagic[] = "hubz";
+
+struct BinlogOptions {
+  // memory used by BinlogRing, 0 to disable it
+  size_t ring_capacity = 64 * 1024 * 1024;
+  // write the binlog in dedicated threads instead of the group leader
+  bool writer_thread = false;
+  /*
+   * the write lanes, a key always goes to the same one. The conflicts of
+   * different lanes never meet, so their groups are formed in parallel
+   */
+  int partitions = 1;
+  /*
+   * wake the waiting readers once wakeup_bytes are appended or
+   * wakeup_delay_us has passed since the last wakeup, 0 wakes them on
+   * every group
+   */
+  uint64_t wakeup_bytes = 0;
+  uint64_t wakeup_delay_us = 1000;
+  /*
+   * the binlog files rolled over are read catchup_readahead bytes at a
+   * time and dropped from the page cache behind the readers, 0 reads
+   * them like the newest one. catchup_prefetch reads the next chunk in
+   * the background
+   */
+  size_t catchup_readahead = 2 * 1024 * 1024;
+  bool catchup_prefetch = false;
+  /*
+   * map the binlog files rolled over once and share them among the
+   * readers, instead of the catch-up mode
+   */
+  bool mmap_segments = false;
+  // compress the groups written, the readers accept any codec built in
+  BinlogCompression compression = kNoCompression;
+  BinlogSyncMode sync_mode = kSyncNone;
+  uint64_t sync_interval_ms = 1000;
+  uint64_t sync_bytes = 4 * 1024 * 1024;
+  // roll to the next binlog file once the current one exceeds file_size
+  uint64_t file_size = 100 * 1024 * 1024;
+  // the number of keys kept for conflict resolving
+  uint64_t conflict_table_capacity = 100000000;
+};
+
+struct SenderOptions {
+  // the threads sending binlog to all the pika servers
+  int threads = 2;
+  /*
+   * coalesce the records of consecutive groups before sending them to
+   * a pika server, a set or del supersedes the records of the same key
+   * before it. The window is sent once it holds coalesce_records records
+   * or coalesce_bytes bytes, or coalesce_ms after it was opened;
+   * coalesce_records = 0 disables it
+   */
+  size_t coalesce_records = 0;
+  size_t coalesce_bytes = 1024 * 1024;
+  uint64_t coalesce_ms = 10;
+  /*
+   * offered to every pika server at trysync, the ones accepting it get
+   * the binlog as compressed hubz frames, the others as plain RESP
+   */
+  BinlogCompression compression = kNoCompression;
 };
 
 const uint8_t kSetOPCode = 1;
@@ -62,7 +141,28 @@ const uint8_t kDelOPCode = 2;
 const uint8_t kExpireatOPCode = 3;
 
 const char kBinlogPrefix[] = "binlog_";
-const int32_t kMaxBinlogFileSize = 100 * 1024 * 1024;
+// binlog_<n> is preallocated as binlog_<n>.prealloc before the roll
+const char kBinlogPreallocSuffix[] = ".prealloc";
+// the sparse group index of binlog_<n>, see BinlogIndexWriter
+const char kBinlogIndexSuffix[] = ".index";
+/*
+ * binlog_snapshot_<begin>_<end> is written by BinlogCompactor, it is
+ * named <name>.tmp until complete
+ */
+const char kBinlogSnapshotPrefix[] = "binlog_snapshot_";
+const char kBinlogSnapshotTmpSuffix[] = ".tmp";
+// index a group if it begins kBinlogIndexInterval bytes after the last one
+const uint64_t kBinlogIndexInterval = 64 * 1024;
+// the physical layout of rocksutil::log, used to locate the record ends
+const uint64_t kBinlogBlockSize = 32768;
+const uint64_t kBinlogHeaderSize = 7;
+/*
+ * the sent groups which might still be in the socket buffers when the
+ * connection breaks, they are sent again after reconnecting
+ */
+const uint64_t kBinlogResendWindow = 4 * 1024 * 1024;
+// a blocking reader looks at the published tail again after this long
+const uint64_t kBinlogWaitTimeoutUs = 1000000;
 const char kBinlogMagic[] = "__PIKA_X#$SKGI";
 const char kLockName[] = "pika_hub_lock#68";
 const char kLeaseKey[] = "pika_hub_lease#68";
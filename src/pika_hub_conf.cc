@@ -8,7 +8,29 @@
 #include <algorithm>
 
 PikaHubConf::PikaHubConf(const std::string& conf_path)
-  : slash::BaseConf(conf_path), conf_path_(conf_path) {
+  : slash::BaseConf(conf_path), conf_path_(conf_path),
+    binlog_ring_capacity_(64 * 1024 * 1024),
+    binlog_partitions_(1),
+    binlog_wakeup_bytes_(0),
+    binlog_wakeup_delay_us_(1000),
+    binlog_catchup_readahead_(2 * 1024 * 1024),
+    binlog_catchup_prefetch_(false),
+    binlog_mmap_segments_(false),
+    binlog_compression_("none"),
+    binlog_sync_mode_("none"),
+    binlog_sync_interval_ms_(1000),
+    binlog_sync_bytes_(4 * 1024 * 1024),
+    binlog_file_size_(100 * 1024 * 1024),
+    binlog_purge_interval_(60),
+    binlog_retention_files_(10),
+    binlog_compact_interval_(300),
+    conflict_table_capacity_(100000000),
+    sender_threads_(2),
+    sender_coalesce_records_(0),
+    sender_coalesce_bytes_(1024 * 1024),
+    sender_coalesce_ms_(10),
+    sender_compression_("none"),
+    binlog_mirror_(false) {
 }
 
 int PikaHubConf::Load() {
@@ -42,5 +64,53 @@ int PikaHubConf::Load() {
 
   GetConfStr("pidfile", &pidfile_);
   GetConfStr("requirepass", &requirepass_);
+  GetConfInt("binlog-ring-capacity", &binlog_ring_capacity_);
+
+  str.clear();
+  GetConfStr("binlog-writer-thread", &str);
+  std::transform(str.begin(), str.end(),
+      str.begin(), ::tolower);
+  binlog_writer_thread_ = str == "yes" ? true : false;
+  GetConfInt("binlog-partitions", &binlog_partitions_);
+  GetConfInt("binlog-wakeup-bytes", &binlog_wakeup_bytes_);
+  GetConfInt("binlog-wakeup-delay-us", &binlog_wakeup_delay_us_);
+  GetConfInt("binlog-catchup-readahead", &binlog_catchup_readahead_);
+  str.clear();
+  GetConfStr("binlog-catchup-prefetch", &str);
+  std::transform(str.begin(), str.end(),
+      str.begin(), ::tolower);
+  binlog_catchup_prefetch_ = str == "yes" ? true : false;
+  str.clear();
+  GetConfStr("binlog-mmap-segments", &str);
+  std::transform(str.begin(), str.end(),
+      str.begin(), ::tolower);
+  binlog_mmap_segments_ = str == "yes" ? true : false;
+  GetConfStr("binlog-compression", &binlog_compression_);
+  std::transform(binlog_compression_.begin(), binlog_compression_.end(),
+      binlog_compression_.begin(), ::tolower);
+
+  GetConfStr("binlog-sync-mode", &binlog_sync_mode_);
+  std::transform(binlog_sync_mode_.begin(), binlog_sync_mode_.end(),
+      binlog_sync_mode_.begin(), ::tolower);
+  GetConfInt("binlog-sync-interval-ms", &binlog_sync_interval_ms_);
+  GetConfInt("binlog-sync-bytes", &binlog_sync_bytes_);
+  GetConfInt("binlog-file-size", &binlog_file_size_);
+  GetConfInt("binlog-purge-interval", &binlog_purge_interval_);
+  GetConfInt("binlog-retention-files", &binlog_retention_files_);
+  GetConfInt("binlog-compact-interval", &binlog_compact_interval_);
+  GetConfInt("conflict-table-capacity", &conflict_table_capacity_);
+  GetConfInt("sender-threads", &sender_threads_);
+  GetConfInt("sender-coalesce-records", &sender_coalesce_records_);
+  GetConfInt("sender-coalesce-bytes", &sender_coalesce_bytes_);
+  GetConfInt("sender-coalesce-ms", &sender_coalesce_ms_);
+  GetConfStr("sender-compression", &sender_compression_);
+  std::transform(sender_compression_.begin(), sender_compression_.end(),
+      sender_compression_.begin(), ::tolower);
+
+  str.clear();
+  GetConfStr("binlog-mirror", &str);
+  std::transform(str.begin(), str.end(),
+      str.begin(), ::tolower);
+  binlog_mirror_ = str == "yes" ? true : false;
   return 0;
 }
@@ -75,6 +75,98 @@ class PikaHubConf : public slash::BaseConf {
     rocksutil::ReadLock l(&rw_mutex_);
     return requirepass_;
   }
+  int binlog_ring_capacity() {
+    rocksutil::ReadLock l(&rw_mutex_);
+    return binlog_ring_capacity_;
+  }
+  bool binlog_writer_thread() {
+    rocksutil::ReadLock l(&rw_mutex_);
+    return binlog_writer_thread_;
+  }
+  int binlog_partitions() {
+    rocksutil::ReadLock l(&rw_mutex_);
+    return binlog_partitions_;
+  }
+  int binlog_wakeup_bytes() {
+    rocksutil::ReadLock l(&rw_mutex_);
+    return binlog_wakeup_bytes_;
+  }
+  int binlog_wakeup_delay_us() {
+    rocksutil::ReadLock l(&rw_mutex_);
+    return binlog_wakeup_delay_us_;
+  }
+  int binlog_catchup_readahead() {
+    rocksutil::ReadLock l(&rw_mutex_);
+    return binlog_catchup_readahead_;
+  }
+  bool binlog_catchup_prefetch() {
+    rocksutil::ReadLock l(&rw_mutex_);
+    return binlog_catchup_prefetch_;
+  }
+  bool binlog_mmap_segments() {
+    rocksutil::ReadLock l(&rw_mutex_);
+    return binlog_mmap_segments_;
+  }
+  const std::string& binlog_compression() {
+    rocksutil::ReadLock l(&rw_mutex_);
+    return binlog_compression_;
+  }
+  const std::string& binlog_sync_mode() {
+    rocksutil::ReadLock l(&rw_mutex_);
+    return binlog_sync_mode_;
+  }
+  int binlog_sync_interval_ms() {
+    rocksutil::ReadLock l(&rw_mutex_);
+    return binlog_sync_interval_ms_;
+  }
+  int binlog_sync_bytes() {
+    rocksutil::ReadLock l(&rw_mutex_);
+    return binlog_sync_bytes_;
+  }
+  int binlog_file_size() {
+    rocksutil::ReadLock l(&rw_mutex_);
+    return binlog_file_size_;
+  }
+  int binlog_purge_interval() {
+    rocksutil::ReadLock l(&rw_mutex_);
+    return binlog_purge_interval_;
+  }
+  int binlog_retention_files() {
+    rocksutil::ReadLock l(&rw_mutex_);
+    return binlog_retention_files_;
+  }
+  int binlog_compact_interval() {
+    rocksutil::ReadLock l(&rw_mutex_);
+    return binlog_compact_interval_;
+  }
+  int conflict_table_capacity() {
+    rocksutil::ReadLock l(&rw_mutex_);
+    return conflict_table_capacity_;
+  }
+  int sender_threads() {
+    rocksutil::ReadLock l(&rw_mutex_);
+    return sender_threads_;
+  }
+  int sender_coalesce_records() {
+    rocksutil::ReadLock l(&rw_mutex_);
+    return sender_coalesce_records_;
+  }
+  int sender_coalesce_bytes() {
+    rocksutil::ReadLock l(&rw_mutex_);
+    return sender_coalesce_bytes_;
+  }
+  int sender_coalesce_ms() {
+    rocksutil::ReadLock l(&rw_mutex_);
+    return sender_coalesce_ms_;
+  }
+  const std::string& sender_compression() {
+    rocksutil::ReadLock l(&rw_mutex_);
+    return sender_compression_;
+  }
+  bool binlog_mirror() {
+    rocksutil::ReadLock l(&rw_mutex_);
+    return binlog_mirror_;
+  }
 
   int Load();
 
@@ -94,6 +186,29 @@ class PikaHubConf : public slash::BaseConf {
   std::string pidfile_;
   bool binlog_offset_absolute_consistency_;
   std::string requirepass_;
+  int binlog_ring_capacity_;
+  bool binlog_writer_thread_;
+  int binlog_partitions_;
+  int binlog_wakeup_bytes_;
+  int binlog_wakeup_delay_us_;
+  int binlog_catchup_readahead_;
+  bool binlog_catchup_prefetch_;
+  bool binlog_mmap_segments_;
+  std::string binlog_compression_;
+  std::string binlog_sync_mode_;
+  int binlog_sync_interval_ms_;
+  int binlog_sync_bytes_;
+  int binlog_file_size_;
+  int binlog_purge_interval_;
+  int binlog_retention_files_;
+  int binlog_compact_interval_;
+  int conflict_table_capacity_;
+  int sender_threads_;
+  int sender_coalesce_records_;
+  int sender_coalesce_bytes_;
+  int sender_coalesce_ms_;
+  std::string sender_compression_;
+  bool binlog_mirror_;
 
   rocksutil::port::RWMutex rw_mutex_;
 };
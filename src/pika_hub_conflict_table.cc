@@ -0,0 +1,143 @@
+//  Copyright (c) 2017-present The pika_hub Authors.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#include "src/pika_hub_conflict_table.h"
+
+#include <cstdlib>
+#include <algorithm>
+
+#include "rocksutil/hash.h"
+
+static inline uint64_t PackValue(int32_t server_id, int32_t exec_time) {
+  return (static_cast<uint64_t>(static_cast<uint32_t>(server_id)) << 32) |
+    static_cast<uint32_t>(exec_time);
+}
+
+ConflictTable::ConflictTable(uint64_t capacity)
+  : size_(0) {
+  // keep the load factor under 0.5
+  shard_size_ = std::max<uint64_t>(kProbeLimit,
+      capacity * 2 / kNumShards + 1);
+  for (int i = 0; i < kNumShards; i++) {
+    /*
+     * calloc leaves the pages untouched until they are used, and
+     * an all-zero Slot is empty
+     */
+    shards_[i].slots = static_cast<Slot*>(calloc(shard_size_, sizeof(Slot)));
+    shards_[i].hand = 0;
+  }
+}
+
+ConflictTable::~ConflictTable() {
+  for (int i = 0; i < kNumShards; i++) {
+    free(shards_[i].slots);
+  }
+}
+
+uint64_t ConflictTable::Fingerprint(const rocksutil::Slice& key) {
+  uint64_t fp = (static_cast<uint64_t>(rocksutil::Hash(key.data(),
+          key.size(), 0x9747b28c)) << 32) |
+    rocksutil::Hash(key.data(), key.size(), 0xbc9f1d34);
+  fp &= ~kRefBit;
+  return fp == 0 ? 1 : fp;
+}
+
+int ConflictTable::Partition(const rocksutil::Slice& key, int partitions) {
+  if (partitions <= 1) {
+    return 0;
+  }
+  return static_cast<int>(Fingerprint(key) % kNumShards % partitions);
+}
+
+bool ConflictTable::Lookup(const rocksutil::Slice& key, int32_t* server_id,
+    int32_t* exec_time) {
+  uint64_t fp = Fingerprint(key);
+  Shard* shard = &shards_[fp % kNumShards];
+  uint64_t home = (fp / kNumShards) % shard_size_;
+  /*
+   * scan the whole window, a slot being replaced is empty for a moment,
+   * stopping there may miss the key behind it
+   */
+  for (int i = 0; i < kProbeLimit; i++) {
+    Slot* slot = &shard->slots[(home + i) % shard_size_];
+    uint64_t tag = slot->tag.load(std::memory_order_acquire);
+    if ((tag & ~kRefBit) != fp) {
+      continue;
+    }
+    uint64_t value = slot->value.load(std::memory_order_acquire);
+    // the slot may be given to another key while we read the value
+    if ((slot->tag.load(std::memory_order_acquire) & ~kRefBit) != fp) {
+      continue;
+    }
+    if ((tag & kRefBit) == 0) {
+      // fails if the slot changed, no matter
+      slot->tag.compare_exchange_strong(tag, tag | kRefBit,
+          std::memory_order_relaxed);
+    }
+    *server_id = static_cast<int32_t>(value >> 32);
+    *exec_time = static_cast<int32_t>(value & 0xffffffff);
+    return true;
+  }
+  return false;
+}
+
+void ConflictTable::Insert(const rocksutil::Slice& key, int32_t server_id,
+    int32_t exec_time) {
+  uint64_t fp = Fingerprint(key);
+  uint64_t value = PackValue(server_id, exec_time);
+  Shard* shard = &shards_[fp % kNumShards];
+  uint64_t home = (fp / kNumShards) % shard_size_;
+
+  /*
+   * the senders have not read the groups of a key just written, give it
+   * the second chance of a referenced one
+   */
+  uint64_t tag_ref = fp | kRefBit;
+  rocksutil::MutexLock l(&shard->mutex);
+  for (int i = 0; i < kProbeLimit; i++) {
+    Slot* slot = &shard->slots[(home + i) % shard_size_];
+    uint64_t tag = slot->tag.load(std::memory_order_relaxed);
+    if (tag == 0) {
+      // publish the tag after the value
+      slot->value.store(value, std::memory_order_relaxed);
+      slot->tag.store(tag_ref, std::memory_order_release);
+      size_.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+    if ((tag & ~kRefBit) == fp) {
+      slot->value.store(value, std::memory_order_release);
+      if (tag != tag_ref) {
+        slot->tag.store(tag_ref, std::memory_order_release);
+      }
+      return;
+    }
+  }
+
+  /*
+   * the window is full, CLOCK: give the referenced slots a second chance
+   * and take the first one not referenced
+   */
+  Slot* victim = nullptr;
+  for (int i = 0; i < 2 * kProbeLimit; i++) {
+    Slot* slot = &shard->slots[(home + (shard->hand + i) % kProbeLimit) %
+      shard_size_];
+    uint64_t tag = slot->tag.load(std::memory_order_relaxed);
+    if ((tag & kRefBit) == 0) {
+      victim = slot;
+      break;
+    }
+    slot->tag.fetch_and(~kRefBit, std::memory_order_relaxed);
+  }
+  shard->hand++;
+  if (victim == nullptr) {
+    // referenced again meanwhile
+    victim = &shard->slots[home];
+  }
+
+  // the readers of the evicted key see the tag changed and skip the slot
+  victim->tag.store(0, std::memory_order_relaxed);
+  victim->value.store(value, std::memory_order_release);
+  victim->tag.store(tag_ref, std::memory_order_release);
+}
@@ -0,0 +1,88 @@
+//  Copyright (c) 2017-present The pika_hub Authors.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#ifndef SRC_PIKA_HUB_CONFLICT_TABLE_H_
+#define SRC_PIKA_HUB_CONFLICT_TABLE_H_
+
+#include <atomic>
+#include <string>
+
+#include "rocksutil/slice.h"
+#include "rocksutil/mutexlock.h"
+
+/*
+ * ConflictTable remembers the (server_id, exec_time) of the last accepted
+ * write of every key, it is used to resolve the conflicts between
+ * the pika servers.
+ *
+ * Keys are identified by a 64-bit fingerprint instead of a copy, every
+ * slot takes 16 bytes: the tag (fingerprint + a clock reference bit) and
+ * the packed value. The slots are split into kNumShards open-addressing
+ * shards, a key lives in the kProbeLimit slots after its home slot; when
+ * they are all taken, one of them is evicted in CLOCK order. The slots
+ * are twice the capacity, so a window is rarely full before the table
+ * holds capacity keys, and a key is inserted referenced, so the keys just
+ * written are the last to be evicted.
+ *
+ * Lookup is lock-free and could be called by any thread, Insert is
+ * serialized per shard.
+ */
+class ConflictTable {
+ public:
+  static const int kMaxPartitions = 64;
+
+  explicit ConflictTable(uint64_t capacity);
+  ~ConflictTable();
+
+  // return false if key is not in the table
+  bool Lookup(const rocksutil::Slice& key, int32_t* server_id,
+      int32_t* exec_time);
+  void Insert(const rocksutil::Slice& key, int32_t server_id,
+      int32_t exec_time);
+
+  uint64_t size() const {
+    return size_.load(std::memory_order_relaxed);
+  }
+  size_t memory_usage() const {
+    return kNumShards * shard_size_ * sizeof(Slot);
+  }
+
+  /*
+   * the partition of key in [0, partitions), partitions is a power of 2
+   * not greater than kMaxPartitions. The keys of different partitions
+   * never share a shard
+   */
+  static int Partition(const rocksutil::Slice& key, int partitions);
+
+ private:
+  static const int kNumShards = kMaxPartitions;
+  static const int kProbeLimit = 32;
+  static const uint64_t kRefBit = 1ULL << 63;
+
+  struct Slot {
+    // 0 if empty, otherwise fingerprint | kRefBit if referenced
+    std::atomic<uint64_t> tag;
+    // server_id << 32 | exec_time
+    std::atomic<uint64_t> value;
+  };
+
+  struct Shard {
+    Slot* slots;
+    // the CLOCK hand, protected by mutex
+    uint64_t hand;
+    rocksutil::port::Mutex mutex;
+  };
+
+  uint64_t shard_size_;
+  Shard shards_[kNumShards];
+  std::atomic<uint64_t> size_;
+
+  static uint64_t Fingerprint(const rocksutil::Slice& key);
+
+  ConflictTable(const ConflictTable&);
+  ConflictTable& operator=(const ConflictTable&);
+};
+
+#endif  // SRC_PIKA_HUB_CONFLICT_TABLE_H_
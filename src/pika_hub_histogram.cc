@@ -0,0 +1,81 @@
+//  Copyright (c) 2017-present The pika_hub Authors.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#include "src/pika_hub_histogram.h"
+
+#include <string>
+
+Histogram::Histogram() {
+  Clear();
+}
+
+void Histogram::Add(uint64_t micros) {
+  int index = 0;
+  while (index < kNumBuckets - 1 &&
+      micros > (static_cast<uint64_t>(1) << index)) {
+    index++;
+  }
+  buckets_[index].fetch_add(1, std::memory_order_relaxed);
+  count_.fetch_add(1, std::memory_order_relaxed);
+  sum_.fetch_add(micros, std::memory_order_relaxed);
+  uint64_t max = max_.load(std::memory_order_relaxed);
+  while (micros > max &&
+      !max_.compare_exchange_weak(max, micros, std::memory_order_relaxed)) {
+  }
+}
+
+void Histogram::Clear() {
+  for (int i = 0; i < kNumBuckets; i++) {
+    buckets_[i].store(0, std::memory_order_relaxed);
+  }
+  count_.store(0, std::memory_order_relaxed);
+  sum_.store(0, std::memory_order_relaxed);
+  max_.store(0, std::memory_order_relaxed);
+}
+
+uint64_t Histogram::Percentile(double p) const {
+  uint64_t total = count();
+  if (total == 0) {
+    return 0;
+  }
+  uint64_t threshold = static_cast<uint64_t>(total * p / 100.0);
+  uint64_t sum = 0;
+  for (int i = 0; i < kNumBuckets; i++) {
+    sum += buckets_[i].load(std::memory_order_relaxed);
+    if (sum > threshold || sum == total) {
+      return static_cast<uint64_t>(1) << i;
+    }
+  }
+  return static_cast<uint64_t>(1) << (kNumBuckets - 1);
+}
+
+std::string Histogram::Summary() const {
+  uint64_t total = count();
+  uint64_t avg = total == 0 ? 0 :
+    sum_.load(std::memory_order_relaxed) / total;
+  return "count=" + std::to_string(total) +
+    ",avg=" + std::to_string(avg) +
+    ",p50=" + std::to_string(Percentile(50)) +
+    ",p90=" + std::to_string(Percentile(90)) +
+    ",p99=" + std::to_string(Percentile(99)) +
+    ",p999=" + std::to_string(Percentile(99.9)) +
+    ",max=" + std::to_string(max_.load(std::memory_order_relaxed));
+}
+
+std::string Histogram::Buckets() const {
+  std::string result;
+  for (int i = 0; i < kNumBuckets; i++) {
+    uint64_t n = buckets_[i].load(std::memory_order_relaxed);
+    if (n == 0) {
+      continue;
+    }
+    if (!result.empty()) {
+      result.append(",");
+    }
+    result.append("<=" + std::to_string(static_cast<uint64_t>(1) << i) +
+        ":" + std::to_string(n));
+  }
+  return result;
+}
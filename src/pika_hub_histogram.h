@@ -0,0 +1,43 @@
+//  Copyright (c) 2017-present The pika_hub Authors.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#ifndef SRC_PIKA_HUB_HISTOGRAM_H_
+#define SRC_PIKA_HUB_HISTOGRAM_H_
+
+#include <atomic>
+#include <string>
+
+/*
+ * A lock-free latency histogram, the upper bound of bucket i is 2^i us,
+ * Add could be called by multiple threads concurrently
+ */
+class Histogram {
+ public:
+  Histogram();
+
+  void Add(uint64_t micros);
+  void Clear();
+  uint64_t count() const {
+    return count_.load(std::memory_order_relaxed);
+  }
+  // the upper bound of the bucket which contains the p percentile
+  uint64_t Percentile(double p) const;
+  // count=,avg=,p50=,p90=,p99=,p999=,max=
+  std::string Summary() const;
+  // <=1:n,<=2:n,... only non-empty buckets
+  std::string Buckets() const;
+
+ private:
+  static const int kNumBuckets = 32;
+  std::atomic<uint64_t> buckets_[kNumBuckets];
+  std::atomic<uint64_t> count_;
+  std::atomic<uint64_t> sum_;
+  std::atomic<uint64_t> max_;
+
+  Histogram(const Histogram&);
+  Histogram& operator=(const Histogram&);
+};
+
+#endif  // SRC_PIKA_HUB_HISTOGRAM_H_
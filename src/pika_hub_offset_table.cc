@@ -0,0 +1,99 @@
+//  Copyright (c) 2017-present The pika_hub Authors.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#include "src/pika_hub_offset_table.h"
+
+#include <thread>
+
+void BinlogOffset::Load(uint64_t* number, uint64_t* offset) const {
+  while (true) {
+    uint64_t seq = seq_.load(std::memory_order_acquire);
+    if (seq & 1) {
+      std::this_thread::yield();
+      continue;
+    }
+    *number = number_.load(std::memory_order_relaxed);
+    *offset = offset_.load(std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (seq_.load(std::memory_order_relaxed) == seq) {
+      return;
+    }
+  }
+}
+
+uint64_t BinlogOffset::BeginWrite() {
+  while (true) {
+    uint64_t seq = seq_.load(std::memory_order_relaxed);
+    if ((seq & 1) == 0 && seq_.compare_exchange_weak(seq, seq + 1,
+          std::memory_order_acquire, std::memory_order_relaxed)) {
+      // the data stores must not be visible before the odd sequence
+      std::atomic_thread_fence(std::memory_order_release);
+      return seq + 1;
+    }
+    std::this_thread::yield();
+  }
+}
+
+void BinlogOffset::EndWrite(uint64_t seq) {
+  seq_.store(seq + 1, std::memory_order_release);
+}
+
+void BinlogOffset::Store(uint64_t number, uint64_t offset) {
+  uint64_t seq = BeginWrite();
+  number_.store(number, std::memory_order_relaxed);
+  offset_.store(offset, std::memory_order_relaxed);
+  EndWrite(seq);
+}
+
+void BinlogOffset::Advance(uint64_t number, uint64_t offset) {
+  uint64_t seq = BeginWrite();
+  if (number >= number_.load(std::memory_order_relaxed)) {
+    number_.store(number, std::memory_order_relaxed);
+    offset_.store(offset, std::memory_order_relaxed);
+  }
+  EndWrite(seq);
+}
+
+OffsetTable::OffsetTable() {
+  for (int i = 0; i < kMaxSlots; i++) {
+    slots_[i].server_id.store(kEmptySlot, std::memory_order_relaxed);
+  }
+}
+
+PikaOffsets* OffsetTable::Acquire(int32_t server_id) {
+  PikaOffsets* offsets = Find(server_id);
+  if (offsets == nullptr) {
+    for (int i = 0; i < kMaxSlots; i++) {
+      if (slots_[i].server_id.load(std::memory_order_relaxed) ==
+          kEmptySlot) {
+        offsets = &slots_[i].offsets;
+        offsets->rcv.Store(0, 0);
+        offsets->send.Store(0, 0);
+        offsets->hwm.Store(0, 0);
+        slots_[i].server_id.store(server_id, std::memory_order_release);
+        return offsets;
+      }
+    }
+    return nullptr;
+  }
+  offsets->rcv.Store(0, 0);
+  offsets->send.Store(0, 0);
+  offsets->hwm.Store(0, 0);
+  return offsets;
+}
+
+PikaOffsets* OffsetTable::Find(int32_t server_id) {
+  // the slots are taken from the front and never given back
+  for (int i = 0; i < kMaxSlots; i++) {
+    int64_t id = slots_[i].server_id.load(std::memory_order_acquire);
+    if (id == server_id) {
+      return &slots_[i].offsets;
+    }
+    if (id == kEmptySlot) {
+      break;
+    }
+  }
+  return nullptr;
+}
@@ -0,0 +1,84 @@
+//  Copyright (c) 2017-present The pika_hub Authors.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#ifndef SRC_PIKA_HUB_OFFSET_TABLE_H_
+#define SRC_PIKA_HUB_OFFSET_TABLE_H_
+
+#include <atomic>
+#include <cstdint>
+
+/*
+ * BinlogOffset is a (number, offset) pair protected by a seqlock, it is
+ * read and written without any mutex. Writers serialize on the sequence
+ * itself, readers retry if a write overlaps.
+ */
+class BinlogOffset {
+ public:
+  BinlogOffset() : seq_(0), number_(0), offset_(0) {}
+
+  void Load(uint64_t* number, uint64_t* offset) const;
+  void Store(uint64_t number, uint64_t offset);
+  // store only if number is not less than the current number
+  void Advance(uint64_t number, uint64_t offset);
+
+ private:
+  // odd while a write is in progress
+  std::atomic<uint64_t> seq_;
+  std::atomic<uint64_t> number_;
+  std::atomic<uint64_t> offset_;
+
+  uint64_t BeginWrite();
+  void EndWrite(uint64_t seq);
+
+  BinlogOffset(const BinlogOffset&);
+  BinlogOffset& operator=(const BinlogOffset&);
+};
+
+// the offsets of a pika server
+struct PikaOffsets {
+  // the position in the binlog of the pika server received by hub
+  BinlogOffset rcv;
+  // the position in the binlog of hub sent to the pika server
+  BinlogOffset send;
+  /*
+   * the high-water mark, the last position of the pika server appended
+   * to the binlog of hub. Unlike rcv it is never restored from floyd,
+   * the records at or below it are replays and dropped
+   */
+  BinlogOffset hwm;
+};
+
+/*
+ * OffsetTable preallocates the PikaOffsets of the pika servers, so the
+ * inner connections update the receive offsets without pika_mutex_.
+ * Find is lock-free; Acquire is called with pika_mutex_ held when a pika
+ * server is configured. A slot stays with its server_id once acquired,
+ * acquiring it again resets the offsets.
+ */
+class OffsetTable {
+ public:
+  static const int kMaxSlots = 1024;
+
+  OffsetTable();
+
+  // return nullptr if the table is full
+  PikaOffsets* Acquire(int32_t server_id);
+  // return nullptr if server_id is not found
+  PikaOffsets* Find(int32_t server_id);
+
+ private:
+  static const int64_t kEmptySlot = -1;
+
+  struct Slot {
+    std::atomic<int64_t> server_id;
+    PikaOffsets offsets;
+  };
+  Slot slots_[kMaxSlots];
+
+  OffsetTable(const OffsetTable&);
+  OffsetTable& operator=(const OffsetTable&);
+};
+
+#endif  // SRC_PIKA_HUB_OFFSET_TABLE_H_
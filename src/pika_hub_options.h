@@ -21,6 +21,29 @@ struct PikaHubOptions {
   size_t log_file_time_to_roll = 0;
   rocksutil::InfoLogLevel info_log_level = rocksutil::INFO_LEVEL;
   std::string pika_servers = "127.0.0.1:9221";
+  size_t binlog_ring_capacity = 64 * 1024 * 1024;
+  bool binlog_writer_thread = false;
+  int binlog_partitions = 1;
+  int binlog_wakeup_bytes = 0;
+  int binlog_wakeup_delay_us = 1000;
+  int binlog_catchup_readahead = 2 * 1024 * 1024;
+  bool binlog_catchup_prefetch = false;
+  bool binlog_mmap_segments = false;
+  std::string binlog_compression = "none";
+  std::string binlog_sync_mode = "none";
+  int binlog_sync_interval_ms = 1000;
+  int binlog_sync_bytes = 4 * 1024 * 1024;
+  int binlog_file_size = 100 * 1024 * 1024;
+  int binlog_purge_interval = 60;
+  int binlog_retention_files = 10;
+  int binlog_compact_interval = 300;
+  int64_t conflict_table_capacity = 100000000;
+  int sender_threads = 2;
+  int sender_coalesce_records = 0;
+  int sender_coalesce_bytes = 1024 * 1024;
+  int sender_coalesce_ms = 10;
+  std::string sender_compression = "none";
+  bool binlog_mirror = false;
 
   rocksutil::Env* env = rocksutil::Env::Default();
 };
@@ -37,6 +60,29 @@ struct Options : public PikaHubOptions, public floyd::Options {
     Header(log, " log_file_time_to_roll = %u", log_file_time_to_roll);
     Header(log, " info_log_level = %d", info_log_level);
     Header(log, " pika_servers = %s", pika_servers.c_str());
+    Header(log, " binlog_ring_capacity = %lu", binlog_ring_capacity);
+    Header(log, " binlog_writer_thread = %d", binlog_writer_thread);
+    Header(log, " binlog_partitions = %d", binlog_partitions);
+    Header(log, " binlog_wakeup_bytes = %d", binlog_wakeup_bytes);
+    Header(log, " binlog_wakeup_delay_us = %d", binlog_wakeup_delay_us);
+    Header(log, " binlog_catchup_readahead = %d", binlog_catchup_readahead);
+    Header(log, " binlog_catchup_prefetch = %d", binlog_catchup_prefetch);
+    Header(log, " binlog_mmap_segments = %d", binlog_mmap_segments);
+    Header(log, " binlog_compression = %s", binlog_compression.c_str());
+    Header(log, " binlog_sync_mode = %s", binlog_sync_mode.c_str());
+    Header(log, " binlog_sync_interval_ms = %d", binlog_sync_interval_ms);
+    Header(log, " binlog_sync_bytes = %d", binlog_sync_bytes);
+    Header(log, " binlog_file_size = %d", binlog_file_size);
+    Header(log, " binlog_purge_interval = %d", binlog_purge_interval);
+    Header(log, " binlog_retention_files = %d", binlog_retention_files);
+    Header(log, " binlog_compact_interval = %d", binlog_compact_interval);
+    Header(log, " conflict_table_capacity = %ld", conflict_table_capacity);
+    Header(log, " sender_threads = %d", sender_threads);
+    Header(log, " sender_coalesce_records = %d", sender_coalesce_records);
+    Header(log, " sender_coalesce_bytes = %d", sender_coalesce_bytes);
+    Header(log, " sender_coalesce_ms = %d", sender_coalesce_ms);
+    Header(log, " sender_compression = %s", sender_compression.c_str());
+    Header(log, " binlog_mirror = %d", binlog_mirror);
     Header(log, "");
     Header(log, "Floyd:");
     Header(log, " members = %s", str_members.c_str());
@@ -0,0 +1,113 @@
+//  Copyright (c) 2017-present The pika_hub Authors.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#include "src/pika_hub_resp.h"
+
+#include <cstring>
+#include <string>
+
+// the array header and the command name of every op
+static const char kSetHeader[] = "*3\r\n$3\r\nset\r\n";
+static const char kDelHeader[] = "*2\r\n$3\r\ndel\r\n";
+static const char kExpireatHeader[] = "*3\r\n$8\r\nexpireat\r\n";
+
+static const char kDigitPairs[] =
+  "00010203040506070809"
+  "10111213141516171819"
+  "20212223242526272829"
+  "30313233343536373839"
+  "40414243444546474849"
+  "50515253545556575859"
+  "60616263646566676869"
+  "70717273747576777879"
+  "80818283848586878889"
+  "90919293949596979899";
+
+static inline size_t Digits(uint64_t v) {
+  size_t n = 1;
+  while (v >= 100) {
+    v /= 100;
+    n += 2;
+  }
+  return v >= 10 ? n + 1 : n;
+}
+
+// write the n digits of v backwards from dst + n, two at a time
+static inline void WriteDigits(uint64_t v, size_t n, char* dst) {
+  char* p = dst + n;
+  while (v >= 100) {
+    const char* pair = kDigitPairs + (v % 100) * 2;
+    v /= 100;
+    *--p = pair[1];
+    *--p = pair[0];
+  }
+  if (v >= 10) {
+    const char* pair = kDigitPairs + v * 2;
+    *--p = pair[1];
+    *--p = pair[0];
+  } else {
+    *--p = static_cast<char>('0' + v);
+  }
+}
+
+// the size of $<len>\r\n<data>\r\n
+static inline size_t BulkSize(size_t len) {
+  return 1 + Digits(len) + 2 + len + 2;
+}
+
+static inline char* WriteBulk(const rocksutil::Slice& s, char* p) {
+  size_t n = Digits(s.size());
+  *p++ = '$';
+  WriteDigits(s.size(), n, p);
+  p += n;
+  *p++ = '\r';
+  *p++ = '\n';
+  if (s.size() > 0) {
+    memcpy(p, s.data(), s.size());
+    p += s.size();
+  }
+  *p++ = '\r';
+  *p++ = '\n';
+  return p;
+}
+
+bool AppendRespCommand(uint8_t op, const rocksutil::Slice& key,
+    const rocksutil::Slice& value, std::string* dst) {
+  const char* header;
+  size_t header_size;
+  bool with_value = true;
+  switch (op) {
+    case kSetOPCode:
+      header = kSetHeader;
+      header_size = sizeof(kSetHeader) - 1;
+      break;
+    case kDelOPCode:
+      header = kDelHeader;
+      header_size = sizeof(kDelHeader) - 1;
+      with_value = false;
+      break;
+    case kExpireatOPCode:
+      header = kExpireatHeader;
+      header_size = sizeof(kExpireatHeader) - 1;
+      break;
+    default:
+      return false;
+  }
+
+  size_t size = header_size + BulkSize(key.size());
+  if (with_value) {
+    size += BulkSize(value.size());
+  }
+  size_t old_size = dst->size();
+  dst->resize(old_size + size);
+  char* p = &(*dst)[old_size];
+  memcpy(p, header, header_size);
+  p += header_size;
+  p = WriteBulk(key, p);
+  if (with_value) {
+    WriteBulk(value, p);
+  }
+  return true;
+}
@@ -0,0 +1,23 @@
+//  Copyright (c) 2017-present The pika_hub Authors.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#ifndef SRC_PIKA_HUB_RESP_H_
+#define SRC_PIKA_HUB_RESP_H_
+
+#include <string>
+
+#include "src/pika_hub_common.h"
+#include "rocksutil/slice.h"
+
+/*
+ * Append the RESP frame of a binlog record (set key value, del key or
+ * expireat key value) to dst, the same bytes as building the argv and
+ * calling pink::SerializeRedisCommand, but with one resize of dst and
+ * no temporary strings. Return false if op is unknown
+ */
+extern bool AppendRespCommand(uint8_t op, const rocksutil::Slice& key,
+    const rocksutil::Slice& value, std::string* dst);
+
+#endif  // SRC_PIKA_HUB_RESP_H_
@@ -0,0 +1,1016 @@
+//  Copyright (c) 2017-present The pika_hub Authors.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#include "src/pika_hub_sender_engine.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "src/pika_hub_resp.h"
+#include "src/pika_hub_binlog_compression.h"
+#include "pink/include/redis_cli.h"
+
+static const int kSenderMaxEvents = 256;
+// bytes queued for a connection before waiting for it to drain
+static const size_t kSenderQueueBytes = 1024 * 1024;
+// the commands compressed together at most
+static const size_t kSenderFrameBytes = 64 * 1024;
+static const uint64_t kConnectTimeoutUs = 1500 * 1000;
+static const uint64_t kReconnectIntervalUs = 2 * 1000 * 1000;
+static const uint64_t kReadRetryIntervalUs = 500 * 1000;
+static const uint64_t kHeartbeatIntervalUs = 3 * 1000 * 1000;
+static const uint64_t kHeartbeatTimeoutUs = 3 * 1000 * 1000;
+// wake up at least this often, in milliseconds
+static const int kSenderMaxWaitMs = 1000;
+
+static const char kPing[] = "*1\r\n$4\r\nPING\r\n";
+
+static uint64_t NowMicros() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+SenderEngine::SenderEngine(std::shared_ptr<rocksutil::Logger> info_log,
+    const SenderOptions& options,
+    PikaServers* pika_servers,
+    rocksutil::port::Mutex* pika_mutex,
+    RecoverOffsetMap* recover_offset,
+    BinlogManager* manager)
+  : info_log_(info_log),
+    compression_(options.compression),
+    pika_servers_(pika_servers),
+    pika_mutex_(pika_mutex) {
+  int thread_num = options.threads < 1 ? 1 : options.threads;
+  for (int i = 0; i < thread_num; i++) {
+    workers_.push_back(new SenderWorker(i, info_log, options, pika_servers,
+          pika_mutex, recover_offset, manager));
+  }
+}
+
+SenderEngine::~SenderEngine() {
+  for (auto worker : workers_) {
+    delete worker;
+  }
+  /*
+   * the workers are stopped, nobody else updates the sending status
+   */
+  rocksutil::MutexLock l(pika_mutex_);
+  for (auto iter = pika_servers_->begin(); iter != pika_servers_->end();
+      iter++) {
+    iter->second.sending = false;
+    iter->second.send_fd = -1;
+    iter->second.hb_fd = -1;
+  }
+}
+
+int SenderEngine::Start() {
+  for (auto worker : workers_) {
+    int ret = worker->Init();
+    if (ret != 0) {
+      return ret;
+    }
+    ret = worker->StartThread();
+    if (ret != 0) {
+      return ret;
+    }
+  }
+  return 0;
+}
+
+void SenderEngine::AddTarget(int32_t server_id, const std::string& ip,
+    int32_t port, PikaOffsets* offsets, BinlogReader* reader,
+    BinlogCompression compression) {
+  workers_[static_cast<uint32_t>(server_id) % workers_.size()]->AddTarget(
+      server_id, ip, port, offsets, reader, compression);
+}
+
+void SenderEngine::RemoveTarget(int32_t server_id) {
+  workers_[static_cast<uint32_t>(server_id) % workers_.size()]->RemoveTarget(
+      server_id);
+}
+
+SenderWorker::SenderWorker(int id,
+    std::shared_ptr<rocksutil::Logger> info_log,
+    const SenderOptions& options,
+    PikaServers* pika_servers,
+    rocksutil::port::Mutex* pika_mutex,
+    RecoverOffsetMap* recover_offset,
+    BinlogManager* manager)
+  : id_(id),
+    info_log_(info_log),
+    options_(options),
+    pika_servers_(pika_servers),
+    pika_mutex_(pika_mutex),
+    recover_offset_(recover_offset),
+    manager_(manager),
+    epfd_(-1),
+    notify_fd_(-1) {}
+
+SenderWorker::~SenderWorker() {
+  set_should_stop();
+  if (notify_fd_ >= 0) {
+    Notify();
+    StopThread();
+    manager_->RemoveWaiter(&waiter_);
+  }
+
+  for (auto iter = targets_.begin(); iter != targets_.end(); iter++) {
+    CloseConn(&iter->second->data);
+    CloseConn(&iter->second->hb);
+    delete iter->second->reader;
+    delete iter->second->snapshot;
+    delete iter->second;
+  }
+  targets_.clear();
+  for (auto& command : commands_) {
+    delete command.reader;
+  }
+  commands_.clear();
+
+  if (notify_fd_ >= 0) {
+    close(notify_fd_);
+  }
+  if (epfd_ >= 0) {
+    close(epfd_);
+  }
+}
+
+int SenderWorker::Init() {
+  epfd_ = epoll_create1(EPOLL_CLOEXEC);
+  if (epfd_ < 0) {
+    return -1;
+  }
+  notify_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (notify_fd_ < 0) {
+    return -1;
+  }
+  struct epoll_event ev;
+  memset(&ev, 0, sizeof(ev));
+  ev.events = EPOLLIN;
+  // data.ptr == nullptr is the notify fd
+  ev.data.ptr = nullptr;
+  if (epoll_ctl(epfd_, EPOLL_CTL_ADD, notify_fd_, &ev) != 0) {
+    return -1;
+  }
+  waiter_.fd = notify_fd_;
+  manager_->AddWaiter(&waiter_);
+  return 0;
+}
+
+void SenderWorker::Notify() {
+  uint64_t one = 1;
+  ssize_t ret = write(notify_fd_, &one, sizeof(one));
+  (void)ret;
+}
+
+void SenderWorker::AddTarget(int32_t server_id, const std::string& ip,
+    int32_t port, PikaOffsets* offsets, BinlogReader* reader,
+    BinlogCompression compression) {
+  reader->set_nonblocking(true);
+  Command command;
+  command.type = kAddTarget;
+  command.server_id = server_id;
+  command.ip = ip;
+  command.port = port;
+  command.offsets = offsets;
+  command.reader = reader;
+  command.compression = compression;
+  {
+  rocksutil::MutexLock l(&mutex_);
+  commands_.push_back(command);
+  }
+  Notify();
+}
+
+void SenderWorker::RemoveTarget(int32_t server_id) {
+  Command command;
+  command.type = kRemoveTarget;
+  command.server_id = server_id;
+  command.port = 0;
+  command.offsets = nullptr;
+  command.reader = nullptr;
+  command.compression = kNoCompression;
+  {
+  rocksutil::MutexLock l(&mutex_);
+  commands_.push_back(command);
+  }
+  Notify();
+}
+
+void SenderWorker::HandleCommands() {
+  std::vector<Command> commands;
+  {
+  rocksutil::MutexLock l(&mutex_);
+  commands.swap(commands_);
+  }
+
+  uint64_t now = NowMicros();
+  for (auto& command : commands) {
+    auto iter = targets_.find(command.server_id);
+    if (iter != targets_.end()) {
+      DropTarget(iter->second);
+    }
+    if (command.type == kRemoveTarget) {
+      continue;
+    }
+
+    Target* target = new Target();
+    target->server_id = command.server_id;
+    target->ip = command.ip;
+    target->port = command.port;
+    target->offsets = command.offsets;
+    target->reader = command.reader;
+    target->compression = command.compression;
+    uint64_t number, offset;
+    target->offsets->send.Load(&number, &offset);
+    OpenSnapshot(target, number, offset);
+    target->data.deadline = now;
+    target->hb.deadline = now;
+    // reserve the queue limit and some slack for the last group
+    target->wbuf.reserve(kSenderQueueBytes * 2);
+    targets_[target->server_id] = target;
+    rocksutil::Info(info_log_, "SenderWorker[%d] add BinlogSender[%d] "
+        "for %s:%d", id_, target->server_id, target->ip.c_str(),
+        target->port);
+  }
+}
+
+void SenderWorker::DropTarget(Target* target) {
+  rocksutil::Info(info_log_, "SenderWorker[%d] drop BinlogSender[%d] "
+      "for %s:%d", id_, target->server_id, target->ip.c_str(), target->port);
+  CloseConn(&target->data);
+  CloseConn(&target->hb);
+  targets_.erase(target->server_id);
+  delete target->reader;
+  delete target->snapshot;
+  delete target;
+}
+
+void SenderWorker::SweepTargets() {
+  std::vector<Target*> closed;
+  for (auto iter = targets_.begin(); iter != targets_.end(); iter++) {
+    if (iter->second->state != kTargetAlive) {
+      closed.push_back(iter->second);
+    }
+  }
+  if (closed.empty()) {
+    return;
+  }
+
+  {
+  rocksutil::MutexLock l(pika_mutex_);
+  for (auto target : closed) {
+    auto iter = pika_servers_->find(target->server_id);
+    if (iter == pika_servers_->end()) {
+      continue;
+    }
+    iter->second.sending = false;
+    iter->second.hb_fd = -1;
+    if (target->state == kTargetReconnect) {
+      iter->second.send_fd = -1;
+      iter->second.sync_status = kShouldConnect;
+    } else {
+      iter->second.send_fd = -2;
+    }
+  }
+  }
+  for (auto target : closed) {
+    DropTarget(target);
+  }
+}
+
+void SenderWorker::UpdateFd(int32_t server_id, bool heartbeat, int fd) {
+  rocksutil::MutexLock l(pika_mutex_);
+  auto iter = pika_servers_->find(server_id);
+  if (iter != pika_servers_->end()) {
+    if (heartbeat) {
+      iter->second.hb_fd = fd;
+    } else {
+      iter->second.send_fd = fd;
+    }
+  }
+}
+
+void SenderWorker::Connect(Conn* conn, uint64_t now) {
+  Target* target = conn->target;
+  const char* name = conn == &target->data ? "BinlogSender" : "Heartbeat";
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(target->port + kPikaPortInterval);
+  if (inet_pton(AF_INET, target->ip.c_str(), &addr.sin_addr) != 1) {
+    rocksutil::Error(info_log_, "%s[%d] invalid ip %s", name,
+        target->server_id, target->ip.c_str());
+    conn->deadline = now + kReconnectIntervalUs;
+    return;
+  }
+
+  int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    rocksutil::Error(info_log_, "%s[%d] create socket failed: %s", name,
+        target->server_id, strerror(errno));
+    conn->deadline = now + kReconnectIntervalUs;
+    return;
+  }
+  int one = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  conn->fd = fd;
+  conn->connecting = true;
+  conn->events = 0;
+  conn->rbuf.clear();
+
+  int ret = connect(fd, reinterpret_cast<struct sockaddr*>(&addr),
+      sizeof(addr));
+  if (ret == 0) {
+    OnConnected(conn, now);
+    return;
+  }
+  if (errno != EINPROGRESS) {
+    if (conn == &target->data) {
+      OnDataError(target, now, strerror(errno));
+    } else {
+      OnHeartbeatError(target, now, strerror(errno), false);
+    }
+    return;
+  }
+  conn->deadline = now + kConnectTimeoutUs;
+  UpdateEvents(conn);
+}
+
+void SenderWorker::OnConnectEvent(Conn* conn, uint64_t now) {
+  int err = 0;
+  socklen_t len = sizeof(err);
+  if (getsockopt(conn->fd, SOL_SOCKET, SO_ERROR, &err, &len) != 0) {
+    err = errno;
+  }
+  if (err == 0) {
+    OnConnected(conn, now);
+    return;
+  }
+  Target* target = conn->target;
+  if (conn == &target->data) {
+    OnDataError(target, now, strerror(err));
+  } else {
+    OnHeartbeatError(target, now, strerror(err), false);
+  }
+}
+
+void SenderWorker::OnConnected(Conn* conn, uint64_t now) {
+  Target* target = conn->target;
+  conn->connecting = false;
+  if (conn == &target->data) {
+    rocksutil::Info(info_log_, "BinlogSender[%d] Connect to %s:%d success",
+        target->server_id, target->ip.c_str(), target->port);
+    if (target->compression != kNoCompression) {
+      // the queue is empty, the frames follow the switch
+      pink::RedisCmdArgsType argv;
+      argv.push_back(kHubCompressCommand);
+      argv.push_back(BinlogCompressionName(target->compression));
+      pink::SerializeRedisCommand(argv, &target->wbuf);
+      target->queued_bytes += target->wbuf.size();
+    }
+  } else {
+    rocksutil::Info(info_log_, "Heartbeat[%d] Connect to %s:%d success",
+        target->server_id, target->ip.c_str(), target->port);
+    target->hb_sent = 0;
+    target->hb_next = now;
+  }
+  UpdateFd(target->server_id, conn == &target->hb, conn->fd);
+  UpdateEvents(conn);
+}
+
+void SenderWorker::CloseConn(Conn* conn) {
+  if (conn->fd >= 0) {
+    // closing the fd removes it from epoll
+    close(conn->fd);
+  }
+  conn->fd = -1;
+  conn->connecting = false;
+  conn->events = 0;
+  conn->rbuf.clear();
+}
+
+void SenderWorker::OnDataError(Target* target, uint64_t now,
+    const char* reason) {
+  if (target->data.connecting || target->data.fd < 0) {
+    rocksutil::Error(info_log_, "BinlogSender[%d] Connect to %s:%d failed: %s",
+        target->server_id, target->ip.c_str(), target->port, reason);
+  } else {
+    rocksutil::Error(info_log_, "BinlogSender[%d] Send to %s:%d failed: %s",
+        target->server_id, target->ip.c_str(), target->port, reason);
+    /*
+     * what is queued but not sent is lost with the connection,
+     * resend after the send offset
+     */
+    target->wbuf.clear();
+    target->wpos = 0;
+    target->queued_bytes = target->sent_bytes = 0;
+    target->marks.clear();
+    target->zbuf.clear();
+    target->zmarks.clear();
+    target->window.Clear();
+    target->reset_reader = true;
+    target->resume_reader = true;
+    UpdateFd(target->server_id, false, -1);
+  }
+  CloseConn(&target->data);
+  target->data.deadline = now + kReconnectIntervalUs;
+}
+
+void SenderWorker::OnHeartbeatError(Target* target, uint64_t now,
+    const char* reason, bool fatal) {
+  rocksutil::Warn(info_log_, "Heartbeat[%d] with %s:%d failed: %s",
+      target->server_id, target->ip.c_str(), target->port, reason);
+  CloseConn(&target->hb);
+  if (fatal || (++target->hb_errors) > kMaxRetryTimes) {
+    rocksutil::Error(info_log_, "Heartbeat[%d] with %s:%d disconnect",
+        target->server_id, target->ip.c_str(), target->port);
+    target->state = kTargetReconnect;
+    return;
+  }
+  target->hb.deadline = now + kReconnectIntervalUs;
+}
+
+bool SenderWorker::ResetReader(Target* target) {
+  // the snapshot is streamed from the beginning again if still needed
+  CloseSnapshot(target);
+  uint64_t number, offset;
+  if (target->window.has_mark) {
+    number = target->window.mark.number;
+    offset = target->window.mark.offset;
+  } else if (!target->zmarks.empty()) {
+    number = target->zmarks.back().number;
+    offset = target->zmarks.back().offset;
+  } else if (!target->marks.empty()) {
+    number = target->marks.back().number;
+    offset = target->marks.back().offset;
+  } else {
+    target->offsets->send.Load(&number, &offset);
+  }
+  if (OpenSnapshot(target, number, offset)) {
+    target->reset_reader = false;
+    return true;
+  }
+
+  /*
+   * after a read error with the queue kept, the groups before the
+   * position are queued already, read on exactly from there
+   */
+  delete target->reader;
+  target->reader = target->resume_reader ?
+      manager_->AddResumeReader(number, offset) :
+      manager_->AddReader(number, offset);
+  if (target->reader == nullptr) {
+    rocksutil::Error(info_log_, "BinlogSender[%d] AddReader error when RETRY",
+        target->server_id);
+    return false;
+  }
+  target->reader->set_nonblocking(true);
+  rocksutil::Info(info_log_, "BinlogSender[%d] reset reader after "
+      "binlog %lu:%lu", target->server_id, number, offset);
+  target->reset_reader = false;
+  return true;
+}
+
+bool SenderWorker::OpenSnapshot(Target* target, uint64_t number,
+    uint64_t offset) {
+  if (target->snapshot_failed) {
+    return false;
+  }
+  SnapshotReader* snapshot = manager_->OpenSnapshot(number, offset);
+  if (snapshot == nullptr) {
+    return false;
+  }
+  BinlogReader* reader = manager_->AddReader(snapshot->end_number(), 0);
+  if (reader == nullptr) {
+    delete snapshot;
+    return false;
+  }
+  reader->set_nonblocking(true);
+  delete target->reader;
+  target->reader = reader;
+  target->snapshot = snapshot;
+  rocksutil::Info(info_log_, "BinlogSender[%d] stream the snapshot instead "
+      "of the binlog from %lu:%lu to %lu", target->server_id, number, offset,
+      snapshot->end_number());
+  return true;
+}
+
+void SenderWorker::CloseSnapshot(Target* target) {
+  delete target->snapshot;
+  target->snapshot = nullptr;
+}
+
+bool SenderWorker::FillFromSnapshot(Target* target, uint64_t now) {
+  BinlogBatchPtr batch;
+  if (target->snapshot->Read(&batch)) {
+    AppendGroup(target, batch, false);
+    return true;
+  }
+  if (!target->snapshot->status().ok()) {
+    rocksutil::Warn(info_log_, "BinlogSender[%d] read snapshot error: %s, "
+        "replay the binlog instead", target->server_id,
+        target->snapshot->status().ToString().c_str());
+    target->snapshot_failed = true;
+    target->read_retry = now + kReadRetryIntervalUs;
+    target->reset_reader = true;
+  } else {
+    rocksutil::Info(info_log_, "BinlogSender[%d] snapshot is queued, "
+        "continue with binlog_%lu", target->server_id,
+        target->snapshot->end_number());
+    AppendMark(target, target->snapshot->end_number(), 0);
+    target->resume_reader = false;
+  }
+  CloseSnapshot(target);
+  return false;
+}
+
+void SenderWorker::FillQueue(Target* target, uint64_t now) {
+  target->more = false;
+  if (now < target->read_retry) {
+    return;
+  }
+  if (target->reset_reader && !ResetReader(target)) {
+    target->state = kTargetFailed;
+    return;
+  }
+
+  BinlogBatchPtr batch;
+  while (target->wbuf.size() - target->wpos + target->zbuf.size() <
+      kSenderQueueBytes) {
+    if (target->snapshot != nullptr) {
+      if (!FillFromSnapshot(target, now) && target->reset_reader) {
+        return;
+      }
+      continue;
+    }
+    rocksutil::Status s = target->reader->ReadRecord(&batch);
+    if (s.IsIncomplete()) {
+      // caught up with the writer
+      return;
+    }
+    if (!s.ok()) {
+      if ((++target->read_errors) > kMaxRetryTimes) {
+        rocksutil::Error(info_log_, "BinlogSender[%d] ReadRecord, EXIT, "
+            "error: %s", target->server_id, s.ToString().c_str());
+        target->state = kTargetFailed;
+        return;
+      }
+      rocksutil::Warn(info_log_, "BinlogSender[%d] ReadRecord once[%d], "
+          "RETRY, error: %s", target->server_id, target->read_errors,
+          s.ToString().c_str());
+      target->read_retry = now + kReadRetryIntervalUs;
+      target->reset_reader = true;
+      return;
+    }
+    target->read_errors = 0;
+    target->resume_reader = false;
+    AppendGroup(target, batch, true);
+    batch.reset();
+  }
+  target->more = true;
+}
+
+void SenderWorker::AppendGroup(Target* target, const BinlogBatchPtr& batch,
+    bool has_mark) {
+  bool coalesce = options_.coalesce_records > 0;
+  const std::vector<BinlogFields>& records = batch->records();
+  for (auto iter = records.begin(); iter != records.end(); iter++) {
+    if (target->server_id == iter->server_id) {
+      continue;
+    }
+
+    /*
+     *  the structure of recover_offset_ map is stable, and the value is
+     *  defined as atomic, so we modify the value without locking here
+     */
+    if ((*recover_offset_)[iter->server_id][target->server_id] <
+        iter->filenum) {
+      (*recover_offset_)[iter->server_id][target->server_id] = iter->filenum;
+    }
+
+    int32_t _server_id, _exec_time;
+    if (manager_->conflict_table()->Lookup(iter->key,
+          &_server_id, &_exec_time)) {
+      if (iter->exec_time < _exec_time) {
+        continue;
+      }
+    } else {
+      rocksutil::Error(info_log_, "BinlogSender[%d] check conflict table: "
+          "%s is not in table", target->server_id,
+          iter->key.ToString().c_str());
+      continue;
+    }
+
+    if (coalesce) {
+      AddToWindow(target, &(*iter));
+    } else {
+      AppendRecord(target, *iter);
+    }
+  }
+
+  uint64_t number, offset;
+  if (!coalesce) {
+    /*
+     * a group with nothing to send gets a mark too, it is committed
+     * with the bytes queued before it
+     */
+    if (has_mark) {
+      target->reader->GetOffset(&number, &offset);
+      AppendMark(target, number, offset);
+    }
+    return;
+  }
+
+  Window* window = &target->window;
+  if (window->empty()) {
+    window->deadline = NowMicros() + options_.coalesce_ms * 1000;
+  }
+  // the records of the batch are kept until the window is sent
+  window->batches.push_back(batch);
+  if (has_mark) {
+    target->reader->GetOffset(&number, &offset);
+    AppendMark(target, number, offset);
+  }
+  if (window->live >= options_.coalesce_records ||
+      window->bytes >= options_.coalesce_bytes) {
+    FlushWindow(target);
+  }
+}
+
+void SenderWorker::AppendMark(Target* target, uint64_t number,
+    uint64_t offset) {
+  SendMark mark;
+  mark.number = number;
+  mark.offset = offset;
+  if (options_.coalesce_records == 0) {
+    PushMark(target, mark);
+    return;
+  }
+  // the mark is queued with the window
+  Window* window = &target->window;
+  if (window->empty()) {
+    window->deadline = NowMicros() + options_.coalesce_ms * 1000;
+  }
+  window->mark = mark;
+  window->has_mark = true;
+}
+
+void SenderWorker::PushMark(Target* target, SendMark mark) {
+  if (target->compression != kNoCompression) {
+    target->zmarks.push_back(mark);
+    return;
+  }
+  mark.bytes = target->queued_bytes;
+  target->marks.push_back(mark);
+}
+
+void SenderWorker::SealFrame(Target* target) {
+  if (!target->zbuf.empty()) {
+    size_t size = target->wbuf.size();
+    AppendHubzFrame(target->compression, target->zbuf, &target->wbuf);
+    target->queued_bytes += target->wbuf.size() - size;
+    target->zbuf.clear();
+  }
+  for (auto& mark : target->zmarks) {
+    mark.bytes = target->queued_bytes;
+    target->marks.push_back(mark);
+  }
+  target->zmarks.clear();
+}
+
+void SenderWorker::AddToWindow(Target* target, const BinlogFields* fields) {
+  Window* window = &target->window;
+  std::vector<size_t>& indexes = window->keys[fields->key.ToString()];
+  if (fields->op == kSetOPCode || fields->op == kDelOPCode) {
+    // the value after a set or del does not depend on the records before
+    for (auto index : indexes) {
+      WindowRecord& record = window->records[index];
+      record.dropped = true;
+      window->live--;
+      window->bytes -= record.fields->key.size() +
+        record.fields->value.size();
+    }
+    indexes.clear();
+  }
+  WindowRecord record;
+  record.fields = fields;
+  record.dropped = false;
+  indexes.push_back(window->records.size());
+  window->records.push_back(record);
+  window->live++;
+  window->bytes += fields->key.size() + fields->value.size();
+}
+
+void SenderWorker::FlushWindow(Target* target) {
+  Window* window = &target->window;
+  for (auto iter = window->records.begin(); iter != window->records.end();
+      iter++) {
+    if (iter->dropped) {
+      continue;
+    }
+    // a newer write may have won the key since the record was added
+    int32_t _server_id, _exec_time;
+    if (manager_->conflict_table()->Lookup(iter->fields->key,
+          &_server_id, &_exec_time) &&
+        iter->fields->exec_time < _exec_time) {
+      continue;
+    }
+    AppendRecord(target, *iter->fields);
+  }
+  if (window->has_mark) {
+    PushMark(target, window->mark);
+  }
+  window->Clear();
+}
+
+void SenderWorker::AppendRecord(Target* target, const BinlogFields& fields) {
+  if (target->compression != kNoCompression) {
+    AppendRespCommand(fields.op, fields.key, fields.value, &target->zbuf);
+    if (target->zbuf.size() >= kSenderFrameBytes) {
+      SealFrame(target);
+    }
+    return;
+  }
+  size_t size = target->wbuf.size();
+  if (AppendRespCommand(fields.op, fields.key, fields.value, &target->wbuf)) {
+    target->queued_bytes += target->wbuf.size() - size;
+  }
+}
+
+void SenderWorker::Flush(Target* target, uint64_t now) {
+  Conn* conn = &target->data;
+  if (target->compression != kNoCompression) {
+    // the commands staged so far are not worth waiting for more
+    SealFrame(target);
+  }
+  while (target->wpos < target->wbuf.size()) {
+    ssize_t n = send(conn->fd, target->wbuf.data() + target->wpos,
+        target->wbuf.size() - target->wpos, MSG_NOSIGNAL);
+    if (n > 0) {
+      target->wpos += n;
+      target->sent_bytes += n;
+      continue;
+    }
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      break;
+    }
+    OnDataError(target, now, strerror(errno));
+    return;
+  }
+  if (target->wpos == target->wbuf.size()) {
+    target->wbuf.clear();
+    target->wpos = 0;
+  } else if (target->wpos >= kSenderQueueBytes) {
+    target->wbuf.erase(0, target->wpos);
+    target->wpos = 0;
+  }
+
+  bool sent = false;
+  SendMark last;
+  while (!target->marks.empty() &&
+      target->marks.front().bytes <= target->sent_bytes) {
+    last = target->marks.front();
+    target->marks.pop_front();
+    sent = true;
+  }
+  if (sent) {
+    target->offsets->send.Store(last.number, last.offset);
+  }
+  UpdateEvents(conn);
+}
+
+void SenderWorker::DrainData(Target* target, uint64_t now) {
+  // pika does not reply the binlog, read only to find the peer closed
+  char buf[4096];
+  while (true) {
+    ssize_t n = read(target->data.fd, buf, sizeof(buf));
+    if (n > 0) {
+      continue;
+    }
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      return;
+    }
+    OnDataError(target, now, n == 0 ? "closed by peer" : strerror(errno));
+    return;
+  }
+}
+
+void SenderWorker::DrainHeartbeat(Target* target, uint64_t now) {
+  Conn* conn = &target->hb;
+  char buf[512];
+  while (true) {
+    ssize_t n = read(conn->fd, buf, sizeof(buf));
+    if (n > 0) {
+      conn->rbuf.append(buf, n);
+      continue;
+    }
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      break;
+    }
+    OnHeartbeatError(target, now, n == 0 ? "closed by peer" : strerror(errno),
+        true);
+    return;
+  }
+
+  // every line is the reply of a PING
+  size_t pos;
+  while ((pos = conn->rbuf.find("\r\n")) != std::string::npos) {
+    conn->rbuf.erase(0, pos + 2);
+    target->hb_errors = 0;
+    target->hb_sent = 0;
+    target->hb_next = now + kHeartbeatIntervalUs;
+  }
+}
+
+void SenderWorker::CheckTimers(Target* target, uint64_t now) {
+  Conn* data = &target->data;
+  if (data->fd < 0 && now >= data->deadline) {
+    Connect(data, now);
+  } else if (data->connecting && now >= data->deadline) {
+    OnDataError(target, now, "connect timeout");
+  }
+
+  Conn* hb = &target->hb;
+  if (hb->fd < 0) {
+    if (now >= hb->deadline) {
+      Connect(hb, now);
+    }
+  } else if (hb->connecting) {
+    if (now >= hb->deadline) {
+      OnHeartbeatError(target, now, "connect timeout", false);
+    }
+  } else if (target->hb_sent != 0) {
+    if (now >= target->hb_sent + kHeartbeatTimeoutUs) {
+      OnHeartbeatError(target, now, "timeout", true);
+    }
+  } else if (now >= target->hb_next) {
+    ssize_t n = send(hb->fd, kPing, sizeof(kPing) - 1, MSG_NOSIGNAL);
+    if (n != static_cast<ssize_t>(sizeof(kPing) - 1)) {
+      OnHeartbeatError(target, now, n < 0 ? strerror(errno) : "short write",
+          true);
+    } else {
+      target->hb_sent = now;
+    }
+  }
+}
+
+void SenderWorker::UpdateEvents(Conn* conn) {
+  if (conn->fd < 0) {
+    return;
+  }
+  uint32_t events = EPOLLIN;
+  if (conn->connecting) {
+    events = EPOLLOUT;
+  } else if (conn == &conn->target->data &&
+      conn->target->wpos < conn->target->wbuf.size()) {
+    events |= EPOLLOUT;
+  }
+  if (events == conn->events) {
+    return;
+  }
+
+  struct epoll_event ev;
+  memset(&ev, 0, sizeof(ev));
+  ev.events = events;
+  ev.data.ptr = conn;
+  int op = conn->events == 0 ? EPOLL_CTL_ADD : EPOLL_CTL_MOD;
+  if (epoll_ctl(epfd_, op, conn->fd, &ev) == 0) {
+    conn->events = events;
+  } else {
+    rocksutil::Error(info_log_, "SenderWorker[%d] epoll_ctl fd %d failed: %s",
+        id_, conn->fd, strerror(errno));
+  }
+}
+
+int SenderWorker::NextTimeout(uint64_t now) {
+  uint64_t next = now + kSenderMaxWaitMs * 1000;
+  const BinlogOptions& binlog_options = manager_->options();
+  if (binlog_options.wakeup_bytes > 0) {
+    // the groups appended without a wakeup are picked up by polling
+    next = std::min(next, now + binlog_options.wakeup_delay_us);
+  }
+  for (auto iter = targets_.begin(); iter != targets_.end(); iter++) {
+    Target* target = iter->second;
+    if (target->state != kTargetAlive) {
+      return 0;
+    }
+    Conn* data = &target->data;
+    if (data->fd >= 0 && !data->connecting &&
+        target->wpos == target->wbuf.size() &&
+        (target->more || target->reset_reader)) {
+      next = std::min(next, std::max(now, target->read_retry));
+    }
+    if (data->fd < 0 || data->connecting) {
+      next = std::min(next, data->deadline);
+    } else if (!target->window.empty()) {
+      next = std::min(next, target->window.deadline);
+    }
+    Conn* hb = &target->hb;
+    if (hb->fd < 0 || hb->connecting) {
+      next = std::min(next, hb->deadline);
+    } else if (target->hb_sent != 0) {
+      next = std::min(next, target->hb_sent + kHeartbeatTimeoutUs);
+    } else {
+      next = std::min(next, target->hb_next);
+    }
+  }
+  if (next <= now) {
+    return 0;
+  }
+  // round up, do not wake up just before the deadline
+  return static_cast<int>((next - now + 999) / 1000);
+}
+
+void* SenderWorker::ThreadMain() {
+  struct epoll_event events[kSenderMaxEvents];
+  while (!should_stop()) {
+    HandleCommands();
+
+    uint64_t now = NowMicros();
+    /*
+     * arm the waiter before polling the readers, the groups appended
+     * after that wake us up
+     */
+    waiter_.armed.store(true);
+    for (auto iter = targets_.begin(); iter != targets_.end(); iter++) {
+      Target* target = iter->second;
+      CheckTimers(target, now);
+      if (target->state == kTargetAlive &&
+          target->data.fd >= 0 && !target->data.connecting) {
+        FillQueue(target, now);
+        if (!target->window.empty() && now >= target->window.deadline) {
+          FlushWindow(target);
+        }
+        if (target->state == kTargetAlive && target->data.fd >= 0) {
+          Flush(target, now);
+        }
+      }
+    }
+    SweepTargets();
+
+    int nfds = epoll_wait(epfd_, events, kSenderMaxEvents, NextTimeout(now));
+    if (nfds < 0) {
+      if (errno != EINTR) {
+        rocksutil::Error(info_log_, "SenderWorker[%d] epoll_wait failed: %s",
+            id_, strerror(errno));
+      }
+      continue;
+    }
+    now = NowMicros();
+    for (int i = 0; i < nfds; i++) {
+      if (events[i].data.ptr == nullptr) {
+        uint64_t value;
+        ssize_t ret = read(notify_fd_, &value, sizeof(value));
+        (void)ret;
+        continue;
+      }
+      Conn* conn = static_cast<Conn*>(events[i].data.ptr);
+      Target* target = conn->target;
+      // closed by an earlier event of this round
+      if (target->state != kTargetAlive || conn->fd < 0) {
+        continue;
+      }
+      if (conn->connecting) {
+        OnConnectEvent(conn, now);
+        continue;
+      }
+      if (conn == &target->data) {
+        if (events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP)) {
+          DrainData(target, now);
+        }
+        if (conn->fd >= 0 && (events[i].events & EPOLLOUT)) {
+          Flush(target, now);
+        }
+      } else {
+        DrainHeartbeat(target, now);
+      }
+    }
+    SweepTargets();
+  }
+  return nullptr;
+}
@@ -0,0 +1,322 @@
+//  Copyright (c) 2017-present The pika_hub Authors.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#ifndef SRC_PIKA_HUB_SENDER_ENGINE_H_
+#define SRC_PIKA_HUB_SENDER_ENGINE_H_
+
+#include <deque>
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "src/pika_hub_common.h"
+#include "src/pika_hub_binlog_reader.h"
+#include "src/pika_hub_binlog_manager.h"
+#include "src/pika_hub_offset_table.h"
+#include "pink/include/pink_thread.h"
+#include "rocksutil/mutexlock.h"
+#include "rocksutil/auto_roll_logger.h"
+
+class SenderWorker;
+
+/*
+ * SenderEngine ships the binlog to all the pika servers and keeps them
+ * alive with heartbeats, a pika server is a target driven by one of a
+ * fixed number of SenderWorkers, so the thread count does not grow with
+ * the cluster.
+ *
+ * A target is assigned to workers_[server_id % workers_.size()], the
+ * commands of the same server_id are handled in order.
+ * AddTarget and RemoveTarget only queue the command and never block,
+ * they could be called with pika_mutex held.
+ */
+class SenderEngine {
+ public:
+  SenderEngine(std::shared_ptr<rocksutil::Logger> info_log,
+    const SenderOptions& options,
+    PikaServers* pika_servers,
+    rocksutil::port::Mutex* pika_mutex,
+    RecoverOffsetMap* recover_offset,
+    BinlogManager* manager);
+  ~SenderEngine();
+
+  int Start();
+
+  /*
+   * start sending with reader, which is owned by the engine since then,
+   * the send offset is kept in offsets. compression is the codec the
+   * pika server accepted at trysync
+   */
+  void AddTarget(int32_t server_id, const std::string& ip, int32_t port,
+      PikaOffsets* offsets, BinlogReader* reader,
+      BinlogCompression compression);
+  void RemoveTarget(int32_t server_id);
+
+  // the codec offered to the pika servers at trysync
+  BinlogCompression compression() const {
+    return compression_;
+  }
+
+ private:
+  std::shared_ptr<rocksutil::Logger> info_log_;
+  const BinlogCompression compression_;
+  PikaServers* pika_servers_;
+  // protect pika_servers_
+  rocksutil::port::Mutex* pika_mutex_;
+  std::vector<SenderWorker*> workers_;
+
+  SenderEngine(const SenderEngine&);
+  SenderEngine& operator=(const SenderEngine&);
+};
+
+/*
+ * SenderWorker is an epoll loop over its targets. Every target has
+ * two nonblocking connections to the inner port of the pika server:
+ * the binlog connection with an output queue, and the heartbeat
+ * connection. Connecting, reconnecting and heartbeats are driven by
+ * the deadlines of the targets.
+ *
+ * The binlog is read by nonblocking BinlogReaders, the worker arms its
+ * BinlogWaiter before polling them and sleeps until the writer appends
+ * a new group or a deadline is due. A target far behind streams the
+ * snapshot first if it is smaller than the binlog to replay, the send
+ * offset stays put until the whole snapshot is sent.
+ *
+ * With coalescing enabled the records pass a per target window first,
+ * a set or del drops the records of the same key before it in the
+ * window. The records are checked against the conflict table again
+ * when the window is sent, a record superseded meanwhile is not sent.
+ *
+ * A target accepting compression gets "hubcompress <codec>" first on
+ * every binlog connection, then the commands are staged in zbuf and
+ * queued as hubz frames. The marks of the staged commands wait in
+ * zmarks, the send offset passes them only when the whole frame is sent.
+ */
+class SenderWorker : public pink::Thread {
+ public:
+  SenderWorker(int id,
+    std::shared_ptr<rocksutil::Logger> info_log,
+    const SenderOptions& options,
+    PikaServers* pika_servers,
+    rocksutil::port::Mutex* pika_mutex,
+    RecoverOffsetMap* recover_offset,
+    BinlogManager* manager);
+  virtual ~SenderWorker();
+
+  // create epoll & eventfd, return 0 on success
+  int Init();
+
+  void AddTarget(int32_t server_id, const std::string& ip, int32_t port,
+      PikaOffsets* offsets, BinlogReader* reader,
+      BinlogCompression compression);
+  void RemoveTarget(int32_t server_id);
+
+ private:
+  struct Target;
+
+  struct Conn {
+    explicit Conn(Target* t)
+      : target(t), fd(-1), connecting(false), events(0), deadline(0) {}
+    Target* target;
+    int fd;
+    bool connecting;
+    // the events registered in epoll
+    uint32_t events;
+    // connect timeout or the next retry time if fd < 0, in microseconds
+    uint64_t deadline;
+    std::string rbuf;
+  };
+
+  // the position of the binlog after some bytes in the output queue
+  struct SendMark {
+    uint64_t bytes;
+    uint64_t number;
+    uint64_t offset;
+  };
+
+  struct WindowRecord {
+    // points into one of Window::batches
+    const BinlogFields* fields;
+    bool dropped;
+  };
+
+  struct Window {
+    Window() : live(0), bytes(0), deadline(0), has_mark(false) {}
+    bool empty() const {
+      return records.empty() && !has_mark;
+    }
+    void Clear() {
+      batches.clear();
+      records.clear();
+      keys.clear();
+      live = bytes = 0;
+      has_mark = false;
+    }
+    std::vector<BinlogBatchPtr> batches;
+    std::vector<WindowRecord> records;
+    // the indexes in records of the records not dropped of every key
+    std::unordered_map<std::string, std::vector<size_t> > keys;
+    size_t live;
+    size_t bytes;
+    uint64_t deadline;
+    // the position after the last group in the window
+    bool has_mark;
+    SendMark mark;
+  };
+
+  enum TargetState {
+    kTargetAlive = 0,
+    // the pika server is lost, trysync it again
+    kTargetReconnect,
+    // the binlog could not be read any more
+    kTargetFailed
+  };
+
+  struct Target {
+    Target() : state(kTargetAlive), server_id(-1), port(0), offsets(nullptr),
+      reader(nullptr), snapshot(nullptr), snapshot_failed(false),
+      compression(kNoCompression),
+      data(this), hb(this), wpos(0), queued_bytes(0), sent_bytes(0),
+      more(false), reset_reader(false), resume_reader(true), read_errors(0),
+      read_retry(0),
+      hb_errors(0), hb_sent(0), hb_next(0) {}
+    TargetState state;
+    int32_t server_id;
+    std::string ip;
+    int32_t port;
+    PikaOffsets* offsets;
+    BinlogReader* reader;
+    // read before reader if not nullptr, reader starts at its end
+    SnapshotReader* snapshot;
+    // do not stream the snapshot again after a read error
+    bool snapshot_failed;
+    BinlogCompression compression;
+    Conn data;
+    Conn hb;
+
+    // output queue of the binlog connection, wbuf[wpos, ) is not sent
+    std::string wbuf;
+    size_t wpos;
+    uint64_t queued_bytes;
+    uint64_t sent_bytes;
+    /*
+     * the groups queued but not sent yet, the send offset moves to
+     * a mark once the bytes before it are sent
+     */
+    std::deque<SendMark> marks;
+    // the commands and marks not framed yet if compression is on
+    std::string zbuf;
+    std::vector<SendMark> zmarks;
+    // the reader stopped at the queue limit instead of the writer
+    bool more;
+    Window window;
+
+    bool reset_reader;
+    /*
+     * the reader is reset with AddResumeReader, the queue was lost with
+     * the connection or no group is queued since the reader resumed
+     */
+    bool resume_reader;
+    int32_t read_errors;
+    // do not read before read_retry after a read error
+    uint64_t read_retry;
+
+    int32_t hb_errors;
+    // when the outstanding PING was sent, 0 if none
+    uint64_t hb_sent;
+    uint64_t hb_next;
+  };
+
+  enum CommandType {
+    kAddTarget = 0,
+    kRemoveTarget
+  };
+
+  struct Command {
+    CommandType type;
+    int32_t server_id;
+    std::string ip;
+    int32_t port;
+    PikaOffsets* offsets;
+    BinlogReader* reader;
+    BinlogCompression compression;
+  };
+
+  int id_;
+  std::shared_ptr<rocksutil::Logger> info_log_;
+  const SenderOptions options_;
+  PikaServers* pika_servers_;
+  // protect pika_servers_
+  rocksutil::port::Mutex* pika_mutex_;
+  RecoverOffsetMap* recover_offset_;
+  BinlogManager* manager_;
+
+  int epfd_;
+  // wake up the loop for commands and new binlog
+  int notify_fd_;
+  BinlogWaiter waiter_;
+
+  // protect commands_
+  rocksutil::port::Mutex mutex_;
+  std::vector<Command> commands_;
+
+  // only used by the worker thread
+  std::map<int32_t, Target*> targets_;
+
+  void Notify();
+  void HandleCommands();
+  void DropTarget(Target* target);
+  // drop the targets closed in this round and update pika_servers
+  void SweepTargets();
+
+  void Connect(Conn* conn, uint64_t now);
+  void CloseConn(Conn* conn);
+  void OnConnected(Conn* conn, uint64_t now);
+  void OnConnectEvent(Conn* conn, uint64_t now);
+  void OnDataError(Target* target, uint64_t now, const char* reason);
+  void OnHeartbeatError(Target* target, uint64_t now, const char* reason,
+      bool fatal);
+
+  // continue after the last group queued or sent
+  bool ResetReader(Target* target);
+  /*
+   * stream the snapshot before the binlog if it is cheaper than replaying
+   * the binlog after (number, offset), return false if not
+   */
+  bool OpenSnapshot(Target* target, uint64_t number, uint64_t offset);
+  void CloseSnapshot(Target* target);
+  // fill the output queue from the snapshot and the reader
+  void FillQueue(Target* target, uint64_t now);
+  // return false if the snapshot is done or failed
+  bool FillFromSnapshot(Target* target, uint64_t now);
+  // the groups of the snapshot have no position in the binlog, no mark
+  void AppendGroup(Target* target, const BinlogBatchPtr& batch,
+      bool has_mark);
+  void AppendMark(Target* target, uint64_t number, uint64_t offset);
+  // queue mark after the records appended, or stage it with them
+  void PushMark(Target* target, SendMark mark);
+  // queue zbuf as a hubz frame and the marks staged after it
+  void SealFrame(Target* target);
+  void AddToWindow(Target* target, const BinlogFields* fields);
+  // serialize the window into the output queue
+  void FlushWindow(Target* target);
+  void AppendRecord(Target* target, const BinlogFields& fields);
+  void Flush(Target* target, uint64_t now);
+  void DrainData(Target* target, uint64_t now);
+  void DrainHeartbeat(Target* target, uint64_t now);
+  void CheckTimers(Target* target, uint64_t now);
+  void UpdateFd(int32_t server_id, bool heartbeat, int fd);
+  void UpdateEvents(Conn* conn);
+  int NextTimeout(uint64_t now);
+
+  virtual void* ThreadMain() override;
+
+  SenderWorker(const SenderWorker&);
+  SenderWorker& operator=(const SenderWorker&);
+};
+
+#endif  // SRC_PIKA_HUB_SENDER_ENGINE_H_
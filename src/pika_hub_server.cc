@@ -11,7 +11,7 @@
 
 #include "src/pika_hub_server.h"
 #include "src/pika_hub_command.h"
-#include "src/pika_hub_heartbeat.h"
+#include "src/pika_hub_binlog_compression.h"
 #include "slash/include/slash_string.h"
 
 Options SanitizeOptions(const Options& options) {
@@ -34,6 +34,91 @@ floyd::Options BuildFloydOptions(const Options& options) {
   return result;
 }
 
+BinlogOptions BuildBinlogOptions(const Options& options) {
+  BinlogOptions result;
+  result.ring_capacity = options.binlog_ring_capacity;
+  result.writer_thread = options.binlog_writer_thread;
+  // a lane owns whole shards of the conflict table
+  if (options.binlog_partitions > 1 &&
+      options.binlog_partitions <= ConflictTable::kMaxPartitions &&
+      (options.binlog_partitions & (options.binlog_partitions - 1)) == 0) {
+    result.partitions = options.binlog_partitions;
+  }
+  if (options.binlog_wakeup_bytes > 0) {
+    result.wakeup_bytes = options.binlog_wakeup_bytes;
+  }
+  if (options.binlog_wakeup_delay_us > 0) {
+    result.wakeup_delay_us = options.binlog_wakeup_delay_us;
+  }
+  result.catchup_readahead = options.binlog_catchup_readahead > 0 ?
+    options.binlog_catchup_readahead : 0;
+  result.catchup_prefetch = options.binlog_catchup_prefetch;
+  result.mmap_segments = options.binlog_mmap_segments;
+  if (!ParseBinlogCompression(options.binlog_compression,
+        &result.compression)) {
+    rocksutil::Warn(options.info_log, "unknown binlog compression %s, "
+        "write the binlog uncompressed", options.binlog_compression.c_str());
+    result.compression = kNoCompression;
+  } else if (!BinlogCompressionSupported(result.compression)) {
+    rocksutil::Warn(options.info_log, "binlog compression %s is not built "
+        "in, write the binlog uncompressed",
+        options.binlog_compression.c_str());
+    result.compression = kNoCompression;
+  }
+  if (options.binlog_sync_mode == "group") {
+    result.sync_mode = kSyncGroup;
+  } else if (options.binlog_sync_mode == "interval") {
+    result.sync_mode = kSyncInterval;
+  } else {
+    if (options.binlog_sync_mode != "none") {
+      rocksutil::Warn(options.info_log, "unknown binlog sync mode %s, "
+          "the binlog is not synced", options.binlog_sync_mode.c_str());
+    }
+    result.sync_mode = kSyncNone;
+  }
+  if (options.binlog_sync_interval_ms > 0) {
+    result.sync_interval_ms = options.binlog_sync_interval_ms;
+  }
+  if (options.binlog_sync_bytes > 0) {
+    result.sync_bytes = options.binlog_sync_bytes;
+  }
+  if (options.binlog_file_size > 0) {
+    result.file_size = options.binlog_file_size;
+  }
+  if (options.conflict_table_capacity > 0) {
+    result.conflict_table_capacity = options.conflict_table_capacity;
+  }
+  return result;
+}
+
+SenderOptions BuildSenderOptions(const Options& options) {
+  SenderOptions result;
+  if (options.sender_threads > 0) {
+    result.threads = options.sender_threads;
+  }
+  if (options.sender_coalesce_records > 0) {
+    result.coalesce_records = options.sender_coalesce_records;
+  }
+  if (options.sender_coalesce_bytes > 0) {
+    result.coalesce_bytes = options.sender_coalesce_bytes;
+  }
+  if (options.sender_coalesce_ms > 0) {
+    result.coalesce_ms = options.sender_coalesce_ms;
+  }
+  if (!ParseBinlogCompression(options.sender_compression,
+        &result.compression)) {
+    rocksutil::Warn(options.info_log, "unknown sender compression %s, "
+        "send the binlog uncompressed", options.sender_compression.c_str());
+    result.compression = kNoCompression;
+  } else if (!BinlogCompressionSupported(result.compression)) {
+    rocksutil::Warn(options.info_log, "sender compression %s is not built "
+        "in, send the binlog uncompressed",
+        options.sender_compression.c_str());
+    result.compression = kNoCompression;
+  }
+  return result;
+}
+
 bool PikaHubServerHandler::AccessHandle(std::string& ip) const {
   pika_hub_server_->PlusAccConnections();
   return true;
@@ -89,7 +174,11 @@ PikaHubServer::PikaHubServer(const Options& options)
     should_exit_(false),
     is_primary_(false),
     primary_lease_deadline_(0),
-    trysync_thread_(nullptr) {
+    trysync_thread_(nullptr),
+    sender_engine_(nullptr),
+    binlog_purger_(nullptr),
+    binlog_compactor_(nullptr),
+    binlog_mirror_(nullptr) {
   conn_factory_ = new PikaHubClientConnFactory();
   server_handler_ = new PikaHubServerHandler(this);
   server_thread_ = pink::NewHolyThread(options_.port, conn_factory_, 1000,
@@ -100,7 +189,7 @@ PikaHubServer::PikaHubServer(const Options& options)
                   inner_conn_factory_, 1000, 1000, inner_server_handler_);
   inner_server_thread_->set_keepalive_timeout(0);
   binlog_manager_ = CreateBinlogManager(options.info_log_path, options.env,
-                      options_.info_log);
+                      options_.info_log, BuildBinlogOptions(options_));
 }
 
 PikaHubServer::~PikaHubServer() {
@@ -108,6 +197,10 @@ PikaHubServer::~PikaHubServer() {
   inner_server_thread_->StopThread();
   delete binlog_writer_;
   delete trysync_thread_;
+  delete sender_engine_;
+  delete binlog_purger_;
+  delete binlog_compactor_;
+  delete binlog_mirror_;
   delete binlog_manager_;
 
   delete inner_server_thread_;
@@ -140,6 +233,7 @@ slash::Status PikaHubServer::Start() {
   if (ret != 0) {
     return slash::Status::Corruption("Start server error");
   }
+  StartBinlogMirror();
 
   rocksutil::Info(options_.info_log, "PikaHub Started");
 
@@ -173,6 +267,10 @@ slash::Status PikaHubServer::Start() {
          (primary_ == self && primary_lease_deadline_ >= now)) {
         try_update_lease = true;
       }
+      if (!is_primary_) {
+        SetMirrorPrimary(primary_ != self && primary_lease_deadline_ >= now ?
+            primary_ : "");
+      }
     } else if (floyd_status.IsNotFound()) {
       try_update_lease = true;
     } else {
@@ -355,17 +453,24 @@ std::string PikaHubServer::DumpPikaServers() {
   rocksutil::MutexLock l(&pika_mutex_);
   std::string res;
   for (auto iter = pika_servers_.begin(); iter != pika_servers_.end(); iter++) {
+    uint64_t rcv_number, rcv_offset, send_number, send_offset;
+    uint64_t hwm_number, hwm_offset;
+    iter->second.offsets->rcv.Load(&rcv_number, &rcv_offset);
+    iter->second.offsets->send.Load(&send_number, &send_offset);
+    iter->second.offsets->hwm.Load(&hwm_number, &hwm_offset);
     res += ("server_id:" + std::to_string(iter->first) +
         ", ip:" + iter->second.ip +
         ", port:" + std::to_string(iter->second.port) +
         ", password:" + iter->second.passwd +
         ", sync_status:" + std::to_string(iter->second.sync_status) +
         ", receive_fd_num:" + std::to_string(iter->second.rcv_fd_num) +
-        ", recv_offset:" + std::to_string(iter->second.rcv_number) +
-        ":" + std::to_string(iter->second.rcv_offset) +
+        ", recv_offset:" + std::to_string(rcv_number) +
+        ":" + std::to_string(rcv_offset) +
+        ", high_water_mark:" + std::to_string(hwm_number) +
+        ":" + std::to_string(hwm_offset) +
         ", send_fd:" + std::to_string(iter->second.send_fd) +
-        ", send_offset:" + std::to_string(iter->second.send_number) +
-        ":" + std::to_string(iter->second.send_offset) +
+        ", send_offset:" + std::to_string(send_number) +
+        ":" + std::to_string(send_offset) +
         ", heartbeat_fd:" + std::to_string(iter->second.hb_fd) +
         "\r\n");
   }
@@ -387,17 +492,37 @@ std::string PikaHubServer::DumpPikaServers() {
 
 void PikaHubServer::UpdateRcvOffset(int32_t server_id,
     int32_t number, int64_t offset) {
-  rocksutil::MutexLock l(&pika_mutex_);
-  auto iter = pika_servers_.find(server_id);
-  if (iter != pika_servers_.end()) {
-    if (static_cast<uint64_t>(number) < iter->second.rcv_number) {
-      return;
-    }
-    iter->second.rcv_number = number;
-    iter->second.rcv_offset = offset;
+  // called by the inner connections for every append, without pika_mutex_
+  PikaOffsets* offsets = offset_table_.Find(server_id);
+  if (offsets != nullptr) {
+    offsets->rcv.Advance(number, offset);
+    offsets->hwm.Advance(number, offset);
   }
 }
 
+bool PikaHubServer::IsReplayed(int32_t server_id, int32_t number,
+    int64_t offset, uint64_t bytes) {
+  PikaOffsets* offsets = offset_table_.Find(server_id);
+  if (offsets == nullptr) {
+    return false;
+  }
+  uint64_t hwm_number, hwm_offset;
+  offsets->hwm.Load(&hwm_number, &hwm_offset);
+  // (0, 0) means nothing appended in this term
+  if (hwm_number == 0 && hwm_offset == 0) {
+    return false;
+  }
+  uint64_t n = static_cast<uint64_t>(number);
+  uint64_t o = static_cast<uint64_t>(offset);
+  if (n > hwm_number || (n == hwm_number && o > hwm_offset)) {
+    return false;
+  }
+  BinlogStats* stats = binlog_manager_->stats();
+  stats->replay_records++;
+  stats->replay_bytes += bytes;
+  return true;
+}
+
 void PikaHubServer::GetBinlogWriterOffset(uint64_t* number,
     uint64_t* offset) {
   rocksutil::MutexLock l(&pika_mutex_);
@@ -406,45 +531,23 @@ void PikaHubServer::GetBinlogWriterOffset(uint64_t* number,
 }
 
 void PikaHubServer::DisconnectPika(int32_t server_id, bool reconnect) {
-  BinlogSender* sender = nullptr;
-  // Heartbeat* hb = nullptr;
   /*
-   * find relevant items in pika_servers_ and set its sender & hb pointer
-   * to a temp sender & hb, because destroy a sender & hb may need some time,
-   * we do it later out of the lock scope
+   * RemoveTarget only queues the command, the target is dropped by
+   * its SenderWorker later
    */
-  {
-  rocksutil::MutexLock l(&pika_mutex_);
-  auto iter = pika_servers_.find(server_id);
-  if (iter != pika_servers_.end()) {
-    sender = static_cast<BinlogSender*>(iter->second.sender);
-    // may cause deadlock, so I comment it
-    // hb = static_cast<Heartbeat*>(iter->second.heartbeat);
-  }
-  }
-
-  /*
-   *  Destroy binlog senders & hb out of the lock scope;
-   */
-  delete sender;
-  // delete hb;
-
-  /*
-   *  modify relevant items status[sender pointer & hb & kShouldConnect]
-   */
-  {
   rocksutil::MutexLock l(&pika_mutex_);
   auto iter = pika_servers_.find(server_id);
   if (iter != pika_servers_.end()) {
+    if (iter->second.sending && sender_engine_ != nullptr) {
+      sender_engine_->RemoveTarget(server_id);
+    }
     iter->second.send_fd = -1;
-    iter->second.sender = nullptr;
+    iter->second.sending = false;
     iter->second.hb_fd = -1;
-    iter->second.heartbeat = nullptr;
     if (reconnect) {
       iter->second.sync_status = kShouldConnect;
     }
   }
-  }
 }
 
 bool PikaHubServer::Transfer(const std::string& server_id,
@@ -504,10 +607,16 @@ bool PikaHubServer::Copy(const std::string& src_server_id,
       " is already exist in pika_servers";
     return false;
   }
-  status.rcv_number = src_iter->second.rcv_number;
-  status.rcv_offset = src_iter->second.rcv_offset;
-  status.send_number = src_iter->second.send_number;
-  status.send_offset = src_iter->second.send_offset;
+  status.offsets = offset_table_.Acquire(new_id);
+  if (status.offsets == nullptr) {
+    *result = "too many pika servers";
+    return false;
+  }
+  uint64_t rcv_number, rcv_offset, send_number, send_offset;
+  src_iter->second.offsets->rcv.Load(&rcv_number, &rcv_offset);
+  src_iter->second.offsets->send.Load(&send_number, &send_offset);
+  status.offsets->rcv.Store(rcv_number, rcv_offset);
+  status.offsets->send.Store(send_number, send_offset);
 
   auto recover_iter = recover_offset_.find(new_id);
   if (recover_iter != recover_offset_.end()) {
@@ -525,9 +634,8 @@ bool PikaHubServer::Copy(const std::string& src_server_id,
       new_id_map[recover_iter->first].store(
         recover_offset_[src_id][recover_iter->first]);
     } else {
-      recover_iter->second[new_id].store(src_iter->second.rcv_number);
-      new_id_map[recover_iter->first].store(
-          src_iter->second.rcv_number);
+      recover_iter->second[new_id].store(rcv_number);
+      new_id_map[recover_iter->first].store(rcv_number);
     }
   }
 
@@ -599,6 +707,10 @@ bool PikaHubServer::CheckPikaServers() {
     status.passwd = token_in != NULL ?
       std::string(token_in, strlen(token_in)) : "";
 
+    status.offsets = offset_table_.Acquire(server_id);
+    if (status.offsets == nullptr) {
+      return false;
+    }
     pika_servers_.insert(PikaServers::
                       value_type(server_id, status));
 
@@ -639,8 +751,9 @@ bool PikaHubServer::RecoverOffset() {
           "RecoverOffset, read floyd error: %s", s.ToString().c_str());
       return false;
     }
-    DecodeOffset(value,
-        &(iter->second.rcv_number), &(iter->second.rcv_offset));
+    uint64_t rcv_number = 0, rcv_offset = 0;
+    DecodeOffset(value, &rcv_number, &rcv_offset);
+    iter->second.offsets->rcv.Store(rcv_number, rcv_offset);
   }
   rocksutil::Info(options_.info_log, "--------------------");
 
@@ -687,6 +800,143 @@ void PikaHubServer::DecodeOffset(const std::string& value,
   *rcv_offset = 0;
 }
 
+slash::Status PikaHubServer::PurgeBinlogs(uint64_t to) {
+  if (!is_primary_ || binlog_purger_ == nullptr) {
+    return slash::Status::NotSupported(
+        "This operation is only allowed for the primary node");
+  }
+  if (!binlog_purger_->PurgeTo(to)) {
+    return slash::Status::Incomplete("binlog already in purging");
+  }
+  return slash::Status::OK();
+}
+
+slash::Status PikaHubServer::ReadBinlogForMirror(uint64_t number,
+    uint64_t offset, std::string* meta, std::string* index,
+    std::string* data) {
+  if (!is_primary_) {
+    return slash::Status::NotSupported(
+        "This operation is only allowed for the primary node");
+  }
+  MirrorMeta mirror_meta;
+  uint64_t start_number;
+  {
+  rocksutil::MutexLock l(binlog_manager_->mutex());
+  start_number = binlog_manager_->start_number();
+  }
+  {
+  rocksutil::MutexLock l(&pika_mutex_);
+  for (auto iter = pika_servers_.begin(); iter != pika_servers_.end();
+      iter++) {
+    MirrorOffsets& offsets = mirror_meta.offsets[iter->first];
+    iter->second.offsets->rcv.Load(&offsets.rcv_number,
+        &offsets.rcv_offset);
+    iter->second.offsets->send.Load(&offsets.send_number,
+        &offsets.send_offset);
+    // nothing sent in this term, the sender starts from start_number
+    if (offsets.send_number == 0 && offsets.send_offset == 0) {
+      offsets.send_number = start_number;
+    }
+  }
+  }
+  // the writer position is taken after the offsets, see MirrorMeta
+  binlog_manager_->GetFileRange(&mirror_meta.first_number,
+      &mirror_meta.writer_number, &mirror_meta.writer_offset);
+
+  rocksutil::Status s = binlog_manager_->ReadFileRange(number, offset,
+      kBinlogMirrorChunk, data, index);
+  if (s.IsNotFound() || s.IsInvalidArgument()) {
+    return slash::Status::NotFound(s.ToString());
+  } else if (!s.ok()) {
+    return slash::Status::IOError(s.ToString());
+  }
+  EncodeMirrorMeta(mirror_meta, meta);
+  return slash::Status::OK();
+}
+
+std::string PikaHubServer::DumpBinlogMirror() {
+  rocksutil::MutexLock l(&mirror_mutex_);
+  if (binlog_mirror_ == nullptr) {
+    return "binlog_mirror:no\r\n";
+  }
+  return "binlog_mirror:yes\r\n" + binlog_mirror_->DumpStatus();
+}
+
+void PikaHubServer::StartBinlogMirror() {
+  if (!options_.binlog_mirror) {
+    return;
+  }
+  rocksutil::MutexLock l(&mirror_mutex_);
+  if (binlog_mirror_ != nullptr) {
+    return;
+  }
+  binlog_mirror_ = new BinlogMirror(options_.info_log, env_,
+      options_.info_log_path, g_pika_hub_conf->requirepass(),
+      binlog_manager_);
+  if (binlog_mirror_->StartThread() != 0) {
+    rocksutil::Error(options_.info_log, "start binlog mirror error");
+    delete binlog_mirror_;
+    binlog_mirror_ = nullptr;
+  }
+}
+
+bool PikaHubServer::StopBinlogMirror(MirrorOffsetMap* offsets) {
+  BinlogMirror* mirror = nullptr;
+  {
+  rocksutil::MutexLock l(&mirror_mutex_);
+  std::swap(mirror, binlog_mirror_);
+  }
+  if (mirror == nullptr) {
+    return false;
+  }
+  // the mirror thread syncs the binlog file it is writing before exiting
+  mirror->set_should_stop();
+  mirror->StopThread();
+  bool result = mirror->GetOffsets(offsets);
+  delete mirror;
+
+  // pick up the mirrored files, the writer starts after the newest one
+  rocksutil::Status s = binlog_manager_->LoadBinlogFiles();
+  if (!s.ok()) {
+    rocksutil::Error(options_.info_log, "load mirrored binlog error: %s",
+        s.ToString().c_str());
+    return false;
+  }
+  return result;
+}
+
+void PikaHubServer::SetMirrorPrimary(const std::string& primary) {
+  rocksutil::MutexLock l(&mirror_mutex_);
+  if (binlog_mirror_ != nullptr) {
+    binlog_mirror_->SetPrimary(primary);
+  }
+}
+
+void PikaHubServer::ApplyMirrorOffsets(const MirrorOffsetMap& offsets) {
+  rocksutil::MutexLock l(&pika_mutex_);
+  for (auto iter = pika_servers_.begin(); iter != pika_servers_.end();
+      iter++) {
+    auto it = offsets.find(iter->first);
+    if (it == offsets.end()) {
+      continue;
+    }
+    if (it->second.rcv_number != 0 || it->second.rcv_offset != 0) {
+      iter->second.offsets->rcv.Store(it->second.rcv_number,
+          it->second.rcv_offset);
+      // the mirrored binlog holds everything received before
+      iter->second.offsets->hwm.Store(it->second.rcv_number,
+          it->second.rcv_offset);
+      iter->second.rcv_exact = true;
+    }
+    iter->second.offsets->send.Store(it->second.send_number,
+        it->second.send_offset);
+    rocksutil::Info(options_.info_log, "Mirrored offset of %d: "
+        "recv %lu:%lu, send %lu:%lu", iter->first,
+        it->second.rcv_number, it->second.rcv_offset,
+        it->second.send_number, it->second.send_offset);
+  }
+}
+
 slash::Status PikaHubServer::BecomePrimary() {
   rocksutil::Info(options_.info_log, "BecomePrimary start");
   rocksutil::Info(options_.info_log, "BecomePrimary-1: set primary identify");
@@ -694,36 +944,104 @@ slash::Status PikaHubServer::BecomePrimary() {
   last_success_save_offset_time_ = std::chrono::system_clock::now();
 
   rocksutil::Info(options_.info_log, "BecomePrimary-2: recover offset");
+  MirrorOffsetMap mirror_offsets;
+  bool mirrored = StopBinlogMirror(&mirror_offsets);
   RecoverOffset();
   if (should_exit_) {
     return slash::Status::OK();
   }
+  if (mirrored) {
+    rocksutil::Info(options_.info_log,
+        "BecomePrimary-2: resume from the binlog mirror");
+    ApplyMirrorOffsets(mirror_offsets);
+  }
 
   rocksutil::Info(options_.info_log,
-      "BecomePrimary-3: create new binlog_writer");
+      "BecomePrimary-3: recover conflict table from binlog");
+  if (!mirrored) {
+    /*
+     * the binlog is reset when becoming secondary, only the mirror
+     * brings the writes the last primary resolved
+     */
+    rocksutil::Warn(options_.info_log,
+        "BecomePrimary-3: %s, the conflict table misses the writes of "
+        "the last primary, set binlog-mirror to yes to keep last writer "
+        "wins across failover", options_.binlog_mirror ?
+        "no binlog mirrored" : "binlog-mirror is off");
+  }
+  int64_t nums = 0;
+  rocksutil::Status recover_status =
+    binlog_manager_->RecoverConflictTable(&nums);
+  if (!recover_status.ok()) {
+    // the records decoded are still applied, go on
+    rocksutil::Error(options_.info_log,
+        "BecomePrimary-3: recover conflict table error: %s",
+        recover_status.ToString().c_str());
+  }
+
+  rocksutil::Info(options_.info_log,
+      "BecomePrimary-4: create new binlog_writer");
   binlog_writer_ = binlog_manager_->AddWriter();
 
   rocksutil::Info(options_.info_log,
-      "BecomePrimary-4: start inner_server thread");
+      "BecomePrimary-5: start inner_server thread");
   int ret = inner_server_thread_->StartThread();
   if (ret != 0) {
     rocksutil::Error(options_.info_log,
-        "BecomePrimary-4: start inner_server thread error");
+        "BecomePrimary-5: start inner_server thread error");
     return slash::Status::Corruption("Start inner_server error");
   }
 
   rocksutil::Info(options_.info_log,
-      "BecomePrimary-5: create & start trysync thread");
+      "BecomePrimary-6: create & start sender engine");
+  sender_engine_ = new SenderEngine(options_.info_log,
+      BuildSenderOptions(options_), &pika_servers_, &pika_mutex_,
+      &recover_offset_, binlog_manager_);
+  ret = sender_engine_->Start();
+  if (ret != 0) {
+    rocksutil::Error(options_.info_log,
+        "BecomePrimary-6: start sender engine error");
+    return slash::Status::Corruption("Start sender engine error");
+  }
+
+  rocksutil::Info(options_.info_log,
+      "BecomePrimary-7: create & start trysync thread");
   trysync_thread_ = new PikaHubTrysync(options_.info_log, options_.local_ip,
-      options_.port, &pika_servers_, &pika_mutex_, &recover_offset_,
-      binlog_manager_);
+      options_.port, &pika_servers_, &pika_mutex_, binlog_manager_,
+      sender_engine_);
   ret = trysync_thread_->StartThread();
   if (ret != 0) {
     rocksutil::Error(options_.info_log,
-        "BecomePrimary-5: start trysync thread error");
+        "BecomePrimary-7: start trysync thread error");
     return slash::Status::Corruption("Start trysync thread error");
   }
 
+  rocksutil::Info(options_.info_log,
+      "BecomePrimary-8: create & start binlog purger");
+  binlog_purger_ = new BinlogPurger(options_.info_log, env_,
+      &pika_servers_, &pika_mutex_, binlog_manager_,
+      options_.binlog_purge_interval, options_.binlog_retention_files);
+  ret = binlog_purger_->StartThread();
+  if (ret != 0) {
+    rocksutil::Error(options_.info_log,
+        "BecomePrimary-8: start binlog purger error");
+    return slash::Status::Corruption("Start binlog purger error");
+  }
+
+  if (options_.binlog_compact_interval > 0) {
+    rocksutil::Info(options_.info_log,
+        "BecomePrimary-9: create & start binlog compactor");
+    binlog_compactor_ = new BinlogCompactor(options_.info_log, env_,
+        options_.info_log_path, binlog_manager_,
+        options_.binlog_compact_interval);
+    ret = binlog_compactor_->StartThread();
+    if (ret != 0) {
+      rocksutil::Error(options_.info_log,
+          "BecomePrimary-9: start binlog compactor error");
+      return slash::Status::Corruption("Start binlog compactor error");
+    }
+  }
+
   rocksutil::Info(options_.info_log, "BecomePrimary done");
   return slash::Status::OK();
 }
@@ -738,19 +1056,26 @@ void PikaHubServer::BecomeSecondary() {
       "BecomeSecondary-1: reset primary identify");
   is_primary_ = false;
   rocksutil::Info(options_.info_log,
-      "BecomeSecondary-2: delete trysync thread");
+      "BecomeSecondary-2: delete trysync thread, sender engine, "
+      "binlog purger & binlog compactor");
   delete trysync_thread_;
   trysync_thread_ = nullptr;
+  delete sender_engine_;
+  sender_engine_ = nullptr;
+  delete binlog_purger_;
+  binlog_purger_ = nullptr;
+  delete binlog_compactor_;
+  binlog_compactor_ = nullptr;
   rocksutil::Info(options_.info_log,
       "BecomeSecondary-3: reset pika_servers offset");
   {
   rocksutil::MutexLock l(&pika_mutex_);
   for (auto iter = pika_servers_.begin(); iter != pika_servers_.end();
       iter++) {
-    iter->second.rcv_number = 0;
-    iter->second.rcv_offset = 0;
-    iter->second.send_number = 0;
-    iter->second.send_offset = 0;
+    iter->second.offsets->rcv.Store(0, 0);
+    iter->second.offsets->send.Store(0, 0);
+    iter->second.offsets->hwm.Store(0, 0);
+    iter->second.rcv_exact = false;
     iter->second.sync_status = kShouldConnect;
   }
   }
@@ -772,6 +1097,7 @@ void PikaHubServer::BecomeSecondary() {
   binlog_manager_->ResetOffsetAndBinlog();
   primary_ = "NULL";
   rocksutil::Info(options_.info_log, "BecomeSecondary-8: reset primary");
+  StartBinlogMirror();
   rocksutil::Info(options_.info_log, "BecomeSecondary done");
 }
 
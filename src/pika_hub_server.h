@@ -16,8 +16,12 @@
 #include "src/pika_hub_client_conn.h"
 #include "src/pika_hub_inner_client_conn.h"
 #include "src/pika_hub_binlog_manager.h"
-#include "src/pika_hub_binlog_sender.h"
+#include "src/pika_hub_sender_engine.h"
+#include "src/pika_hub_binlog_purger.h"
+#include "src/pika_hub_binlog_compactor.h"
+#include "src/pika_hub_binlog_mirror.h"
 #include "src/pika_hub_trysync.h"
+#include "src/pika_hub_offset_table.h"
 #include "floyd/include/floyd.h"
 #include "pink/include/server_thread.h"
 #include "rocksutil/coding.h"
@@ -135,6 +139,13 @@ class PikaHubServer {
   std::string DumpPikaServers();
   void UpdateRcvOffset(int32_t server_id,
       int32_t number, int64_t offset);
+  /*
+   * return true if the record at (number, offset) of server_id is at or
+   * below its high-water mark, it is counted as a dropped replay of
+   * bytes then
+   */
+  bool IsReplayed(int32_t server_id, int32_t number, int64_t offset,
+      uint64_t bytes);
   void GetBinlogWriterOffset(uint64_t* number, uint64_t* offset);
   void Exit() {
     should_exit_ = true;
@@ -158,6 +169,19 @@ class PikaHubServer {
 
   void GetAllHubServers(std::set<std::string>* nodes);
 
+  // return Incomplete if another purge is in progress
+  slash::Status PurgeBinlogs(uint64_t to);
+
+  /*
+   * Serve a hubbinlog of the BinlogMirror on a secondary: meta is the
+   * encoded MirrorMeta, data is the bytes of binlog_<number> from offset
+   * and index is the index entries within them. Return NotFound if the
+   * offset is not in the binlog
+   */
+  slash::Status ReadBinlogForMirror(uint64_t number, uint64_t offset,
+      std::string* meta, std::string* index, std::string* data);
+  std::string DumpBinlogMirror();
+
  private:
   rocksutil::Env* env_;
   const Options options_;
@@ -195,7 +219,19 @@ class PikaHubServer {
 
   BinlogManager* binlog_manager_;
   PikaHubTrysync* trysync_thread_;
+  SenderEngine* sender_engine_;
   BinlogWriter* binlog_writer_;
+  BinlogPurger* binlog_purger_;
+  // nullptr if binlog_compact_interval is 0
+  BinlogCompactor* binlog_compactor_;
+  // protect binlog_mirror_, only exists on a secondary
+  rocksutil::port::Mutex mirror_mutex_;
+  BinlogMirror* binlog_mirror_;
+  void StartBinlogMirror();
+  // return false if there are no mirrored offsets
+  bool StopBinlogMirror(MirrorOffsetMap* offsets);
+  void SetMirrorPrimary(const std::string& primary);
+  void ApplyMirrorOffsets(const MirrorOffsetMap& offsets);
   bool CheckPikaServers();
   bool RecoverOffset();
   static void EncodeOffset(std::string* value,
@@ -211,6 +247,8 @@ class PikaHubServer {
       std::string* holder, uint64_t* lease_deadline);
   // protect pika_servers_
   rocksutil::port::Mutex pika_mutex_;
+  // offsets of pika_servers_
+  OffsetTable offset_table_;
 
   RecoverOffsetMap recover_offset_;
 };
@@ -32,9 +32,15 @@ void SetCmd::DoInitial(const PikaCmdArgsType &argv,
   exec_time_ = rocksutil::DecodeFixed32(argv[5].data());
   number_ = rocksutil::DecodeFixed32(argv[5].data() + 4);
   offset_ = rocksutil::DecodeFixed64(argv[5].data() + 8);
+  replay_ = g_pika_hub_server->IsReplayed(server_id_, number_, offset_,
+      BinlogWriter::Task(kSetOPCode, key_, value_, server_id_, exec_time_,
+        number_).EncodedSize());
 }
 
 void SetCmd::Do() {
+  if (replay_) {
+    return;
+  }
   rocksutil::Status s = g_pika_hub_server->binlog_writer()->
     Append(kSetOPCode, key_, value_, server_id_, exec_time_,
         number_);
@@ -59,14 +65,20 @@ void DelCmd::DoInitial(const PikaCmdArgsType &argv,
     return;
   }
   key_ = argv[1];
-  value_ = "";
+  value_.clear();
   slash::string2l(argv[3].data(), argv[3].size(), &server_id_);
   exec_time_ = rocksutil::DecodeFixed32(argv[4].data());
   number_ = rocksutil::DecodeFixed32(argv[4].data() + 4);
   offset_ = rocksutil::DecodeFixed64(argv[4].data() + 8);
+  replay_ = g_pika_hub_server->IsReplayed(server_id_, number_, offset_,
+      BinlogWriter::Task(kDelOPCode, key_, value_, server_id_, exec_time_,
+        number_).EncodedSize());
 }
 
 void DelCmd::Do() {
+  if (replay_) {
+    return;
+  }
   rocksutil::Status s = g_pika_hub_server->binlog_writer()->
     Append(kDelOPCode, key_, value_, server_id_, exec_time_,
         number_);
@@ -96,9 +108,15 @@ void ExpireatCmd::DoInitial(const PikaCmdArgsType &argv,
   exec_time_ = rocksutil::DecodeFixed32(argv[5].data());
   number_ = rocksutil::DecodeFixed32(argv[5].data() + 4);
   offset_ = rocksutil::DecodeFixed64(argv[5].data() + 8);
+  replay_ = g_pika_hub_server->IsReplayed(server_id_, number_, offset_,
+      BinlogWriter::Task(kExpireatOPCode, key_, timestamp_, server_id_,
+        exec_time_, number_).EncodedSize());
 }
 
 void ExpireatCmd::Do() {
+  if (replay_) {
+    return;
+  }
   rocksutil::Status s = g_pika_hub_server->binlog_writer()->
     Append(kExpireatOPCode, key_, timestamp_, server_id_, exec_time_,
         number_);
@@ -111,3 +129,81 @@ void ExpireatCmd::Do() {
   }
   return;
 }
+
+void HubbatchCmd::DoInitial(const PikaCmdArgsType &argv,
+    const CmdInfo* const ptr_info) {
+  if (!ptr_info->CheckArg(argv.size())) {
+    res_.SetRes(CmdRes::kWrongNum, kCmdNameHubbatch);
+    return;
+  }
+  if (argv[1] != kBinlogMagic) {
+    res_.SetRes(CmdRes::kInvalidMagic, kCmdNameHubbatch);
+    return;
+  }
+  slash::string2l(argv[2].data(), argv[2].size(), &server_id_);
+
+  tasks_.clear();
+  rocksutil::Slice frame(argv[3]);
+  uint32_t count = 0;
+  if (!rocksutil::GetFixed32(&frame, &count)) {
+    res_.SetRes(CmdRes::kInvalidParameter, kCmdNameHubbatch);
+    return;
+  }
+  // a record takes 25 bytes at least
+  if (count > frame.size() / 25) {
+    res_.SetRes(CmdRes::kInvalidParameter, kCmdNameHubbatch);
+    return;
+  }
+  tasks_.reserve(count);
+  for (uint32_t i = 0; i < count; i++) {
+    if (frame.size() < 17) {
+      res_.SetRes(CmdRes::kInvalidParameter, kCmdNameHubbatch);
+      return;
+    }
+    uint8_t op = static_cast<uint8_t>(frame[0]);
+    int32_t exec_time = rocksutil::DecodeFixed32(frame.data() + 1);
+    number_ = rocksutil::DecodeFixed32(frame.data() + 5);
+    offset_ = rocksutil::DecodeFixed64(frame.data() + 9);
+    frame.remove_prefix(17);
+
+    rocksutil::Slice key, value;
+    if (!GetFrameBytes(&frame, &key) || !GetFrameBytes(&frame, &value) ||
+        (op != kSetOPCode && op != kDelOPCode && op != kExpireatOPCode)) {
+      res_.SetRes(CmdRes::kInvalidParameter, kCmdNameHubbatch);
+      return;
+    }
+    BinlogWriter::Task task(op, key, value, server_id_, exec_time, number_);
+    if (g_pika_hub_server->IsReplayed(server_id_, number_, offset_,
+          task.EncodedSize())) {
+      continue;
+    }
+    tasks_.push_back(task);
+  }
+}
+
+bool HubbatchCmd::GetFrameBytes(rocksutil::Slice* frame,
+    rocksutil::Slice* result) {
+  uint32_t size = 0;
+  if (!rocksutil::GetFixed32(frame, &size) || frame->size() < size) {
+    return false;
+  }
+  *result = rocksutil::Slice(frame->data(), size);
+  frame->remove_prefix(size);
+  return true;
+}
+
+void HubbatchCmd::Do() {
+  if (tasks_.empty()) {
+    return;
+  }
+  rocksutil::Status s = g_pika_hub_server->binlog_writer()->
+    AppendBatch(tasks_);
+  if (s.ok()) {
+    g_pika_hub_server->UpdateRcvOffset(server_id_,
+        number_, offset_);
+  } else {
+    Error(g_pika_hub_server->GetLogger(), "Append Batch Error: %s",
+        s.ToString().c_str());
+  }
+  return;
+}
@@ -7,52 +7,96 @@
 #define SRC_PIKA_HUB_SYNC_COMMAND_H_
 
 #include <string>
+#include <vector>
 #include "src/pika_hub_command.h"
 #include "src/pika_hub_client_conn.h"
+#include "src/pika_hub_binlog_writer.h"
+#include "rocksutil/slice.h"
 
+/*
+ * The sync commands keep slices into the argv of the connection instead of
+ * copies, it is safe because Do() is always called right after Initial()
+ * by the same connection, BinlogWriter encodes them into the group buffer
+ * before Append returns.
+ */
 class SetCmd : public Cmd {
  public:
-  SetCmd() {}
+  SetCmd() : replay_(false) {}
   virtual void Do() override;
  private:
   virtual void DoInitial(const PikaCmdArgsType &argvs,
       const CmdInfo* const ptr_info) override;
-  std::string key_;
-  std::string value_;
+  rocksutil::Slice key_;
+  rocksutil::Slice value_;
   int64_t server_id_;
   int32_t exec_time_;
   int32_t number_;
   int64_t offset_;
+  // at or below the high-water mark of server_id_, dropped
+  bool replay_;
 };
 
 class DelCmd : public Cmd {
  public:
-  DelCmd() {}
+  DelCmd() : replay_(false) {}
   virtual void Do() override;
  private:
   virtual void DoInitial(const PikaCmdArgsType &argvs,
       const CmdInfo* const ptr_info) override;
-  std::string key_;
-  std::string value_;
+  rocksutil::Slice key_;
+  rocksutil::Slice value_;
   int64_t server_id_;
   int32_t exec_time_;
   int32_t number_;
   int64_t offset_;
+  bool replay_;
 };
 
 class ExpireatCmd : public Cmd {
  public:
-  ExpireatCmd() {}
+  ExpireatCmd() : replay_(false) {}
   virtual void Do() override;
  private:
   virtual void DoInitial(const PikaCmdArgsType &argvs,
       const CmdInfo* const ptr_info) override;
-  std::string key_;
-  std::string timestamp_;
+  rocksutil::Slice key_;
+  rocksutil::Slice timestamp_;
   int64_t server_id_;
   int32_t exec_time_;
   int32_t number_;
   int64_t offset_;
+  bool replay_;
+};
+
+/*
+ * hubbatch <magic> <server_id> <frame> carries the records of one pika
+ * server in one command, the frame is
+ *
+ *   count(Fixed32) record * count
+ *
+ * and every record is
+ *
+ *   op(1 byte) exec_time(Fixed32) number(Fixed32) offset(Fixed64)
+ *   key_size(Fixed32) key value_size(Fixed32) value
+ *
+ * number & offset are the binlog position of the record on the pika
+ * server, as the last argument of set/del/expireat. The records at or
+ * below the high-water mark are dropped, the rest of the frame is
+ * appended to BinlogWriter as one task
+ */
+class HubbatchCmd : public Cmd {
+ public:
+  HubbatchCmd() {}
+  virtual void Do() override;
+ private:
+  virtual void DoInitial(const PikaCmdArgsType &argvs,
+      const CmdInfo* const ptr_info) override;
+  static bool GetFrameBytes(rocksutil::Slice* frame, rocksutil::Slice* result);
+  int64_t server_id_;
+  std::vector<BinlogWriter::Task> tasks_;
+  // the position of the last record
+  int32_t number_;
+  int64_t offset_;
 };
 
 #endif  // SRC_PIKA_HUB_SYNC_COMMAND_H_
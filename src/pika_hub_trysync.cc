@@ -3,192 +3,409 @@
 //  LICENSE file in the root directory of this source tree. An additional grant
 //  of patent rights can be found in the PATENTS file in the same directory.
 
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
 #include <string>
 #include <thread>
 
 #include "src/pika_hub_trysync.h"
-#include "src/pika_hub_heartbeat.h"
+#include "src/pika_hub_offset_table.h"
+#include "src/pika_hub_binlog_compression.h"
 #include "pink/include/redis_cli.h"
 #include "slash/include/slash_string.h"
-#include "slash/include/slash_status.h"
 
-bool PikaHubTrysync::Auth(pink::PinkCli* cli,
-    const PikaServers::iterator& iter) {
-  if (iter->second.passwd == "") {
-    return true;
+static const uint64_t kTrysyncConnectTimeoutUs = 1500 * 1000;
+static const uint64_t kTrysyncIOTimeoutUs = 3000 * 1000;
+static const int kTrysyncIntervalSeconds = 2;
+
+static uint64_t NowMicros() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/*
+ * Parse one RESP reply at the front of rbuf, the content of a status,
+ * error, integer or bulk reply is stored in reply.
+ * Return 1 if a reply is parsed, 0 if more bytes are needed,
+ * -1 if the reply is not understood
+ */
+static int ParseReply(const std::string& rbuf, std::string* reply) {
+  size_t pos = rbuf.find("\r\n");
+  if (pos == std::string::npos) {
+    return 0;
+  }
+  switch (rbuf[0]) {
+    case '+':
+    case '-':
+    case ':':
+      reply->assign(rbuf, 1, pos - 1);
+      return 1;
+    case '$': {
+      long len = 0;  // NOLINT
+      if (!slash::string2l(rbuf.data() + 1, pos - 1, &len) || len < 0) {
+        return -1;
+      }
+      if (rbuf.size() < pos + 2 + static_cast<size_t>(len) + 2) {
+        return 0;
+      }
+      reply->assign(rbuf, pos + 2, static_cast<size_t>(len));
+      return 1;
+    }
+    default:
+      return -1;
   }
+}
 
-  pink::RedisCmdArgsType argv;
-  std::string wbuf_str;
-  argv.clear();
-  argv.push_back("auth");
-  argv.push_back(iter->second.passwd);
-  pink::SerializeRedisCommand(argv, &wbuf_str);
-  slash::Status s = cli->Send(&wbuf_str);
-  if (!s.ok()) {
-    Error(info_log_, "Trysync master %d,%s:%d Auth, "
-      "Send, error: %s",
-      iter->first, iter->second.ip.c_str(), iter->second.port,
-      s.ToString().c_str());
-    return false;
+uint64_t PikaHubTrysync::RollbackNumber(const PikaServers::iterator& iter) {
+  uint64_t rcv_number, rcv_offset;
+  iter->second.offsets->rcv.Load(&rcv_number, &rcv_offset);
+  if (iter->second.rcv_exact) {
+    return rcv_number;
   }
+  return rcv_number >= kMaxRecvRollbackNums ?
+    rcv_number - kMaxRecvRollbackNums : 0;
+}
 
-  s = cli->Recv(&argv);
-  if (!s.ok()) {
-    Error(info_log_, "Trysync master %d,%s:%d Auth, "
-      "Recv, error: %s",
-      iter->first, iter->second.ip.c_str(), iter->second.port,
-      strerror(errno));
-    return false;
+void PikaHubTrysync::TakeSnapshot(std::vector<Handshake>* handshakes) {
+  rocksutil::MutexLock l(pika_mutex_);
+  auto it = pika_servers_->begin();
+  while (it != pika_servers_->end()) {
+    if (it->second.sync_status == kShouldDelete) {
+      if (it->second.sending) {
+        sender_engine_->RemoveTarget(it->first);
+      }
+      it = pika_servers_->erase(it);
+      continue;
+    }
+    if (it->second.sync_status == kShouldConnect) {
+      Handshake hs;
+      hs.server_id = it->first;
+      hs.ip = it->second.ip;
+      hs.port = it->second.port;
+      hs.passwd = it->second.passwd;
+      hs.number = RollbackNumber(it);
+      handshakes->push_back(hs);
+    }
+    it++;
   }
+}
 
-  std::string result = slash::StringToLower(argv[0]);
-  if (result != "ok") {
-    Error(info_log_, "Trysync master %d,%s:%d Auth failed",
-      iter->first, iter->second.ip.c_str(), iter->second.port);
-    return false;
+void PikaHubTrysync::FinishHandshake(Handshake* hs,
+    Handshake::Result result, const char* reason) {
+  if (hs->phase == Handshake::kCompress && result == Handshake::kRetry) {
+    /*
+     * the trysync is done, a pika server not knowing hubcompress may
+     * close the connection or never answer, send it plain RESP
+     */
+    Info(info_log_, "Trysync master %d,%s:%d does not take compressed "
+        "binlog: %s", hs->server_id, hs->ip.c_str(), hs->port, reason);
+    result = Handshake::kSuccess;
   }
+  if (result == Handshake::kRetry) {
+    Error(info_log_, "Trysync master %d,%s:%d(%llu %llu) failed: %s",
+        hs->server_id, hs->ip.c_str(), hs->port, hs->number, 0, reason);
+  } else if (result == Handshake::kRefused) {
+    Error(info_log_,
+        "Trysync master %d,%s:%d(%llu %llu), Recv, logic error: %s",
+        hs->server_id, hs->ip.c_str(), hs->port, hs->number, 0, reason);
+  }
+  if (hs->fd >= 0) {
+    close(hs->fd);
+    hs->fd = -1;
+  }
+  hs->phase = Handshake::kDone;
+  hs->result = result;
+}
 
-  return true;
+void PikaHubTrysync::StartHandshake(Handshake* hs, uint64_t now) {
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(hs->port);
+  if (inet_pton(AF_INET, hs->ip.c_str(), &addr.sin_addr) != 1) {
+    FinishHandshake(hs, Handshake::kRetry, "invalid ip");
+    return;
+  }
+  hs->fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (hs->fd < 0) {
+    FinishHandshake(hs, Handshake::kRetry, strerror(errno));
+    return;
+  }
+  hs->phase = Handshake::kConnecting;
+  int ret = connect(hs->fd, reinterpret_cast<struct sockaddr*>(&addr),
+      sizeof(addr));
+  if (ret == 0) {
+    OnConnected(hs, now);
+  } else if (errno == EINPROGRESS) {
+    hs->deadline = now + kTrysyncConnectTimeoutUs;
+  } else {
+    FinishHandshake(hs, Handshake::kRetry, strerror(errno));
+  }
 }
 
-bool PikaHubTrysync::Send(pink::PinkCli* cli,
-    const PikaServers::iterator& iter) {
+void PikaHubTrysync::OnConnected(Handshake* hs, uint64_t now) {
   pink::RedisCmdArgsType argv;
-  std::string wbuf_str;
-  uint64_t number =
-    iter->second.rcv_number >= kMaxRecvRollbackNums ?
-      iter->second.rcv_number - kMaxRecvRollbackNums : 0;
-
-  argv.clear();
-  argv.push_back("internaltrysync");
-  argv.push_back(local_ip_);
-  argv.push_back(std::to_string(local_port_));
-  argv.push_back(std::to_string(number));
-  argv.push_back(std::to_string(0));
-  if (g_pika_hub_conf->binlog_offset_absolute_consistency()) {
-    argv.push_back(std::to_string(0));
+  if (hs->passwd != "") {
+    argv.push_back("auth");
+    argv.push_back(hs->passwd);
+    hs->phase = Handshake::kAuth;
   } else {
-    argv.push_back(std::to_string(1));
+    argv.push_back("internaltrysync");
+    argv.push_back(local_ip_);
+    argv.push_back(std::to_string(local_port_));
+    argv.push_back(std::to_string(hs->number));
+    argv.push_back(std::to_string(0));
+    if (g_pika_hub_conf->binlog_offset_absolute_consistency()) {
+      argv.push_back(std::to_string(0));
+    } else {
+      argv.push_back(std::to_string(1));
+    }
+    hs->phase = Handshake::kTrysync;
+  }
+  hs->wbuf.clear();
+  pink::SerializeRedisCommand(argv, &hs->wbuf);
+  hs->wpos = 0;
+  hs->deadline = now + kTrysyncIOTimeoutUs;
+  OnWritable(hs, now);
+}
+
+void PikaHubTrysync::OnWritable(Handshake* hs, uint64_t now) {
+  while (hs->wpos < hs->wbuf.size()) {
+    ssize_t n = send(hs->fd, hs->wbuf.data() + hs->wpos,
+        hs->wbuf.size() - hs->wpos, MSG_NOSIGNAL);
+    if (n > 0) {
+      hs->wpos += n;
+    } else if (n < 0 && errno == EINTR) {
+      continue;
+    } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      return;
+    } else {
+      FinishHandshake(hs, Handshake::kRetry, strerror(errno));
+      return;
+    }
   }
+}
 
-  pink::SerializeRedisCommand(argv, &wbuf_str);
+void PikaHubTrysync::OnReadable(Handshake* hs, uint64_t now) {
+  char buf[1024];
+  while (true) {
+    ssize_t n = recv(hs->fd, buf, sizeof(buf), 0);
+    if (n > 0) {
+      hs->rbuf.append(buf, n);
+      continue;
+    }
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      break;
+    }
+    FinishHandshake(hs, Handshake::kRetry,
+        n == 0 ? "connection closed by peer" : strerror(errno));
+    return;
+  }
+  OnReply(hs, now);
+}
 
-  slash::Status s = cli->Send(&wbuf_str);
-  if (!s.ok()) {
-    Error(info_log_, "Trysync master %d,%s:%d(%llu %llu), Send, error: %s",
-      iter->first, iter->second.ip.c_str(), iter->second.port,
-      number, 0,
-      s.ToString().c_str());
-    return false;
+void PikaHubTrysync::OnReply(Handshake* hs, uint64_t now) {
+  int ret = ParseReply(hs->rbuf, &hs->reply);
+  if (ret == 0) {
+    return;
+  }
+  hs->rbuf.clear();
+  if (ret < 0) {
+    FinishHandshake(hs, Handshake::kRetry, "invalid reply");
+    return;
+  }
+  std::string result = slash::StringToLower(hs->reply);
+  if (hs->phase == Handshake::kAuth) {
+    if (result != "ok") {
+      FinishHandshake(hs, Handshake::kRetry, "Auth failed");
+      return;
+    }
+    hs->passwd.clear();
+    OnConnected(hs, now);
+  } else if (hs->phase == Handshake::kTrysync) {
+    if (result != "ok") {
+      FinishHandshake(hs, Handshake::kRefused, hs->reply.c_str());
+      return;
+    }
+    BinlogCompression offered = sender_engine_->compression();
+    if (offered == kNoCompression) {
+      FinishHandshake(hs, Handshake::kSuccess, nullptr);
+      return;
+    }
+    pink::RedisCmdArgsType argv;
+    argv.push_back(kHubCompressCommand);
+    argv.push_back(BinlogCompressionName(offered));
+    hs->wbuf.clear();
+    pink::SerializeRedisCommand(argv, &hs->wbuf);
+    hs->wpos = 0;
+    hs->deadline = now + kTrysyncIOTimeoutUs;
+    hs->phase = Handshake::kCompress;
+    OnWritable(hs, now);
+  } else if (hs->phase == Handshake::kCompress) {
+    if (result == "ok") {
+      hs->compression = sender_engine_->compression();
+      FinishHandshake(hs, Handshake::kSuccess, nullptr);
+    } else {
+      FinishHandshake(hs, Handshake::kRetry, hs->reply.c_str());
+    }
   }
-  return true;
 }
 
-bool PikaHubTrysync::Recv(pink::PinkCli* cli,
-    const PikaServers::iterator& iter) {
-  slash::Status s;
-  std::string reply;
-  uint64_t number =
-    iter->second.rcv_number >= kMaxRecvRollbackNums ?
-      iter->second.rcv_number - kMaxRecvRollbackNums : 0;
+void PikaHubTrysync::RunHandshakes(std::vector<Handshake>* handshakes) {
+  uint64_t now = NowMicros();
+  for (auto& hs : *handshakes) {
+    StartHandshake(&hs, now);
+  }
 
-  pink::RedisCmdArgsType argv;
-  s = cli->Recv(&argv);
-  if (!s.ok()) {
-    Error(info_log_, "Trysync master %d,%s:%d(%llu %llu), Recv, error: %s",
-      iter->first, iter->second.ip.c_str(), iter->second.port,
-      number, 0,
-      strerror(errno));
-    return false;
+  std::vector<struct pollfd> pfds;
+  std::vector<Handshake*> polled;
+  while (!should_stop()) {
+    pfds.clear();
+    polled.clear();
+    uint64_t deadline = 0;
+    for (auto& hs : *handshakes) {
+      if (hs.phase == Handshake::kDone) {
+        continue;
+      }
+      struct pollfd pfd;
+      pfd.fd = hs.fd;
+      pfd.events = (hs.phase == Handshake::kConnecting ||
+          hs.wpos < hs.wbuf.size()) ? POLLOUT : POLLIN;
+      pfd.revents = 0;
+      pfds.push_back(pfd);
+      polled.push_back(&hs);
+      if (deadline == 0 || hs.deadline < deadline) {
+        deadline = hs.deadline;
+      }
+    }
+    if (pfds.empty()) {
+      break;
+    }
+
+    now = NowMicros();
+    // wake up at least every second to check should_stop
+    int timeout = deadline > now ?
+      static_cast<int>(std::min<uint64_t>((deadline - now) / 1000 + 1, 1000))
+      : 0;
+    int nfds = poll(pfds.data(), pfds.size(), timeout);
+    if (nfds < 0 && errno != EINTR) {
+      Error(info_log_, "Trysync poll failed: %s", strerror(errno));
+      break;
+    }
+
+    now = NowMicros();
+    for (size_t i = 0; nfds > 0 && i < pfds.size(); i++) {
+      Handshake* hs = polled[i];
+      if (pfds[i].revents == 0) {
+        continue;
+      }
+      if (hs->phase == Handshake::kConnecting) {
+        int err = 0;
+        socklen_t len = sizeof(err);
+        if (getsockopt(hs->fd, SOL_SOCKET, SO_ERROR, &err, &len) != 0) {
+          err = errno;
+        }
+        if (err != 0) {
+          FinishHandshake(hs, Handshake::kRetry, strerror(err));
+        } else {
+          OnConnected(hs, now);
+        }
+      } else if (pfds[i].revents & POLLOUT) {
+        OnWritable(hs, now);
+      } else if (pfds[i].revents & (POLLIN | POLLERR | POLLHUP)) {
+        OnReadable(hs, now);
+      }
+    }
+
+    for (auto hs : polled) {
+      if (hs->phase != Handshake::kDone && hs->deadline <= now) {
+        FinishHandshake(hs, Handshake::kRetry,
+            hs->phase == Handshake::kConnecting ? "connect timeout" :
+            "timeout");
+      }
+    }
   }
 
-  reply = slash::StringToLower(argv[0]);
+  // stopped before all the handshakes are done
+  for (auto& hs : *handshakes) {
+    if (hs.phase != Handshake::kDone) {
+      FinishHandshake(&hs, Handshake::kRetry, "trysync stopped");
+    }
+  }
+}
 
-  if (reply != "ok") {
-    Error(info_log_,
-      "Trysync master %d,%s:%d(%llu %llu), Recv, logic error: %s",
-      iter->first, iter->second.ip.c_str(), iter->second.port,
-      number, 0,
-      reply.c_str());
+void PikaHubTrysync::ApplyResult(const Handshake& hs) {
+  if (hs.result == Handshake::kRetry) {
+    return;
+  }
+  rocksutil::MutexLock l(pika_mutex_);
+  auto iter = pika_servers_->find(hs.server_id);
+  /*
+   * the pika server may be deleted or changed while the handshake
+   * is running, the result is stale then
+   */
+  if (iter == pika_servers_->end() ||
+      iter->second.sync_status != kShouldConnect ||
+      iter->second.ip != hs.ip || iter->second.port != hs.port) {
+    Info(info_log_, "Trysync master %d,%s:%d changed during trysync, "
+        "ignore the result", hs.server_id, hs.ip.c_str(), hs.port);
+    return;
+  }
+  if (hs.result == Handshake::kRefused) {
     iter->second.sync_status = kErrorHappened;
-    return false;
+    // the binlog of the pika server may be recreated, forget its positions
+    iter->second.offsets->hwm.Store(0, 0);
+    return;
   }
+
+  Info(info_log_, "Trysync master %d,%s:%d(%llu %llu) success",
+      iter->first, iter->second.ip.c_str(), iter->second.port,
+      hs.number, 0);
   iter->second.sync_status = kConnected;
-  if (iter->second.sender == nullptr) {
-    uint64_t number = iter->second.send_number > 0 ?
-            iter->second.send_number - 1 : 0;
-    BinlogReader* reader = manager_->AddReader(number,
-        0);
+  iter->second.rcv_exact = false;
+  if (!iter->second.sending) {
+    uint64_t number, offset;
+    iter->second.offsets->send.Load(&number, &offset);
+    BinlogReader* reader = manager_->AddResumeReader(number, offset);
     if (reader) {
-      iter->second.sender = new BinlogSender(iter->first,
-          iter->second.ip, iter->second.port, info_log_, reader,
-          pika_servers_, pika_mutex_, recover_offset_, manager_);
-      static_cast<BinlogSender*>(iter->second.sender)->StartThread();
-      Info(info_log_, "Start BinlogSender[%d] success for %s:%d(%llu %llu)",
-          iter->first, iter->second.ip.c_str(), iter->second.port,
-          number, 0);
+      sender_engine_->AddTarget(iter->first, iter->second.ip,
+          iter->second.port, iter->second.offsets, reader, hs.compression);
+      iter->second.sending = true;
+      Info(info_log_, "Start BinlogSender[%d] success for %s:%d(%llu %llu), "
+          "compression: %s", iter->first, iter->second.ip.c_str(),
+          iter->second.port, number, offset,
+          BinlogCompressionName(hs.compression));
     } else {
       Error(info_log_, "Start BinlogSender[%d] Failed for %s:%d(%llu %llu)",
           iter->first, iter->second.ip.c_str(), iter->second.port,
-          number, 0);
+          number, offset);
     }
   }
-  if (iter->second.heartbeat == nullptr) {
-    iter->second.heartbeat = new Heartbeat(iter->first,
-        iter->second.ip, iter->second.port, info_log_,
-        pika_servers_, pika_mutex_);
-    static_cast<Heartbeat*>(iter->second.heartbeat)->StartThread();
-    Info(info_log_, "Start HeartBeat[%d] success for %s:%d",
-        iter->first, iter->second.ip.c_str(), iter->second.port);
-  }
-  return true;
-}
-
-void PikaHubTrysync::Trysync(const PikaServers::
-    iterator& iter) {
-  pink::PinkCli* cli = pink::NewRedisCli();
-  cli->set_connect_timeout(1500);
-  std::string master_ip;
-  uint64_t number =
-    iter->second.rcv_number >= kMaxRecvRollbackNums ?
-      iter->second.rcv_number - kMaxRecvRollbackNums : 0;
-  if ((cli->Connect(iter->second.ip, iter->second.port)).ok()) {
-    cli->set_send_timeout(3000);
-    cli->set_recv_timeout(3000);
-    if (!Auth(cli, iter)) {
-      return;
-    }
-    if (Send(cli, iter) && Recv(cli, iter)) {
-      Info(info_log_, "Trysync master %d,%s:%d(%llu %llu) success",
-          iter->first,
-          iter->second.ip.c_str(), iter->second.port,
-          number, 0);
-    }
-  } else {
-    Error(info_log_, "Trysync master %d,%s:%d(%llu %llu) connect failed",
-          iter->first,
-          iter->second.ip.c_str(), iter->second.port,
-          number, 0);
-  }
-  delete cli;
 }
 
 void* PikaHubTrysync::ThreadMain() {
+  std::vector<Handshake> handshakes;
   while (!should_stop()) {
-    {
-    rocksutil::MutexLock l(pika_mutex_);
-    for (auto it = pika_servers_->begin(); it != pika_servers_->end(); it++) {
-      if (it->second.sync_status == kShouldDelete) {
-        delete static_cast<BinlogSender*>(it->second.sender);
-        it = pika_servers_->erase(it);
+    handshakes.clear();
+    TakeSnapshot(&handshakes);
+    if (!handshakes.empty()) {
+      RunHandshakes(&handshakes);
+      for (const auto& hs : handshakes) {
+        ApplyResult(hs);
       }
-      if (it->second.sync_status == kShouldConnect) {
-        Trysync(it);
-      }
-    }
     }
-    std::this_thread::sleep_for(std::chrono::seconds(2));
+    std::this_thread::sleep_for(std::chrono::seconds(kTrysyncIntervalSeconds));
   }
   return nullptr;
 }
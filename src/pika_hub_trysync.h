@@ -8,13 +8,12 @@
 
 #include <string>
 #include <memory>
+#include <vector>
 
 #include "src/pika_hub_common.h"
 #include "src/pika_hub_conf.h"
-#include "src/pika_hub_binlog_sender.h"
-#include "src/pika_hub_heartbeat.h"
+#include "src/pika_hub_sender_engine.h"
 #include "src/pika_hub_binlog_manager.h"
-#include "pink/include/pink_cli.h"
 #include "pink/include/pink_thread.h"
 #include "rocksutil/mutexlock.h"
 #include "rocksutil/auto_roll_logger.h"
@@ -28,35 +27,22 @@ class PikaHubTrysync : public pink::Thread {
     int local_port,
     PikaServers* pika_servers,
     rocksutil::port::Mutex* pika_mutex,
-    RecoverOffsetMap* recover_offset,
-    BinlogManager* manager)
+    BinlogManager* manager,
+    SenderEngine* sender_engine)
   : info_log_(info_log),
     local_ip_(local_ip),
     local_port_(local_port),
     pika_servers_(pika_servers),
     pika_mutex_(pika_mutex),
-    recover_offset_(recover_offset),
-    manager_(manager) {}
+    manager_(manager),
+    sender_engine_(sender_engine) {}
 
+  /*
+   * the targets started are stopped with the SenderEngine,
+   * which is deleted after this thread
+   */
   virtual ~PikaHubTrysync() {
     set_should_stop();
-    {
-     /*
-      * I commented the lock, because it may cause deadlock when BinlogSender
-      * is using pika_mutex_. It looks like that there is no need to hold
-      * the lock here. I will solve it later...
-      */
-//    rocksutil::MutexLock l(pika_mutex_);
-    for (auto iter = pika_servers_->begin(); iter != pika_servers_->end();
-        iter++) {
-      delete static_cast<BinlogSender*>(iter->second.sender);
-      iter->second.sender = nullptr;
-      iter->second.send_fd = -1;
-      delete static_cast<Heartbeat*>(iter->second.heartbeat);
-      iter->second.heartbeat = nullptr;
-      iter->second.hb_fd = -1;
-    }
-    }
     StopThread();
   }
 
@@ -67,16 +53,64 @@ class PikaHubTrysync : public pink::Thread {
   PikaServers* pika_servers_;
   // protect pika_servers_
   rocksutil::port::Mutex* pika_mutex_;
-  RecoverOffsetMap* recover_offset_;
   BinlogManager* manager_;
+  SenderEngine* sender_engine_;
 
-  void Trysync(const PikaServers::iterator& iter);
-  bool Send(pink::PinkCli* cli,
-        const PikaServers::iterator& iter);
-  bool Recv(pink::PinkCli* cli,
-        const PikaServers::iterator& iter);
-  bool Auth(pink::PinkCli* cli,
-        const PikaServers::iterator& iter);
+  /*
+   * The trysync of one pika server: connect, auth if passwd is set,
+   * then internaltrysync, then hubcompress if the sender offers a
+   * compressed stream. All the handshakes of a round run at the same
+   * time on non-blocking sockets, pika_mutex_ is only held to take the
+   * snapshot before and to apply the results after
+   */
+  struct Handshake {
+    enum Phase {
+      kConnecting = 0,
+      kAuth = 1,
+      kTrysync = 2,
+      // optional, the binlog is sent uncompressed if it is refused
+      kCompress = 3,
+      kDone = 4
+    };
+    enum Result {
+      // failed before the trysync was answered, retry in next round
+      kRetry = 0,
+      // the pika server refused the trysync
+      kRefused = 1,
+      kSuccess = 2
+    };
+    int32_t server_id;
+    std::string ip;
+    int port;
+    std::string passwd;
+    uint64_t number;
+    // the codec accepted by the pika server
+    BinlogCompression compression = kNoCompression;
+
+    int fd = -1;
+    Phase phase = kConnecting;
+    Result result = kRetry;
+    std::string wbuf;
+    size_t wpos = 0;
+    std::string rbuf;
+    uint64_t deadline = 0;
+    std::string reply;
+  };
+
+  // the binlog number of the pika server to sync from
+  uint64_t RollbackNumber(const PikaServers::iterator& iter);
+  // erase the deleted pika servers and copy the ones to trysync
+  void TakeSnapshot(std::vector<Handshake>* handshakes);
+  void RunHandshakes(std::vector<Handshake>* handshakes);
+  void ApplyResult(const Handshake& hs);
+
+  void StartHandshake(Handshake* hs, uint64_t now);
+  void OnConnected(Handshake* hs, uint64_t now);
+  void OnWritable(Handshake* hs, uint64_t now);
+  void OnReadable(Handshake* hs, uint64_t now);
+  void OnReply(Handshake* hs, uint64_t now);
+  void FinishHandshake(Handshake* hs, Handshake::Result result,
+      const char* reason);
   virtual void* ThreadMain() override;
 };
 
@@ -0,0 +1,369 @@
+//  Copyright (c) 2017-present The pika_hub Authors.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+/*
+ * hubz_receiver stands for a pika server taking the compressed binlog,
+ * to try sender-compression locally:
+ *
+ *   hubz_receiver <port> [forward_ip:forward_port]
+ *
+ * Add it to pika_hub as a pika server at <port>. The port answers auth,
+ * internaltrysync and hubcompress with OK, <port> + 1100 takes the
+ * binlog and heartbeat connections like the inner port of pika. The
+ * commands decompressed are printed, or forwarded as plain RESP to the
+ * inner port of a real pika server if forward_ip:forward_port is given.
+ * The bytes received and decompressed are printed at exit
+ */
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "src/pika_hub_common.h"
+#include "src/pika_hub_binlog_compression.h"
+
+struct Conn {
+  Conn() : data_port(false), compressed(false), codec(kNoCompression) {}
+  bool data_port;
+  // hubz frames follow hubcompress
+  bool compressed;
+  BinlogCompression codec;
+  std::string rbuf;
+  // decompressed, the rest of a command spanning frames
+  std::string raw;
+};
+
+static volatile sig_atomic_t stop = 0;
+static int forward_fd = -1;
+static uint64_t wire_bytes = 0;
+static uint64_t frame_bytes = 0;
+static uint64_t raw_bytes = 0;
+static uint64_t frames = 0;
+static uint64_t commands = 0;
+
+static void Usage() {
+  fprintf(stderr, "usage: hubz_receiver <port> "
+      "[forward_ip:forward_port]\n");
+}
+
+static void OnSignal(int sig) {
+  stop = 1;
+}
+
+static int Listen(int port) {
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd < 0) {
+    return -1;
+  }
+  int one = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  addr.sin_port = htons(port);
+  if (bind(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) != 0
+      || listen(fd, 16) != 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+static int ConnectTo(const std::string& ip, int port) {
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  if (inet_pton(AF_INET, ip.c_str(), &addr.sin_addr) != 1) {
+    return -1;
+  }
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd < 0) {
+    return -1;
+  }
+  if (connect(fd, reinterpret_cast<struct sockaddr*>(&addr),
+        sizeof(addr)) != 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+static bool WriteAll(int fd, const char* data, size_t len) {
+  while (len > 0) {
+    ssize_t n = send(fd, data, len, MSG_NOSIGNAL);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return false;
+    }
+    data += n;
+    len -= n;
+  }
+  return true;
+}
+
+/*
+ * Parse the RESP array at the front of data into argv.
+ * Return its size, 0 if more bytes are needed, -1 if it is not RESP
+ */
+static int64_t ParseCommand(const char* data, size_t len,
+    std::vector<std::string>* argv) {
+  argv->clear();
+  const char* end = data + len;
+  const char* p = data;
+  const char* eol = static_cast<const char*>(memchr(p, '\n', end - p));
+  if (eol == nullptr) {
+    return 0;
+  }
+  if (*p != '*') {
+    return -1;
+  }
+  long count = strtol(p + 1, nullptr, 10);  // NOLINT
+  if (count <= 0) {
+    return -1;
+  }
+  p = eol + 1;
+  for (long i = 0; i < count; i++) {  // NOLINT
+    eol = static_cast<const char*>(memchr(p, '\n', end - p));
+    if (eol == nullptr) {
+      return 0;
+    }
+    if (*p != '$') {
+      return -1;
+    }
+    long size = strtol(p + 1, nullptr, 10);  // NOLINT
+    if (size < 0) {
+      return -1;
+    }
+    p = eol + 1;
+    if (end - p < size + 2) {
+      return 0;
+    }
+    argv->push_back(std::string(p, size));
+    p += size + 2;
+  }
+  return p - data;
+}
+
+static void Output(const char* data, size_t len,
+    const std::vector<std::string>& argv) {
+  commands++;
+  if (forward_fd >= 0) {
+    if (!WriteAll(forward_fd, data, len)) {
+      fprintf(stderr, "forward failed: %s\n", strerror(errno));
+      stop = 1;
+    }
+    return;
+  }
+  for (size_t i = 0; i < argv.size(); i++) {
+    printf(i == 0 ? "%s" : " %s", argv[i].c_str());
+  }
+  printf("\n");
+}
+
+// return false if the connection should be closed
+static bool HandleCommand(int fd, Conn* conn, const char* data, size_t len,
+    const std::vector<std::string>& argv) {
+  std::string cmd = argv[0];
+  for (auto& c : cmd) {
+    c = tolower(c);
+  }
+  if (cmd == kHubCompressCommand) {
+    BinlogCompression codec = kNoCompression;
+    if (argv.size() != 2 || !ParseBinlogCompression(argv[1], &codec) ||
+        !BinlogCompressionSupported(codec)) {
+      fprintf(stderr, "unsupported compression %s\n",
+          argv.size() > 1 ? argv[1].c_str() : "");
+      WriteAll(fd, "-ERR unsupported compression\r\n", 30);
+      return !conn->data_port;
+    }
+    if (conn->data_port) {
+      conn->compressed = true;
+      conn->codec = codec;
+      fprintf(stderr, "binlog connection switched to %s\n",
+          BinlogCompressionName(codec));
+      return true;
+    }
+    return WriteAll(fd, "+OK\r\n", 5);
+  }
+  if (cmd == "ping") {
+    return WriteAll(fd, "+PONG\r\n", 7);
+  }
+  if (!conn->data_port) {
+    if (cmd == "auth" || cmd == "internaltrysync") {
+      return WriteAll(fd, "+OK\r\n", 5);
+    }
+    return WriteAll(fd, "-ERR unknown command\r\n", 22);
+  }
+  // the binlog is not replied
+  Output(data, len, argv);
+  return true;
+}
+
+// consume the commands in buf, return false on a protocol error
+static bool HandleCommands(int fd, Conn* conn, std::string* buf,
+    bool framed) {
+  std::vector<std::string> argv;
+  size_t pos = 0;
+  while (pos < buf->size()) {
+    if (conn->compressed && !framed) {
+      break;
+    }
+    int64_t n = ParseCommand(buf->data() + pos, buf->size() - pos, &argv);
+    if (n == 0) {
+      break;
+    }
+    if (n < 0 || !HandleCommand(fd, conn, buf->data() + pos, n, argv)) {
+      return false;
+    }
+    pos += n;
+    if (framed) {
+      raw_bytes += n;
+    }
+  }
+  buf->erase(0, pos);
+  return true;
+}
+
+static bool HandleInput(int fd, Conn* conn) {
+  if (!conn->compressed && !HandleCommands(fd, conn, &conn->rbuf, false)) {
+    return false;
+  }
+  while (conn->compressed) {
+    size_t consumed = 0;
+    std::string raw;
+    int ret = DecodeHubzFrame(conn->rbuf, &consumed, &raw);
+    if (ret == 0) {
+      break;
+    }
+    if (ret < 0) {
+      fprintf(stderr, "corrupted hubz frame\n");
+      return false;
+    }
+    conn->rbuf.erase(0, consumed);
+    frames++;
+    frame_bytes += consumed;
+    conn->raw.append(raw);
+    if (!HandleCommands(fd, conn, &conn->raw, true)) {
+      fprintf(stderr, "bad commands in hubz frame\n");
+      return false;
+    }
+  }
+  return true;
+}
+
+int main(int argc, char* argv[]) {
+  if (argc != 2 && argc != 3) {
+    Usage();
+    return 1;
+  }
+  int port = atoi(argv[1]);
+  if (port <= 0 || port + kPikaPortInterval > 65535) {
+    Usage();
+    return 1;
+  }
+  if (argc == 3) {
+    std::string target(argv[2]);
+    size_t colon = target.find(':');
+    if (colon == std::string::npos) {
+      Usage();
+      return 1;
+    }
+    forward_fd = ConnectTo(target.substr(0, colon),
+        atoi(target.c_str() + colon + 1));
+    if (forward_fd < 0) {
+      fprintf(stderr, "connect to %s failed\n", argv[2]);
+      return 1;
+    }
+  }
+
+  int cmd_fd = Listen(port);
+  int data_fd = Listen(port + kPikaPortInterval);
+  if (cmd_fd < 0 || data_fd < 0) {
+    fprintf(stderr, "listen on %d and %d failed: %s\n", port,
+        port + kPikaPortInterval, strerror(errno));
+    return 1;
+  }
+  signal(SIGINT, OnSignal);
+  signal(SIGTERM, OnSignal);
+  signal(SIGPIPE, SIG_IGN);
+
+  std::map<int, Conn> conns;
+  std::vector<struct pollfd> pfds;
+  char buf[64 * 1024];
+  while (!stop) {
+    pfds.clear();
+    struct pollfd pfd;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    pfd.fd = cmd_fd;
+    pfds.push_back(pfd);
+    pfd.fd = data_fd;
+    pfds.push_back(pfd);
+    for (auto& conn : conns) {
+      pfd.fd = conn.first;
+      pfds.push_back(pfd);
+    }
+    if (poll(pfds.data(), pfds.size(), 1000) <= 0) {
+      continue;
+    }
+
+    for (auto& p : pfds) {
+      if (p.revents == 0) {
+        continue;
+      }
+      if (p.fd == cmd_fd || p.fd == data_fd) {
+        int fd = accept(p.fd, nullptr, nullptr);
+        if (fd >= 0) {
+          conns[fd].data_port = p.fd == data_fd;
+        }
+        continue;
+      }
+      Conn* conn = &conns[p.fd];
+      ssize_t n = read(p.fd, buf, sizeof(buf));
+      if (n < 0 && errno == EINTR) {
+        continue;
+      }
+      if (n > 0) {
+        wire_bytes += conn->data_port ? n : 0;
+        conn->rbuf.append(buf, n);
+        if (HandleInput(p.fd, conn)) {
+          continue;
+        }
+      }
+      close(p.fd);
+      conns.erase(p.fd);
+    }
+    fflush(stdout);
+  }
+
+  fprintf(stderr, "received %lu bytes, %lu hubz frames of %lu bytes "
+      "carrying %lu bytes, %lu commands\n", wire_bytes, frames, frame_bytes,
+      raw_bytes, commands);
+  for (auto& conn : conns) {
+    close(conn.first);
+  }
+  close(cmd_fd);
+  close(data_fd);
+  if (forward_fd >= 0) {
+    close(forward_fd);
+  }
+  return 0;
+}
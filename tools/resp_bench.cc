@@ -0,0 +1,146 @@
+//  Copyright (c) 2017-present The pika_hub Authors.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+/*
+ * resp_bench compares AppendRespCommand with the argv and
+ * pink::SerializeRedisCommand path the sender used before, for set, del
+ * and expireat over several key and value sizes:
+ *
+ *   resp_bench [records]
+ *
+ * Every record is checked to be encoded to the same bytes by both first,
+ * then each path appends all the records to a send queue, which is
+ * cleared at the queue limit of the sender like after a flush
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "src/pika_hub_common.h"
+#include "src/pika_hub_resp.h"
+#include "pink/include/redis_cli.h"
+
+// the records are taken from a pool, so the keys are not all cached
+static const size_t kPoolSize = 1024;
+static const size_t kQueueBytes = 1024 * 1024;
+
+struct Case {
+  uint8_t op;
+  const char* name;
+  size_t key_size;
+  size_t value_size;
+};
+
+static const Case kCases[] = {
+  {kSetOPCode, "set", 16, 16},
+  {kSetOPCode, "set", 16, 128},
+  {kSetOPCode, "set", 32, 1024},
+  {kSetOPCode, "set", 64, 16384},
+  {kDelOPCode, "del", 16, 0},
+  {kDelOPCode, "del", 128, 0},
+  {kExpireatOPCode, "expireat", 16, 10},
+  {kExpireatOPCode, "expireat", 128, 10},
+};
+
+static uint64_t NowNanos() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static std::string RandomString(size_t size) {
+  std::string s(size, '\0');
+  for (auto& c : s) {
+    c = static_cast<char>('a' + rand() % 26);
+  }
+  return s;
+}
+
+// the sender before AppendRespCommand
+static void SerializeByArgv(uint8_t op, const rocksutil::Slice& key,
+    const rocksutil::Slice& value, std::string* dst) {
+  pink::RedisCmdArgsType args;
+  std::string tmp_str;
+  switch (op) {
+    case kSetOPCode:
+      args.push_back("set");
+      break;
+    case kDelOPCode:
+      args.push_back("del");
+      break;
+    case kExpireatOPCode:
+      args.push_back("expireat");
+      break;
+  }
+  args.push_back(key.ToString());
+  if (op == kSetOPCode || op == kExpireatOPCode) {
+    args.push_back(value.ToString());
+  }
+  pink::SerializeRedisCommand(args, &tmp_str);
+  dst->append(tmp_str);
+}
+
+int main(int argc, char* argv[]) {
+  size_t records = argc > 1 ? strtoul(argv[1], nullptr, 10) : 1000000;
+  if (records == 0) {
+    fprintf(stderr, "usage: resp_bench [records]\n");
+    return 1;
+  }
+  srand(0);
+
+  printf("%-9s %5s %6s %13s %13s %8s\n", "op", "key", "value",
+      "argv ns/rec", "append ns/rec", "speedup");
+  for (const auto& c : kCases) {
+    std::vector<std::string> keys, values;
+    for (size_t i = 0; i < kPoolSize; i++) {
+      keys.push_back(RandomString(c.key_size));
+      values.push_back(c.op == kExpireatOPCode ?
+          std::to_string(1500000000 + rand()).substr(0, c.value_size) :
+          RandomString(c.value_size));
+    }
+
+    for (size_t i = 0; i < kPoolSize; i++) {
+      std::string expected, actual;
+      SerializeByArgv(c.op, keys[i], values[i], &expected);
+      AppendRespCommand(c.op, keys[i], values[i], &actual);
+      if (expected != actual) {
+        fprintf(stderr, "%s key %zu value %zu: the bytes differ\n",
+            c.name, c.key_size, c.value_size);
+        return 1;
+      }
+    }
+
+    std::string queue;
+    queue.reserve(kQueueBytes * 2);
+    uint64_t start = NowNanos();
+    for (size_t i = 0; i < records; i++) {
+      size_t n = i % kPoolSize;
+      SerializeByArgv(c.op, keys[n], values[n], &queue);
+      if (queue.size() >= kQueueBytes) {
+        queue.clear();
+      }
+    }
+    uint64_t argv_ns = NowNanos() - start;
+
+    queue.clear();
+    start = NowNanos();
+    for (size_t i = 0; i < records; i++) {
+      size_t n = i % kPoolSize;
+      AppendRespCommand(c.op, keys[n], values[n], &queue);
+      if (queue.size() >= kQueueBytes) {
+        queue.clear();
+      }
+    }
+    uint64_t append_ns = NowNanos() - start;
+
+    printf("%-9s %5zu %6zu %13.1f %13.1f %7.2fx\n", c.name, c.key_size,
+        c.value_size, static_cast<double>(argv_ns) / records,
+        static_cast<double>(append_ns) / records,
+        append_ns > 0 ? static_cast<double>(argv_ns) / append_ns : 0.0);
+  }
+  return 0;
+}